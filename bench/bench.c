@@ -0,0 +1,56 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+double bench_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// compare_double: ordre croissant de deux double pour qsort
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// format_latency: écrit dans buf la durée seconds dans l'unité la plus lisible
+static void format_latency(char *buf, size_t size, double seconds) {
+  if (seconds < 1e-3) {
+    snprintf(buf, size, "%.1f us", seconds * 1e6);
+  } else if (seconds < 1) {
+    snprintf(buf, size, "%.2f ms", seconds * 1e3);
+  } else {
+    snprintf(buf, size, "%.3f s", seconds);
+  }
+}
+
+void bench_report(const char *name, double *latencies, long count,
+                  long failed, double elapsed) {
+  printf("%s: %ld done, %ld failed in %.3f s (%.1f/s)\n", name,
+         count - failed, failed, elapsed,
+         elapsed > 0 ? (double)(count - failed) / elapsed : 0);
+  if (count < 1) {
+    return;
+  }
+  qsort(latencies, (size_t)count, sizeof(double), compare_double);
+  double sum = 0;
+  for (long i = 0; i < count; i++) {
+    sum += latencies[i];
+  }
+  const double ranks[] = {0.5, 0.9, 0.99, 0.999};
+  const char *names[] = {"p50", "p90", "p99", "p99.9"};
+  char value[32];
+  format_latency(value, sizeof(value), sum / (double)count);
+  printf("  latency mean %s", value);
+  for (size_t r = 0; r < sizeof(ranks) / sizeof(ranks[0]); r++) {
+    format_latency(value, sizeof(value),
+                   latencies[(long)(ranks[r] * (double)(count - 1))]);
+    printf(", %s %s", names[r], value);
+  }
+  format_latency(value, sizeof(value), latencies[count - 1]);
+  printf(", max %s\n", value);
+}
@@ -0,0 +1,17 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// BENCHMARKS
+// Outils communs aux programmes de mesure de bench/ : horloge et résumé des
+// latences mesurées.
+
+// bench_now: renvoit l'instant présent en secondes (horloge CLOCK_MONOTONIC)
+double bench_now(void);
+
+// bench_report: affiche sous le nom name le débit de count opérations, dont
+// failed ont échoué, effectuées en elapsed secondes, puis la moyenne et les
+// centiles des count latences en secondes de latencies, qui sont triées.
+void bench_report(const char *name, double *latencies, long count,
+                  long failed, double elapsed);
+
+#endif
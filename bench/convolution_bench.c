@@ -0,0 +1,310 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "bmp.h"
+#include "convolution.h"
+
+// CONVOLUTION BENCH
+// convolution_bench [megabytes] [repeat]
+// Compare le moteur de convolution en virgule fixe (shared/convolution.c) au
+// moteur flottant qu'il a remplacé, reproduit ici : sommes en float,
+// division par la somme des poids, 16 canaux par itération en AVX2 si le
+// processeur le permet. Chaque filtre est appliqué à une image générée de
+// megabytes Mo (100 par défaut) sur un seul thread, repeat fois (3 par
+// défaut) dont le meilleur temps est retenu : en 2D par les deux moteurs,
+// dont les sorties doivent être identiques, puis par le chemin séparable du
+// moteur en virgule fixe lorsque le filtre l'est.
+
+#define DEFAULT_MEGABYTES 100
+#define DEFAULT_REPEAT 3
+#define IMAGE_WIDTH 5760
+#define SIMD_LANES 16
+
+typedef struct {
+  const char *name;
+  int32_t size;
+  int16_t matrix[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  bool separable;
+  int16_t row[CONVOLUTION_MAX_SIZE];
+  int16_t col[CONVOLUTION_MAX_SIZE];
+} bench_matrix_t;
+
+static const bench_matrix_t matrices[] = {
+    {"gb", 3, {1, 2, 1, 2, 4, 2, 1, 2, 1}, true, {1, 2, 1}, {1, 2, 1}},
+    {"gb5",
+     5,
+     {1, 4, 6, 4, 1, 4, 16, 24, 16, 4, 6, 24, 36,
+      24, 6, 4, 16, 24, 16, 4, 1, 4, 6, 4, 1},
+     true,
+     {1, 4, 6, 4, 1},
+     {1, 4, 6, 4, 1}},
+    {"bl", 3, {1, 1, 1, 1, 1, 1, 1, 1, 1}, true, {1, 1, 1}, {1, 1, 1}},
+    {"mbh", 3, {0, 0, 0, 1, 1, 1, 0, 0, 0}, true, {1, 1, 1}, {0, 1, 0}},
+    {"sh", 3, {0, -1, 0, -1, 5, -1, 0, -1, 0}, false, {0}, {0}},
+    {"ed", 3, {-1, -1, -1, -1, 8, -1, -1, -1, -1}, false, {0}, {0}},
+    {"em", 3, {-2, -1, 0, -1, 1, 1, 0, 1, 2}, false, {0}, {0}},
+    {"mb", 3, {1, 0, 0, 0, 1, 0, 0, 0, 1}, false, {0}, {0}},
+};
+
+//---- [FLOAT ENGINE  ] ------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// float_store: normalise par weight_sum (si positif), tronque et sature dans
+// [0, 255] la somme sum
+static inline uint8_t float_store(float sum, float weight_sum) {
+  if (weight_sum > 0) {
+    sum /= weight_sum;
+  }
+  return (uint8_t)(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+}
+
+// convolve_float: out[i] = somme(weights[k] * srcs[k][i]) normalisée pour i
+// dans [begin, end)
+static void convolve_float(uint8_t *out, const uint8_t *const *srcs,
+                           const float *weights, int32_t tap_count,
+                           size_t begin, size_t end, float weight_sum) {
+  for (size_t i = begin; i < end; i++) {
+    float sum = 0;
+    for (int32_t k = 0; k < tap_count; k++) {
+      sum += srcs[k][i] * weights[k];
+    }
+    out[i] = float_store(sum, weight_sum);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void convolve_float_avx2(uint8_t *out, const uint8_t *const *srcs,
+                                     const float *weights, int32_t tap_count,
+                                     size_t begin, size_t end,
+                                     float weight_sum) {
+  size_t i = begin;
+  for (; i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m256 acc[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    for (int32_t k = 0; k < tap_count; k++) {
+      __m128i bytes = _mm_loadu_si128((const __m128i *)(srcs[k] + i));
+      __m256 w = _mm256_set1_ps(weights[k]);
+      __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+      __m256 high =
+          _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+      acc[0] = _mm256_add_ps(acc[0], _mm256_mul_ps(low, w));
+      acc[1] = _mm256_add_ps(acc[1], _mm256_mul_ps(high, w));
+    }
+    __m256i values[2];
+    for (int j = 0; j < 2; j++) {
+      if (weight_sum > 0) {
+        acc[j] = _mm256_div_ps(acc[j], _mm256_set1_ps(weight_sum));
+      }
+      values[j] = _mm256_cvttps_epi32(acc[j]);
+    }
+    __m128i packed_low =
+        _mm_packs_epi32(_mm256_castsi256_si128(values[0]),
+                        _mm256_extracti128_si256(values[0], 1));
+    __m128i packed_high =
+        _mm_packs_epi32(_mm256_castsi256_si128(values[1]),
+                        _mm256_extracti128_si256(values[1], 1));
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_packus_epi16(packed_low, packed_high));
+  }
+  convolve_float(out, srcs, weights, tap_count, i, end, weight_sum);
+}
+#endif
+
+typedef void (*convolve_float_t)(uint8_t *, const uint8_t *const *,
+                                 const float *, int32_t, size_t, size_t,
+                                 float);
+
+// clamp_index: ramène p dans [0, n) (politique de bord clamp)
+static inline int32_t clamp_index(int32_t p, int32_t n) {
+  return p < 0 ? 0 : (p >= n ? n - 1 : p);
+}
+
+// float_filter: écrit dans out la convolution 2D en flottants de l'image
+// src de width x height pixels, de lignes de row_size octets, par m
+static void float_filter(uint8_t *out, const uint8_t *src, int32_t width,
+                         int32_t height, int32_t row_size,
+                         const bench_matrix_t *m, convolve_float_t convolve) {
+  int32_t half_size = m->size / 2;
+  const uint8_t *srcs[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  float weights[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  int32_t tap_rows[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  int32_t tap_offsets[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  int32_t tap_count = 0;
+  float weight_sum = 0;
+  for (int32_t k = 0; k < m->size * m->size; k++) {
+    weight_sum += m->matrix[k];
+    if (m->matrix[k] != 0) {
+      tap_rows[tap_count] = k / m->size;
+      tap_offsets[tap_count] = (k % m->size - half_size) * 3;
+      weights[tap_count++] = m->matrix[k];
+    }
+  }
+  for (int32_t y = 0; y < height; y++) {
+    const uint8_t *rows[CONVOLUTION_MAX_SIZE];
+    for (int32_t ky = 0; ky < m->size; ky++) {
+      rows[ky] = src + (size_t)clamp_index(y + ky - half_size, height) *
+                           (size_t)row_size;
+    }
+    uint8_t *row_out = out + (size_t)y * (size_t)row_size;
+
+    // INTERIOR
+    for (int32_t k = 0; k < tap_count; k++) {
+      srcs[k] = rows[tap_rows[k]] + tap_offsets[k];
+    }
+    convolve(row_out, srcs, weights, tap_count, (size_t)half_size * 3,
+             (size_t)(width - half_size) * 3, weight_sum);
+
+    // BORDERS
+    for (int32_t i = 0; i < 2 * half_size; i++) {
+      int32_t x = i < half_size ? i : width - 2 * half_size + i;
+      for (int32_t c = 0; c < 3; c++) {
+        float sum = 0;
+        for (int32_t k = 0; k < tap_count; k++) {
+          int32_t px = clamp_index(x + tap_offsets[k] / 3, width);
+          sum += rows[tap_rows[k]][px * 3 + c] * weights[k];
+        }
+        row_out[x * 3 + c] = float_store(sum, weight_sum);
+      }
+    }
+  }
+}
+
+//---- [FIXED POINT   ] ------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// fixed_filter: applique m à l'image img de hauteur height, en place, par le
+// moteur en virgule fixe, en 2D ou par son chemin séparable si separable.
+// Renvoit 0 en cas de succes, -1 sinon.
+static int fixed_filter(bmp_mapped_image_t *img, int32_t height,
+                        const bench_matrix_t *m, bool separable) {
+  int16_t matrix[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  memcpy(matrix, m->matrix, sizeof(matrix));
+  convolution_matrix_t conv = {.matrix = matrix,
+                               .size = m->size,
+                               .row = separable ? m->row : nullptr,
+                               .col = separable ? m->col : nullptr};
+  bmp_halo_t halo;
+  if (bmp_halo_init(&halo, img, height, height, BMP_MAX_HALO) == -1) {
+    return -1;
+  }
+  thread_filter_args_t args = {.img = img,
+                               .start_line = 0,
+                               .end_line = height,
+                               .halo = &halo,
+                               .border = BORDER_CLAMP,
+                               .carry = nullptr};
+  void *ret = generic_convolution_filter(&args, &conv);
+  free(args.carry);
+  bmp_halo_dispose(&halo);
+  return ret == FILTER_FAILED ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    fprintf(stderr, "Usage: %s [megabytes] [repeat]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  long megabytes = argc > 1 ? strtol(argv[1], nullptr, 10) : DEFAULT_MEGABYTES;
+  long repeat = argc > 2 ? strtol(argv[2], nullptr, 10) : DEFAULT_REPEAT;
+  if (megabytes < 1 || megabytes > 4096 || repeat < 1) {
+    fprintf(stderr, "%s: Invalid megabytes or repeat\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int32_t width = IMAGE_WIDTH;
+  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+  int32_t height = (int32_t)(megabytes * 1000000 / row_size);
+  size_t size = (size_t)row_size * (size_t)height;
+
+  convolve_float_t convolve = convolve_float;
+  const char *engine = "generic";
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    convolve = convolve_float_avx2;
+    engine = "avx2";
+  }
+#endif
+
+  uint8_t *source = malloc(size);
+  uint8_t *fixed = malloc(size);
+  uint8_t *floating = malloc(size);
+  if (source == nullptr || fixed == nullptr || floating == nullptr) {
+    perror("malloc");
+    free(source);
+    free(fixed);
+    free(floating);
+    return EXIT_FAILURE;
+  }
+  uint32_t seed = 0x9E3779B9;
+  for (size_t i = 0; i < size; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    source[i] = (uint8_t)seed;
+  }
+  bmp_file_header_t file_h = {.signature = BMP_SIGNATURE};
+  bmp_dib_header_t dib_h = {.header_size = sizeof(bmp_dib_header_t),
+                            .width = width,
+                            .height = height,
+                            .planes = 1,
+                            .bit_count = 24};
+  bmp_mapped_image_t img = {.file_h = &file_h, .dib_h = &dib_h,
+                            .pixels = fixed};
+
+  printf("%dx%d image (%.1f MB), one thread, best of %ld, float kernel %s\n",
+         width, height, (double)size / 1e6, repeat, engine);
+  printf("filter   float 2D   fixed 2D   fixed sep   speedup   differ\n");
+  int ret = EXIT_SUCCESS;
+  for (size_t f = 0; f < sizeof(matrices) / sizeof(matrices[0]); f++) {
+    const bench_matrix_t *m = &matrices[f];
+    double best_float = 0;
+    double best_fixed = 0;
+    double best_separable = 0;
+    for (long r = 0; r < repeat; r++) {
+      double start = bench_now();
+      float_filter(floating, source, width, height, row_size, m, convolve);
+      double elapsed = bench_now() - start;
+      best_float = r == 0 || elapsed < best_float ? elapsed : best_float;
+
+      // 2D last: its output is compared to the float engine's
+      for (int pass = m->separable ? 0 : 1; pass < 2; pass++) {
+        bool separable = pass == 0;
+        memcpy(fixed, source, size);
+        start = bench_now();
+        if (fixed_filter(&img, height, m, separable) == -1) {
+          perror("fixed_filter");
+          ret = EXIT_FAILURE;
+        }
+        elapsed = bench_now() - start;
+        double *best = separable ? &best_separable : &best_fixed;
+        *best = r == 0 || elapsed < *best ? elapsed : *best;
+      }
+    }
+    size_t differ = 0;
+    for (size_t i = 0; i < size; i++) {
+      differ += fixed[i] != floating[i] ? 1 : 0;
+    }
+    if (differ > 0) {
+      ret = EXIT_FAILURE;
+    }
+    char sep[16] = "-";
+    if (m->separable) {
+      snprintf(sep, sizeof(sep), "%.1f ms", best_separable * 1e3);
+    }
+    printf("%-6s %8.1f ms %8.1f ms %11s %8.2fx %8zu\n", m->name,
+           best_float * 1e3, best_fixed * 1e3, sep,
+           best_fixed > 0 ? best_float / best_fixed : 0, differ);
+  }
+
+  free(source);
+  free(fixed);
+  free(floating);
+  return ret;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bmpfilter.h"
+
+// DISPATCH BENCH
+// dispatch_bench <input> [clients]
+// Mesure la latence de répartition du serveur sous clients (1000 par défaut)
+// clients concurrents : chaque client est un processus qui, une fois tous
+// créés, se connecte au socket du serveur et y envoie une seule requête, filtre
+// identity, de l'image input (de préférence petite) vers un fichier. La latence
+// de chaque requête est affichée depuis la connexion et depuis l'envoi de la
+// requête, jusqu'à la réponse. Le serveur doit fonctionner, sans cache de
+// résultats (cache_size=0) : les requêtes identiques seraient sinon servies
+// sans passer par les workers.
+
+#define DEFAULT_CLIENTS 1000
+#define MAX_CLIENTS 10000
+#define OUTPUT_FORMAT "/tmp/dispatch_bench_%ld.bmp"
+
+// Mesures d'un client, partagées avec le processus principal
+typedef struct {
+  double from_connect;
+  double from_send;
+  int status; // 0 en cas de succes, valeur d'errno sinon
+} client_result_t;
+
+// on_reply: fonction de rappel de la requête d'un client
+static void on_reply(int status, void *user_data) {
+  *(int *)user_data = status;
+}
+
+// run_client: attend que start soit fermé, puis envoie la requête du client
+// index et écrit ses mesures dans result
+static void run_client(int start, const char *input, long index,
+                       client_result_t *result) {
+  char c;
+  while (read(start, &c, 1) == -1 && errno == EINTR) {
+  }
+  char output[64];
+  snprintf(output, sizeof(output), OUTPUT_FORMAT, index);
+  bmpfilter_options_t options = {
+      .filters = {identity}, .filter_count = 1, .border = BORDER_CLAMP};
+  int status = -1;
+  double connected = bench_now();
+  bmpfilter_session_t *session = bmpfilter_open(1);
+  if (session == nullptr) {
+    result->status = errno;
+    return;
+  }
+  double sent = bench_now();
+  if (bmpfilter_submit_file(session, input, output, &options, on_reply,
+                            &status) == -1) {
+    result->status = errno;
+    bmpfilter_close(session);
+    return;
+  }
+  while (status == -1) {
+    if (bmpfilter_wait(session, -1) == -1) {
+      status = errno;
+    }
+  }
+  double replied = bench_now();
+  bmpfilter_close(session);
+  unlink(output);
+  *result = (client_result_t){.from_connect = replied - connected,
+                              .from_send = replied - sent,
+                              .status = status};
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <input> [clients]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  long clients = argc > 2 ? strtol(argv[2], nullptr, 10) : DEFAULT_CLIENTS;
+  if (clients < 1 || clients > MAX_CLIENTS) {
+    fprintf(stderr, "%s: Invalid clients\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  // The server resolves paths from its own working directory
+  char input[PATH_MAX];
+  if (realpath(argv[1], input) == nullptr) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  size_t results_size = sizeof(client_result_t) * (size_t)clients;
+  client_result_t *results =
+      mmap(nullptr, results_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  double *latencies = malloc(sizeof(double) * (size_t)clients);
+  if (results == MAP_FAILED || latencies == nullptr) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  int start[2];
+  if (pipe(start) == -1) {
+    perror("pipe");
+    return EXIT_FAILURE;
+  }
+
+  // CLIENTS
+  // All created before the first connects: closing start releases them
+  long created = 0;
+  for (; created < clients; created++) {
+    results[created] = (client_result_t){.status = ECHILD};
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(start[1]);
+      run_client(start[0], input, created, &results[created]);
+      _exit(EXIT_SUCCESS);
+    }
+    if (pid == -1) {
+      perror("fork");
+      break;
+    }
+  }
+  close(start[0]);
+  double begin = bench_now();
+  close(start[1]);
+  while (wait(nullptr) != -1 || errno == EINTR) {
+  }
+  double elapsed = bench_now() - begin;
+
+  printf("%ld clients, one request each\n", created);
+  long failed = 0;
+  for (long i = 0; i < created; i++) {
+    if (results[i].status != 0) {
+      if (failed++ == 0) {
+        fprintf(stderr, "request: %s\n", strerror(results[i].status));
+      }
+    }
+  }
+  for (long i = 0; i < created; i++) {
+    latencies[i] = results[i].from_connect;
+  }
+  bench_report("from connect", latencies, created, failed, elapsed);
+  for (long i = 0; i < created; i++) {
+    latencies[i] = results[i].from_send;
+  }
+  bench_report("from send", latencies, created, failed, elapsed);
+
+  free(latencies);
+  munmap(results, results_size);
+  return created == clients && failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "full_io.h"
+
+// FIFO BENCH
+// fifo_bench [output_dir] [repeat]
+// Mesure le débit de la FIFO de réponse pour des images de 1, 10 et 100 Mo,
+// d'un processus écrivain (le worker) à un processus lecteur (le client) qui
+// écrit l'image dans un fichier de output_dir (/tmp par défaut) :
+// - chunks : transfert par blocs de PIPE_BUF octets, une alarme réarmée
+//   (sigaction puis alarm) pour chaque bloc de chaque côté, le lecteur
+//   copiant chaque bloc dans un tampon avant de l'écrire, comme avant ;
+// - splice : FIFO agrandie par F_SETPIPE_SZ et non bloquante, image placée
+//   par vmsplice côté écrivain et déplacée par splice vers le fichier côté
+//   lecteur, avec les fonctions de full_io.h du serveur et du client.
+// Chaque transfert est répété repeat fois (5 par défaut), la médiane de la
+// durée de bout en bout est affichée.
+
+#define DEFAULT_REPEAT 5
+#define MAX_REPEAT 101
+#define PIPE_SIZE (1024 * 1024) // RESPONSE_PIPE_SIZE du serveur
+#define TIMEOUT 5
+
+static const size_t sizes[] = {1000000, 10000000, 100000000};
+
+// handle_sigalrm: fonction de traitement de l'alarme d'un bloc
+static void handle_sigalrm(int sig) { (void)sig; }
+
+// arm_timeout: réarme l'alarme d'un bloc comme le faisaient le serveur et le
+// client
+static void arm_timeout(unsigned int seconds) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_sigalrm;
+  sigaction(SIGALRM, &sa, nullptr);
+  alarm(seconds);
+}
+
+// write_chunks: écrit les size octets de data dans fifo par blocs de PIPE_BUF
+// octets. Renvoit 0 en cas de succes, -1 sinon.
+static int write_chunks(int fifo, const char *data, size_t size) {
+  while (size > 0) {
+    size_t n = size > PIPE_BUF ? PIPE_BUF : size;
+    arm_timeout(TIMEOUT);
+    if (full_write(fifo, data, n) != (ssize_t)n) {
+      return -1;
+    }
+    alarm(0);
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// read_chunks: copie size octets de fifo vers out par blocs de PIPE_BUF
+// octets. Renvoit 0 en cas de succes, -1 sinon.
+static int read_chunks(int fifo, int out, size_t size) {
+  char buffer[PIPE_BUF];
+  while (size > 0) {
+    size_t n = size > PIPE_BUF ? PIPE_BUF : size;
+    arm_timeout(TIMEOUT);
+    if (full_read(fifo, buffer, n) != (ssize_t)n ||
+        full_write(out, buffer, n) != (ssize_t)n) {
+      return -1;
+    }
+    alarm(0);
+    size -= n;
+  }
+  return 0;
+}
+
+// write_splice: place les size octets de data dans fifo par vmsplice.
+// Renvoit 0 en cas de succes, -1 sinon.
+static int write_splice(int fifo, const char *data, size_t size) {
+  fcntl(fifo, F_SETPIPE_SZ, PIPE_SIZE);
+  if (fcntl(fifo, F_SETFL, O_NONBLOCK) == -1) {
+    return -1;
+  }
+  return full_vmsplice(fifo, data, size, TIMEOUT) == (ssize_t)size ? 0 : -1;
+}
+
+// read_splice: déplace size octets de fifo vers out par splice. Renvoit 0 en
+// cas de succes, -1 sinon.
+static int read_splice(int fifo, int out, size_t size) {
+  if (fcntl(fifo, F_SETFL, O_NONBLOCK) == -1) {
+    return -1;
+  }
+  return full_splice(fifo, out, size, TIMEOUT) == (ssize_t)size ? 0 : -1;
+}
+
+// transfer: transfère les size octets de data par la FIFO fifo_path vers le
+// fichier output, en chunks ou par splice selon use_splice. Renvoit la durée
+// du transfert en secondes, -1 en cas d'échec.
+static double transfer(const char *fifo_path, const char *output,
+                       const char *data, size_t size, bool use_splice) {
+  int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out == -1) {
+    return -1;
+  }
+  double start = bench_now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fifo = open(fifo_path, O_WRONLY);
+    int ret = fifo == -1 ? -1
+              : use_splice ? write_splice(fifo, data, size)
+                           : write_chunks(fifo, data, size);
+    _exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  if (pid == -1) {
+    close(out);
+    return -1;
+  }
+  int fifo = open(fifo_path, O_RDONLY);
+  int ret = fifo == -1 ? -1
+            : use_splice ? read_splice(fifo, out, size)
+                         : read_chunks(fifo, out, size);
+  if (fifo != -1) {
+    close(fifo);
+  }
+  int status;
+  if (close(out) == -1 || waitpid(pid, &status, 0) == -1 ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    ret = -1;
+  }
+  double elapsed = bench_now() - start;
+  return ret == 0 ? elapsed : -1;
+}
+
+// compare_double: ordre croissant de deux double pour qsort
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    fprintf(stderr, "Usage: %s [output_dir] [repeat]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *dir = argc > 1 ? argv[1] : "/tmp";
+  long repeat = argc > 2 ? strtol(argv[2], nullptr, 10) : DEFAULT_REPEAT;
+  if (repeat < 1 || repeat > MAX_REPEAT) {
+    fprintf(stderr, "%s: Invalid repeat\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char fifo_path[PATH_MAX];
+  char output[PATH_MAX];
+  snprintf(fifo_path, sizeof(fifo_path), "%s/fifo_bench_%d", dir, getpid());
+  snprintf(output, sizeof(output), "%s/fifo_bench_%d.bmp", dir, getpid());
+  if (mkfifo(fifo_path, 0600) == -1) {
+    perror(fifo_path);
+    return EXIT_FAILURE;
+  }
+
+  int ret = EXIT_SUCCESS;
+  printf("size       chunks              splice              speedup\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t size = sizes[s];
+    char *data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      perror("mmap");
+      ret = EXIT_FAILURE;
+      break;
+    }
+    memset(data, 0x5A, size);
+    double medians[2];
+    for (int mode = 0; mode < 2 && ret == EXIT_SUCCESS; mode++) {
+      double times[MAX_REPEAT];
+      for (long r = 0; r < repeat; r++) {
+        times[r] = transfer(fifo_path, output, data, size, mode == 1);
+        if (times[r] < 0) {
+          perror("transfer");
+          ret = EXIT_FAILURE;
+          break;
+        }
+      }
+      qsort(times, (size_t)repeat, sizeof(double), compare_double);
+      medians[mode] = times[repeat / 2];
+    }
+    munmap(data, size);
+    if (ret != EXIT_SUCCESS) {
+      break;
+    }
+    printf("%4zu MB  %7.2f ms %6.0f MB/s  %7.2f ms %6.0f MB/s  %6.2fx\n",
+           size / 1000000, medians[0] * 1e3,
+           (double)size / 1e6 / medians[0], medians[1] * 1e3,
+           (double)size / 1e6 / medians[1], medians[0] / medians[1]);
+  }
+
+  unlink(output);
+  unlink(fifo_path);
+  return ret;
+}
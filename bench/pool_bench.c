@@ -0,0 +1,337 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bmp.h"
+#include "bmpfilter.h"
+#include "full_io.h"
+
+// POOL BENCH
+// pool_bench <input> [count] [concurrency] [filter] [threads]
+// Compare les workers du serveur, créés au démarrage, à un processus créé par
+// requête. Les count requêtes (1000 par défaut) filtrent l'image input vers
+// un fichier, au plus concurrency (4 par défaut) à la fois, avec le filtre
+// d'option courte filter (sep par défaut) :
+// - fork : chaque requête est traitée par un processus créé pour elle, qui
+//   projette l'image, la filtre avec threads threads (4 par défaut) créés pour
+//   elle puis écrit le résultat, comme le faisait le serveur avant son pool ;
+// - pool : chaque requête est envoyée par libbmpfilter au serveur, qui doit
+//   fonctionner, sans cache de résultats (cache_size=0) : les requêtes
+//   identiques seraient sinon servies sans filtrage.
+// La latence de chaque requête (de sa soumission à sa fin) et le débit sont
+// affichés pour chaque mode.
+
+#define DEFAULT_COUNT 1000
+#define DEFAULT_CONCURRENCY 4
+#define DEFAULT_THREADS 4
+#define MAX_THREADS 64
+#define OUTPUT_FORMAT "/tmp/pool_bench_%d.bmp"
+
+typedef struct {
+  const char *flag;
+  filter_t filter;
+  filter_func_t func;
+  bool complex;
+} bench_filter_t;
+
+#define OPT_TO_REQUEST_SIMPLE_FILTER(filter, short_flag, long_flag, desc,      \
+                                     func)                                     \
+  {short_flag, filter, func, false},
+#define OPT_TO_REQUEST_COMPLEX_FILTER(filter, short_flag, long_flag, desc,     \
+                                      func)                                    \
+  {short_flag, filter, func, true},
+static const bench_filter_t bench_filters[] = {
+    OPT_TO_REQUEST_SIMPLE_FILTERS OPT_TO_REQUEST_COMPLEX_FILTERS};
+#undef OPT_TO_REQUEST_SIMPLE_FILTER
+#undef OPT_TO_REQUEST_COMPLEX_FILTER
+
+typedef struct {
+  filter_func_t func;
+  thread_filter_args_t args;
+} band_t;
+
+// run_band: applique le filtre de la bande pointé par arg
+static void *run_band(void *arg) {
+  band_t *band = arg;
+  void *ret = band->func(&band->args);
+  free(band->args.carry);
+  return ret;
+}
+
+// filter_request: filtre l'image input vers le fichier output avec threads
+// threads créés pour l'occasion. Renvoit 0 en cas de succes, -1 sinon.
+static int filter_request(const char *input, const char *output,
+                          const bench_filter_t *f, int threads) {
+  int fd = open(input, O_RDONLY);
+  struct stat s;
+  if (fd == -1 || fstat(fd, &s) == -1) {
+    return -1;
+  }
+  void *data = mmap(nullptr, (size_t)s.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  bmp_mapped_image_t img = {.file_h = data};
+  img.dib_h = (bmp_dib_header_t *)((char *)data + sizeof(bmp_file_header_t));
+  if (!bmp_headers_valid(img.file_h, img.dib_h, (size_t)s.st_size)) {
+    errno = EINVAL;
+    return -1;
+  }
+  img.pixels = (char *)data + img.file_h->pixel_array_offset;
+  int32_t height =
+      img.dib_h->height > 0 ? img.dib_h->height : -img.dib_h->height;
+
+  // BANDS
+  int32_t band_rows = (height + threads - 1) / threads;
+  if (band_rows < 2 * BMP_MAX_HALO) {
+    band_rows = 2 * BMP_MAX_HALO;
+  }
+  bmp_halo_t halo = {.boundaries = nullptr};
+  if (f->complex &&
+      bmp_halo_init(&halo, &img, height, band_rows, BMP_MAX_HALO) == -1) {
+    return -1;
+  }
+  int32_t band_count = (height + band_rows - 1) / band_rows;
+  for (int32_t b = 0; f->complex && b < band_count; b++) {
+    if (bmp_halo_capture(&halo, b) == -1) {
+      return -1;
+    }
+  }
+  band_t bands[MAX_THREADS];
+  pthread_t tids[MAX_THREADS];
+  for (int32_t b = 0; b < band_count; b++) {
+    bands[b] = (band_t){
+        .func = f->func,
+        .args = {.img = &img,
+                 .start_line = b * band_rows,
+                 .end_line = b + 1 < band_count ? (b + 1) * band_rows : height,
+                 .halo = f->complex ? &halo : nullptr,
+                 .border = BORDER_CLAMP,
+                 .carry = nullptr}};
+    if (pthread_create(&tids[b], nullptr, run_band, &bands[b]) != 0) {
+      return -1;
+    }
+  }
+  int ret = 0;
+  for (int32_t b = 0; b < band_count; b++) {
+    void *status;
+    pthread_join(tids[b], &status);
+    if (status == FILTER_FAILED) {
+      ret = -1;
+    }
+  }
+  bmp_halo_dispose(&halo);
+
+  // WRITE
+  int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out == -1 || full_write(out, data, (size_t)s.st_size) != s.st_size) {
+    ret = -1;
+  }
+  if (out != -1) {
+    close(out);
+  }
+  munmap(data, (size_t)s.st_size);
+  return ret;
+}
+
+// run_fork: traite count requêtes, chacune dans un processus créé pour elle,
+// au plus concurrency à la fois, écrit leurs latences dans latencies et le
+// nombre de requêtes échouées dans failed. Renvoit le nombre de requêtes
+// terminées, moins de count en cas d'échec de fork ou de wait.
+static long run_fork(const char *input, const bench_filter_t *f, long count,
+                     int concurrency, int threads, double *latencies,
+                     long *failed) {
+  pid_t pids[BMPFILTER_MAX_IN_FLIGHT] = {0}; // par sortie, 0 si libre
+  double starts[BMPFILTER_MAX_IN_FLIGHT];
+  long submitted = 0;
+  long done = 0;
+  *failed = 0;
+  while (done < count) {
+    for (int slot = 0; slot < concurrency && submitted < count; slot++) {
+      if (pids[slot] != 0) {
+        continue;
+      }
+      char output[64];
+      snprintf(output, sizeof(output), OUTPUT_FORMAT, slot);
+      starts[slot] = bench_now();
+      pid_t pid = fork();
+      if (pid == 0) {
+        _exit(filter_request(input, output, f, threads) == 0 ? EXIT_SUCCESS
+                                                              : EXIT_FAILURE);
+      }
+      if (pid == -1) {
+        perror("fork");
+        return done;
+      }
+      pids[slot] = pid;
+      submitted++;
+    }
+    int status;
+    pid_t pid = wait(&status);
+    if (pid == -1) {
+      perror("wait");
+      return done;
+    }
+    for (int slot = 0; slot < concurrency; slot++) {
+      if (pids[slot] == pid) {
+        latencies[done++] = bench_now() - starts[slot];
+        pids[slot] = 0;
+      }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      (*failed)++;
+    }
+  }
+  return done;
+}
+
+typedef struct {
+  double *latencies;
+  long done;
+  long failed;
+  int *free_slots;
+  int free_count;
+} pool_t;
+
+typedef struct {
+  pool_t *pool;
+  int slot;
+  double start;
+} pool_ctx_t;
+
+// on_filtered: fonction de rappel d'une requête envoyée au serveur
+static void on_filtered(int status, void *user_data) {
+  pool_ctx_t *ctx = user_data;
+  pool_t *pool = ctx->pool;
+  pool->latencies[pool->done++] = bench_now() - ctx->start;
+  if (status != 0) {
+    pool->failed++;
+    fprintf(stderr, "request: %s\n", strerror(status));
+  }
+  pool->free_slots[pool->free_count++] = ctx->slot;
+}
+
+// run_pool: envoie count requêtes au serveur, au plus concurrency à la fois,
+// écrit leurs latences dans latencies et le nombre de requêtes échouées dans
+// failed. Renvoit le nombre de requêtes terminées, moins de count si la
+// session a échoué.
+static long run_pool(const char *input, const bench_filter_t *f, long count,
+                     int concurrency, double *latencies, long *failed) {
+  pool_ctx_t ctxs[BMPFILTER_MAX_IN_FLIGHT];
+  int free_slots[BMPFILTER_MAX_IN_FLIGHT];
+  pool_t pool = {.latencies = latencies, .free_slots = free_slots};
+  for (int i = 0; i < concurrency; i++) {
+    ctxs[i] = (pool_ctx_t){.pool = &pool, .slot = i};
+    free_slots[pool.free_count++] = i;
+  }
+  bmpfilter_session_t *session = bmpfilter_open((uint32_t)concurrency);
+  if (session == nullptr) {
+    perror("bmpfilter_open");
+    *failed = 0;
+    return 0;
+  }
+  bmpfilter_options_t options = {.filters = {f->filter},
+                                 .filter_count = 1,
+                                 .border = BORDER_CLAMP};
+  long submitted = 0;
+  while (pool.done < count) {
+    while (submitted < count && pool.free_count > 0) {
+      pool_ctx_t *ctx = &ctxs[pool.free_slots[pool.free_count - 1]];
+      char output[64];
+      snprintf(output, sizeof(output), OUTPUT_FORMAT, ctx->slot);
+      ctx->start = bench_now();
+      if (bmpfilter_submit_file(session, input, output, &options, on_filtered,
+                                ctx) == -1) {
+        perror("bmpfilter_submit_file");
+        count = submitted; // waits for the requests already sent
+        break;
+      }
+      pool.free_count--;
+      submitted++;
+    }
+    if (bmpfilter_wait(session, -1) == -1) {
+      perror("bmpfilter_wait");
+      break;
+    }
+  }
+  bmpfilter_close(session);
+  *failed = pool.failed;
+  return pool.done;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 6) {
+    fprintf(stderr,
+            "Usage: %s <input> [count] [concurrency] [filter] [threads]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  long count = argc > 2 ? strtol(argv[2], nullptr, 10) : DEFAULT_COUNT;
+  long concurrency =
+      argc > 3 ? strtol(argv[3], nullptr, 10) : DEFAULT_CONCURRENCY;
+  const char *flag = argc > 4 ? argv[4] : "sep";
+  long threads = argc > 5 ? strtol(argv[5], nullptr, 10) : DEFAULT_THREADS;
+  if (count < 1 || concurrency < 1 || concurrency > BMPFILTER_MAX_IN_FLIGHT ||
+      threads < 1 || threads > MAX_THREADS) {
+    fprintf(stderr, "%s: Invalid count, concurrency or threads\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const bench_filter_t *f = nullptr;
+  for (size_t i = 0; i < sizeof(bench_filters) / sizeof(bench_filters[0]);
+       i++) {
+    if (strcmp(bench_filters[i].flag, flag) == 0) {
+      f = &bench_filters[i];
+    }
+  }
+  if (f == nullptr) {
+    fprintf(stderr, "%s: Unknown filter %s\n", argv[0], flag);
+    return EXIT_FAILURE;
+  }
+  // The server resolves paths from its own working directory
+  char input[PATH_MAX];
+  if (realpath(argv[1], input) == nullptr) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  double *latencies = malloc(sizeof(double) * (size_t)count);
+  if (latencies == nullptr) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld requests -%s, %ld at a time\n", count, flag, concurrency);
+  int ret = EXIT_SUCCESS;
+  long failed;
+  double start = bench_now();
+  long done = run_fork(input, f, count, (int)concurrency, (int)threads,
+                       latencies, &failed);
+  bench_report("fork", latencies, done, failed, bench_now() - start);
+  if (done < count || failed > 0) {
+    ret = EXIT_FAILURE;
+  }
+  start = bench_now();
+  done = run_pool(input, f, count, (int)concurrency, latencies, &failed);
+  bench_report("pool", latencies, done, failed, bench_now() - start);
+  if (done < count || failed > 0) {
+    ret = EXIT_FAILURE;
+  }
+
+  for (long i = 0; i < concurrency; i++) {
+    char output[64];
+    snprintf(output, sizeof(output), OUTPUT_FORMAT, (int)i);
+    unlink(output);
+  }
+  free(latencies);
+  return ret;
+}
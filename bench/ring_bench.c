@@ -0,0 +1,251 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS, memfd_create
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "request_ring.h"
+#include "utils.h"
+
+// RING BENCH
+// ring_bench [producers] [pushes] [consumers] [capacity]
+// Mesure la latence d'ajout d'une requête à la file partagée : producers
+// processus producteurs (64 par défaut), libérés ensemble, ajoutent chacun
+// pushes requêtes (2000 par défaut) aussi vite que possible, pendant que
+// consumers processus consommateurs (10 par défaut) la vident :
+// - semaphores : file de REQUEST_FIFO_SIZE requêtes complètes protégée par
+//   les sémaphores empty, full, write et read, comme avant ;
+// - ring : file sans verrou de request_ring.h de capacity cases (1024 par
+//   défaut, queue_size du serveur), dans un segment privé.
+// La latence de chaque ajout (attente d'une place comprise) et le débit sont
+// affichés pour chaque file.
+
+#define DEFAULT_PRODUCERS 64
+#define DEFAULT_PUSHES 2000
+#define DEFAULT_CONSUMERS 10
+#define DEFAULT_CAPACITY 1024
+#define MAX_PROCESSES 1024
+#define MAX_CAPACITY 65536
+#define REQUEST_FIFO_SIZE 10 // capacité de l'ancienne file
+
+// Ancienne file, dont les sémaphores nommés sont ici anonymes et partagés
+typedef struct {
+  sem_t empty;
+  sem_t full;
+  sem_t write;
+  sem_t read;
+  int write_pos;
+  int read_pos;
+  filter_request_t buffer[REQUEST_FIFO_SIZE];
+} sem_queue_t;
+
+// Zone partagée entre le processus principal et ceux qu'il crée
+typedef struct {
+  sem_queue_t queue;
+  request_t *ring;
+  _Atomic long popped;
+  long total;
+  double latencies[];
+} shared_t;
+
+// sem_push: ajoute rq à l'ancienne file. Renvoit 0 en cas de succes, -1
+// sinon.
+static int sem_push(sem_queue_t *q, const filter_request_t *rq) {
+  if (P(&q->empty) == -1 || P(&q->write) == -1) {
+    return -1;
+  }
+  q->buffer[q->write_pos] = *rq;
+  q->write_pos = (q->write_pos + 1) % REQUEST_FIFO_SIZE;
+  V(&q->write);
+  V(&q->full);
+  return 0;
+}
+
+// sem_consume: retire les requêtes de l'ancienne file jusqu'à ce que toutes
+// aient été retirées
+static void sem_consume(shared_t *sh) {
+  sem_queue_t *q = &sh->queue;
+  filter_request_t rq;
+  while (P(&q->full) == 0) {
+    if (atomic_load(&sh->popped) >= sh->total) {
+      V(&q->full); // passes the end on to the next consumer
+      return;
+    }
+    P(&q->read);
+    memcpy(&rq, &q->buffer[q->read_pos], sizeof(rq));
+    q->read_pos = (q->read_pos + 1) % REQUEST_FIFO_SIZE;
+    V(&q->read);
+    V(&q->empty);
+    if (atomic_fetch_add(&sh->popped, 1) + 1 == sh->total) {
+      V(&q->full);
+    }
+  }
+}
+
+// ring_consume: retire les requêtes de la file sans verrou jusqu'à ce que
+// toutes aient été retirées
+static void ring_consume(shared_t *sh, int consumers) {
+  filter_request_t rq;
+  while (atomic_load(&sh->popped) < sh->total) {
+    uint32_t seen = request_ring_ready(sh->ring);
+    if (request_ring_try_pop(sh->ring, &rq) == 0) {
+      if (atomic_fetch_add(&sh->popped, 1) + 1 == sh->total) {
+        for (int i = 0; i < consumers; i++) {
+          request_ring_notify(sh->ring);
+        }
+      }
+    } else if (errno == EAGAIN) {
+      request_ring_wait(sh->ring, seen);
+    } else {
+      perror("request_ring_try_pop");
+      atomic_fetch_add(&sh->popped, 1);
+    }
+  }
+}
+
+// produce: attend que start soit fermé, puis ajoute pushes requêtes à la
+// file choisie par use_ring et écrit leurs latences dans latencies. Renvoit
+// 0 en cas de succes, -1 sinon.
+static int produce(shared_t *sh, int start, long pushes, bool use_ring,
+                   double *latencies) {
+  char c;
+  while (read(start, &c, 1) == -1 && errno == EINTR) {
+  }
+  filter_request_t rq = {.pid = getpid(),
+                         .filters = {identity},
+                         .filter_count = 1,
+                         .border = BORDER_CLAMP,
+                         .response = RESPONSE_FIFO};
+  snprintf(rq.path, sizeof(rq.path), "/tmp/ring_bench_%d.bmp", rq.pid);
+  for (long i = 0; i < pushes; i++) {
+    double t = bench_now();
+    int ret = use_ring ? request_ring_push(sh->ring, &rq)
+                       : sem_push(&sh->queue, &rq);
+    latencies[i] = bench_now() - t;
+    if (ret == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// run: lance consumers consommateurs et producers producteurs de pushes
+// requêtes sur la file choisie par use_ring, attend leur fin et affiche les
+// mesures sous le nom name. Renvoit 0 en cas de succes, -1 sinon.
+static int run(shared_t *sh, const char *name, int producers, long pushes,
+               int consumers, bool use_ring) {
+  atomic_store(&sh->popped, 0);
+  int start[2];
+  if (pipe(start) == -1) {
+    perror("pipe");
+    return -1;
+  }
+  int ret = 0;
+  int created = 0;
+  for (; created < consumers + producers; created++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(start[1]);
+      int p = created - consumers;
+      if (p < 0) {
+        close(start[0]);
+        if (use_ring) {
+          ring_consume(sh, consumers);
+        } else {
+          sem_consume(sh);
+        }
+        _exit(EXIT_SUCCESS);
+      }
+      _exit(produce(sh, start[0], pushes, use_ring,
+                    &sh->latencies[p * pushes]) == 0
+                ? EXIT_SUCCESS
+                : EXIT_FAILURE);
+    }
+    if (pid == -1) {
+      perror("fork");
+      ret = -1;
+      break;
+    }
+  }
+  close(start[0]);
+  double begin = bench_now();
+  close(start[1]);
+  int status;
+  pid_t pid;
+  while ((pid = wait(&status)) != -1 || errno == EINTR) {
+    if (pid != -1 &&
+        (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)) {
+      ret = -1;
+    }
+  }
+  double elapsed = bench_now() - begin;
+  if (ret == 0) {
+    bench_report(name, sh->latencies, sh->total, 0, elapsed);
+  }
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 5) {
+    fprintf(stderr, "Usage: %s [producers] [pushes] [consumers] [capacity]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  long producers =
+      argc > 1 ? strtol(argv[1], nullptr, 10) : DEFAULT_PRODUCERS;
+  long pushes = argc > 2 ? strtol(argv[2], nullptr, 10) : DEFAULT_PUSHES;
+  long consumers =
+      argc > 3 ? strtol(argv[3], nullptr, 10) : DEFAULT_CONSUMERS;
+  long capacity = argc > 4 ? strtol(argv[4], nullptr, 10) : DEFAULT_CAPACITY;
+  if (producers < 1 || consumers < 1 ||
+      producers + consumers > MAX_PROCESSES || pushes < 1 ||
+      pushes > 1000000 || capacity < 1 || capacity > MAX_CAPACITY) {
+    fprintf(stderr, "%s: Invalid producers, pushes, consumers or capacity\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  long total = producers * pushes;
+  size_t size = sizeof(shared_t) + sizeof(double) * (size_t)total;
+  shared_t *sh = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sh == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  sh->total = total;
+  if (sem_init(&sh->queue.empty, 1, REQUEST_FIFO_SIZE) == -1 ||
+      sem_init(&sh->queue.full, 1, 0) == -1 ||
+      sem_init(&sh->queue.write, 1, 1) == -1 ||
+      sem_init(&sh->queue.read, 1, 1) == -1) {
+    perror("sem_init");
+    return EXIT_FAILURE;
+  }
+  int fd = memfd_create("ring_bench", 0);
+  if (fd == -1 ||
+      (sh->ring = request_ring_create(fd, (uint32_t)capacity)) == nullptr) {
+    perror("request_ring_create");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  printf("%ld producers x %ld pushes, %ld consumers, ring of %ld slots\n",
+         producers, pushes, consumers, capacity);
+  int ret = EXIT_SUCCESS;
+  if (run(sh, "semaphores", (int)producers, pushes, (int)consumers, false) ==
+          -1 ||
+      run(sh, "ring", (int)producers, pushes, (int)consumers, true) == -1) {
+    ret = EXIT_FAILURE;
+  }
+
+  request_ring_detach(sh->ring);
+  munmap(sh, size);
+  return ret;
+}
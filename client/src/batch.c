@@ -0,0 +1,482 @@
+#define _GNU_SOURCE // getline
+
+#include "batch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <glob.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bmpfilter.h"
+#include "socket_client.h"
+#include "utils.h"
+
+typedef enum { BATCH_MANIFEST, BATCH_DIRECTORY, BATCH_GLOB } batch_kind_t;
+
+// Source des entrées du lot, lue au fur et à mesure
+typedef struct {
+  batch_kind_t kind;
+  const char *prog;
+  const char *path;
+  const char *outdir;
+  arguments_t common; // filtres et options (répertoire, glob)
+  FILE *manifest;
+  char *line;
+  size_t line_size;
+  size_t line_number;
+  DIR *dir;
+  glob_t glob;
+  size_t glob_index;
+} batch_source_t;
+
+typedef struct batch batch_t;
+
+// Requête en cours, d'indice index dans le tableau des requêtes du lot
+typedef struct {
+  batch_t *batch;
+  int index;
+  arguments_t args;
+  char input[PATH_MAX];
+  char output[PATH_MAX];
+  off_t size;
+} batch_slot_t;
+
+// État du lot, mis à jour par les fonctions de rappel des requêtes
+struct batch {
+  const char *prog;
+  batch_slot_t slots[BATCH_MAX_WINDOW];
+  int free_slots[BATCH_MAX_WINDOW];
+  int free_count;
+  size_t done;
+  size_t failed;
+  double bytes;
+};
+
+bool is_batch_option(const char *arg) {
+  return strcmp(arg, OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_BATCH) ==
+             0 ||
+         strcmp(arg, OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_BATCH) == 0;
+}
+
+// is_window_option: renvoit true si arg est l'option de la fenêtre du lot
+static bool is_window_option(const char *arg) {
+  return strcmp(arg, OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_WINDOW) ==
+             0 ||
+         strcmp(arg, OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_WINDOW) ==
+             0;
+}
+
+// join: écrit dans path, de taille PATH_MAX, le chemin name précédé du
+// répertoire dir s'il n'est pas nullptr. Renvoit 0 en cas de succes, -1 si le
+// chemin est trop long (errno vaut ENAMETOOLONG).
+static int join(char *path, const char *dir, const char *name) {
+  int n = dir == nullptr ? snprintf(path, PATH_MAX, "%s", name)
+                         : snprintf(path, PATH_MAX, "%s/%s", dir, name);
+  if (n >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+// set_paths: copie dans slot le chemin d'entrée input_dir/input et celui de
+// sortie output_dir/output (répertoires ignorés s'ils valent nullptr).
+// Renvoit 0 en cas de succes, -1 si un chemin est trop long.
+static int set_paths(batch_slot_t *slot, const char *input_dir,
+                     const char *input, const char *output_dir,
+                     const char *output) {
+  if (join(slot->input, input_dir, input) == -1 ||
+      join(slot->output, output_dir, output) == -1) {
+    return -1;
+  }
+  slot->args.input = slot->input;
+  slot->args.output = slot->output;
+  return 0;
+}
+
+// next_manifest: lit la prochaine entrée du manifeste de src dans slot.
+// Renvoit 1 si une entrée a été lue, 0 à la fin du manifeste, -1 si
+// l'entrée est invalide (un message est affiché).
+static int next_manifest(batch_source_t *src, batch_slot_t *slot) {
+  for (;;) {
+    errno = 0;
+    if (getline(&src->line, &src->line_size, src->manifest) == -1) {
+      if (errno != 0) {
+        MESSAGE_ERR(src->prog, src->path);
+        return -1;
+      }
+      return 0;
+    }
+    src->line_number++;
+    char *tokens[BATCH_MAX_TOKENS];
+    int count = 1;
+    tokens[0] = (char *)src->prog;
+    char *save = nullptr;
+    for (char *token = strtok_r(src->line, " \t\r\n", &save);
+         token != nullptr; token = strtok_r(nullptr, " \t\r\n", &save)) {
+      if (count == BATCH_MAX_TOKENS) {
+        count = -1;
+        break;
+      }
+      tokens[count++] = token;
+    }
+    if (count == 1 || tokens[1][0] == '#') {
+      continue;
+    }
+    if (count == -1 || process_options_to_request(count, tokens,
+                                                  &slot->args) != 0) {
+      fprintf(stderr, "%s: %s:%zu: Invalid entry\n", src->prog, src->path,
+              src->line_number);
+      return -1;
+    }
+    if (slot->args.response != RESPONSE_FIFO &&
+        slot->args.response != RESPONSE_SOCKET) {
+      fprintf(stderr, "%s: %s:%zu: Only the socket is used in batch mode\n",
+              src->prog, src->path, src->line_number);
+      return -1;
+    }
+    if (set_paths(slot, nullptr, slot->args.input, nullptr,
+                  slot->args.output) == -1) {
+      MESSAGE_ERR(src->prog, slot->args.input);
+      return -1;
+    }
+    return 1;
+  }
+}
+
+// is_regular: renvoit true si path désigne un fichier régulier
+static bool is_regular(const char *path) {
+  struct stat s;
+  return stat(path, &s) == 0 && S_ISREG(s.st_mode);
+}
+
+// next_directory: prend la prochaine image .bmp du répertoire de src dans
+// slot. Renvoit 1 si une image a été trouvée, 0 à la fin du répertoire, -1
+// si l'entrée est invalide (un message est affiché).
+static int next_directory(batch_source_t *src, batch_slot_t *slot) {
+  struct dirent *entry;
+  while ((entry = readdir(src->dir)) != nullptr) {
+    size_t len = strlen(entry->d_name);
+    if (len < 4 || strcasecmp(entry->d_name + len - 4, ".bmp") != 0) {
+      continue;
+    }
+    slot->args = src->common;
+    if (set_paths(slot, src->path, entry->d_name, src->outdir,
+                  entry->d_name) == -1) {
+      MESSAGE_ERR(src->prog, entry->d_name);
+      return -1;
+    }
+    if (is_regular(slot->input)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// next_glob: prend le prochain fichier correspondant au motif de src dans
+// slot. Renvoit 1 si un fichier a été trouvé, 0 s'il n'y en a plus, -1 si
+// l'entrée est invalide (un message est affiché).
+static int next_glob(batch_source_t *src, batch_slot_t *slot) {
+  while (src->glob_index < src->glob.gl_pathc) {
+    const char *path = src->glob.gl_pathv[src->glob_index++];
+    if (!is_regular(path)) {
+      continue;
+    }
+    char copy[PATH_MAX];
+    snprintf(copy, sizeof(copy), "%s", path);
+    slot->args = src->common;
+    if (set_paths(slot, nullptr, path, src->outdir, basename(copy)) == -1) {
+      MESSAGE_ERR(src->prog, path);
+      return -1;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+// next_entry: prend la prochaine entrée de src dans slot. Renvoit 1 si une
+// entrée a été prise, 0 s'il n'y en a plus, -1 si elle est invalide.
+static int next_entry(batch_source_t *src, batch_slot_t *slot) {
+  switch (src->kind) {
+  case BATCH_MANIFEST:
+    return next_manifest(src, slot);
+  case BATCH_DIRECTORY:
+    return next_directory(src, slot);
+  case BATCH_GLOB:
+    return next_glob(src, slot);
+  }
+  return 0;
+}
+
+// open_source: ouvre la source path du lot dans src, avec le répertoire de
+// sortie et les filtres des argc arguments de rest (argv[0] étant le nom du
+// programme) pour un répertoire ou un motif glob. Renvoit 0 en cas de succes,
+// -1 sinon (un message est affiché).
+static int open_source(batch_source_t *src, const char *path, int argc,
+                       char *rest[]) {
+  src->path = path;
+  struct stat s;
+  if (strpbrk(path, "*?[") != nullptr) {
+    src->kind = BATCH_GLOB;
+  } else if (stat(path, &s) == -1) {
+    MESSAGE_ERR(src->prog, path);
+    return -1;
+  } else {
+    src->kind = S_ISDIR(s.st_mode) ? BATCH_DIRECTORY : BATCH_MANIFEST;
+  }
+
+  if (src->kind == BATCH_MANIFEST) {
+    if (argc > 1) {
+      fprintf(stderr,
+              "%s: Error: A manifest gives the outputs and filters of its "
+              "entries\n",
+              src->prog);
+      return -1;
+    }
+    src->manifest = fopen(path, "r");
+    if (src->manifest == nullptr) {
+      MESSAGE_ERR(src->prog, path);
+      return -1;
+    }
+    return 0;
+  }
+
+  // <outdir> <filters>... parsed as <input> <output> <filters>...
+  char *argv[BATCH_MAX_TOKENS];
+  if (argc + 1 > BATCH_MAX_TOKENS) {
+    fprintf(stderr, "%s: Error: Too many arguments\n", src->prog);
+    return -1;
+  }
+  argv[0] = rest[0];
+  argv[1] = (char *)path;
+  for (int i = 1; i < argc; ++i) {
+    argv[i + 1] = rest[i];
+  }
+  if (process_options_to_request(argc + 1, argv, &src->common) != 0) {
+    return -1;
+  }
+  if (src->common.response != RESPONSE_FIFO &&
+      src->common.response != RESPONSE_SOCKET) {
+    fprintf(stderr, "%s: Error: Only the socket is used in batch mode\n",
+            src->prog);
+    return -1;
+  }
+  src->outdir = src->common.output;
+  int found = stat(src->outdir, &s);
+  if (found == 0 && !S_ISDIR(s.st_mode)) {
+    errno = ENOTDIR;
+    found = -1;
+  }
+  if (found == -1) {
+    MESSAGE_ERR(src->prog, src->outdir);
+    return -1;
+  }
+
+  if (src->kind == BATCH_DIRECTORY) {
+    src->dir = opendir(path);
+    if (src->dir == nullptr) {
+      MESSAGE_ERR(src->prog, path);
+      return -1;
+    }
+    return 0;
+  }
+  int err = glob(path, 0, nullptr, &src->glob);
+  if (err != 0 && err != GLOB_NOMATCH) {
+    fprintf(stderr, "%s: %s: Invalid pattern\n", src->prog, path);
+    return -1;
+  }
+  return 0;
+}
+
+// close_source: libère les ressources de la source pointé par src
+static void close_source(batch_source_t *src) {
+  if (src->manifest != nullptr) {
+    fclose(src->manifest);
+  }
+  free(src->line);
+  if (src->dir != nullptr) {
+    closedir(src->dir);
+  }
+  if (src->kind == BATCH_GLOB) {
+    globfree(&src->glob);
+  }
+}
+
+// on_filtered: fonction de rappel de la requête du lot pointé par user_data
+static void on_filtered(int status, void *user_data) {
+  batch_slot_t *slot = user_data;
+  batch_t *batch = slot->batch;
+  if (status != EXIT_SUCCESS) {
+    errno = status;
+    MESSAGE_ERR(batch->prog, slot->args.input);
+    batch->failed++;
+  } else {
+    batch->done++;
+    batch->bytes += (double)slot->size;
+  }
+  batch->free_slots[batch->free_count++] = slot->index;
+}
+
+// submit_entry: envoie sur session la requête de slot. Renvoit 0 en cas de
+// succes, -1 sinon (errno est positionné, un message est affiché sauf si le
+// socket est plein : EAGAIN).
+static int submit_entry(bmpfilter_session_t *session, batch_slot_t *slot) {
+  struct stat s;
+  if (stat(slot->args.input, &s) == -1) {
+    MESSAGE_ERR(slot->batch->prog, slot->args.input);
+    return -1;
+  }
+  slot->size = s.st_size;
+  bmpfilter_options_t options;
+  socket_client_options(&slot->args, &options);
+  if (bmpfilter_submit_file(session, slot->args.input, slot->args.output,
+                            &options, on_filtered, slot) == -1) {
+    if (errno != EAGAIN) {
+      int err = errno;
+      MESSAGE_ERR(slot->batch->prog, slot->args.input);
+      errno = err;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+// is_session_error: renvoit true si l'erreur err met fin à la connexion
+static bool is_session_error(int err) {
+  return err == EPIPE || err == ECONNRESET || err == ENOTCONN;
+}
+
+int run_batch(int argc, char *argv[]) {
+  const char *prog = argv[0];
+  int ret = EXIT_SUCCESS;
+  bmpfilter_session_t *session = nullptr;
+  batch_source_t src = {.prog = prog, .kind = BATCH_MANIFEST};
+  static batch_t batch;
+  batch = (batch_t){.prog = prog};
+  long window = BATCH_DEFAULT_WINDOW;
+
+  // PARSE ARGS
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i],
+               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_HELP) == 0 ||
+        strcmp(argv[i], OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_HELP) ==
+            0) {
+      print_help(prog);
+      return EXIT_FAILURE;
+    }
+  }
+  if (argc < 3) {
+    print_help(prog);
+    return EXIT_FAILURE;
+  }
+  // The window option is removed, the rest starts with the program name
+  char *rest[BATCH_MAX_TOKENS];
+  int rest_count = 1;
+  rest[0] = argv[0];
+  for (int i = 3; i < argc; ++i) {
+    if (is_window_option(argv[i])) {
+      char *end = nullptr;
+      window = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+      if (end == nullptr || *end != '\0' || window < 1 ||
+          window > BATCH_MAX_WINDOW) {
+        fprintf(stderr, "Error: The window must be between 1 and %d\n",
+                BATCH_MAX_WINDOW);
+        return EXIT_FAILURE;
+      }
+    } else if (rest_count == BATCH_MAX_TOKENS) {
+      fprintf(stderr, "Error: Too many arguments\n");
+      return EXIT_FAILURE;
+    } else {
+      rest[rest_count++] = argv[i];
+    }
+  }
+  if (open_source(&src, argv[2], rest_count, rest) == -1) {
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+
+  // CONNECT
+  session = socket_client_open(prog, (uint32_t)window);
+  if (session == nullptr) {
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+  for (int i = (int)window - 1; i >= 0; --i) {
+    batch.slots[i].batch = &batch;
+    batch.slots[i].index = i;
+    batch.free_slots[batch.free_count++] = i;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bool more = true;
+  batch_slot_t *held = nullptr; // entry not sent yet, the socket being full
+  while (more || held != nullptr || bmpfilter_in_flight(session) > 0) {
+    // SEND UNTIL THE WINDOW IS FULL
+    while (held != nullptr || (more && batch.free_count > 0)) {
+      batch_slot_t *slot = held;
+      int status = 1;
+      held = nullptr;
+      if (slot == nullptr) {
+        slot = &batch.slots[batch.free_slots[--batch.free_count]];
+        status = next_entry(&src, slot);
+      }
+      if (status == 1 && submit_entry(session, slot) == 0) {
+        continue;
+      }
+      if (status == 1 && errno == EAGAIN) {
+        held = slot;
+        break;
+      }
+      batch.free_slots[batch.free_count++] = slot->index;
+      if (status == 0) {
+        more = false;
+      } else {
+        batch.failed++;
+        if (status == 1 && is_session_error(errno)) {
+          more = false;
+        }
+      }
+    }
+    if (held == nullptr && bmpfilter_in_flight(session) == 0) {
+      break;
+    }
+
+    // WAIT RESPONSES
+    int done = bmpfilter_wait(session, BATCH_RESPONSE_TIMEOUT * 1000);
+    if (done <= 0) {
+      if (done == 0) {
+        errno = ETIMEDOUT;
+      }
+      MESSAGE_ERR(prog, "bmpfilter_wait");
+      batch.failed += bmpfilter_in_flight(session) + (held != nullptr);
+      break;
+    }
+  }
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // REPORT
+  double elapsed = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%zu images filtered, %zu failed in %.3f s (%.1f images/s, %.1f "
+         "MB/s)\n",
+         batch.done, batch.failed, elapsed,
+         elapsed > 0 ? (double)batch.done / elapsed : 0,
+         elapsed > 0 ? batch.bytes / elapsed / 1e6 : 0);
+  if (batch.failed > 0) {
+    ret = EXIT_FAILURE;
+  }
+
+dispose:
+  bmpfilter_close(session);
+  close_source(&src);
+  return ret;
+}
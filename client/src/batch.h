@@ -0,0 +1,35 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+#define BATCH_DEFAULT_WINDOW 32
+#define BATCH_MAX_WINDOW 128 // requêtes en cours acceptées par le serveur
+// Délai en secondes pour recevoir la réponse suivante
+#define BATCH_RESPONSE_TIMEOUT 30
+#define BATCH_MAX_TOKENS 32 // mots d'une ligne de manifeste
+
+// MODE BATCH
+// client -ba <source> [<outdir> <filtres>...] [-wi <n>]
+// Toutes les requêtes sont envoyées sur une seule connexion au socket du
+// serveur, au plus n à la fois (BATCH_DEFAULT_WINDOW par défaut) : une
+// nouvelle requête part dès qu'une réponse arrive. source est :
+// - un répertoire : chacune de ses images .bmp est filtrée vers
+//   outdir/<nom> avec les filtres et options donnés ;
+// - un motif glob (contenant *, ? ou [) : de même pour chaque fichier
+//   correspondant ;
+// - un manifeste : chaque ligne donne "<input> <output> <filtres>..." avec la
+//   syntaxe de la ligne de commande, les lignes vides ou commençant par #
+//   étant ignorées.
+// Les erreurs d'une entrée sont affichées sans interrompre le lot. Le nombre
+// d'images filtrées, d'échecs et le débit sont affichés à la fin.
+
+// is_batch_option: renvoit true si arg est l'option du mode batch
+bool is_batch_option(const char *arg);
+
+// run_batch: exécute le lot décrit par la ligne de commande argv de taille
+// argc, argv[1] étant l'option du mode batch. Renvoit EXIT_SUCCESS si toutes
+// les images ont été filtrées, EXIT_FAILURE sinon.
+int run_batch(int argc, char *argv[]);
+
+#endif
@@ -1,8 +1,7 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <libgen.h>
 #include <linux/limits.h>
-#include <semaphore.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +9,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "batch.h"
 #include "full_io.h"
+#include "request_ring.h"
+#include "socket_client.h"
 #include "utils.h"
 
 //---- [FILTERS] -------------------------------------------------------------//
@@ -22,19 +24,88 @@
 //---- [TIME OUT] ------------------------------------------------------------//
 //----------------------------------------------------------------------------//
 
-void handle_sigalrm(int sig) {
-  (void)sig;
-  MESSAGE_ERR("error :", "Read operation timed out");
-  exit(EXIT_FAILURE);
+// Délai en secondes pour obtenir le statut de la requête, puis pour recevoir
+// l'image entière
+#define READ_TIMEOUT 5
+
+//---- [OUTPUT PATH] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// absolute_path: écrit dans resolved, de taille PATH_MAX, le chemin absolu du
+// fichier path, qui peut ne pas encore exister : seul son répertoire est
+// résolu. Renvoit 0 en cas de succes, -1 sinon (errno est positionné).
+static int absolute_path(const char *path, char *resolved) {
+  char dir_copy[PATH_MAX];
+  char base_copy[PATH_MAX];
+  char dir[PATH_MAX];
+  if (strlen(path) >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(dir_copy, path);
+  strcpy(base_copy, path);
+  if (realpath(dirname(dir_copy), dir) == nullptr) {
+    return -1;
+  }
+  if (snprintf(resolved, PATH_MAX, "%s/%s", strcmp(dir, "/") == 0 ? "" : dir,
+               basename(base_copy)) >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
 }
 
-static void set_read_timeout(unsigned int seconds) {
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = handle_sigalrm;
-  sa.sa_flags = 0;
-  sigaction(SIGALRM, &sa, NULL);
-  alarm(seconds);
+//---- [SOCKET] --------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// on_socket_response: écrit le statut de la requête dans l'entier pointé par
+// user_data
+static void on_socket_response(int status, void *user_data) {
+  *(int *)user_data = status;
+}
+
+// send_socket_request: envoie la requête décrite par args sur le socket du
+// serveur, avec les descripteurs de l'image d'entrée et du fichier de sortie,
+// et attend sa réponse. Renvoit EXIT_SUCCESS ou EXIT_FAILURE.
+static int send_socket_request(const char *prog, const arguments_t *args) {
+  int ret = EXIT_SUCCESS;
+  int status = -1;
+  bmpfilter_session_t *session = socket_client_open(prog, 1);
+  if (session == nullptr) {
+    return EXIT_FAILURE;
+  }
+
+  // SEND REQUEST
+  bmpfilter_options_t options;
+  socket_client_options(args, &options);
+  if (bmpfilter_submit_file(session, args->input, args->output, &options,
+                            on_socket_response, &status) == -1) {
+    MESSAGE_ERR(prog, args->input);
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+
+  // WAIT RESPONSE
+  // No time limit: the reply comes once the image is filtered, however long
+  // it queues or takes, and a server that dies closes the connection
+  while (bmpfilter_in_flight(session) > 0) {
+    if (bmpfilter_wait(session, -1) == -1 && status == -1) {
+      MESSAGE_ERR(prog, "bmpfilter_wait");
+      ret = EXIT_FAILURE;
+      goto dispose;
+    }
+  }
+  if (status != EXIT_SUCCESS) {
+    errno = status;
+    MESSAGE_ERR(prog, "server");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+  printf("Image created with success\n");
+
+dispose:
+  bmpfilter_close(session);
+  return ret;
 }
 
 //---- [CODE] ----------------------------------------------------------------//
@@ -43,14 +114,19 @@ static void set_read_timeout(unsigned int seconds) {
 int main(int argc, char *argv[]) {
   int ret = EXIT_SUCCESS;
   filter_request_t rq;
-  sem_t *mutex_empty = SEM_FAILED;
-  sem_t *mutex_full = SEM_FAILED;
-  sem_t *mutex_write = SEM_FAILED;
   int fd = -1;
-  request_t *rqs = MAP_FAILED;
+  request_t *rqs = nullptr;
   int fifo = -1;
   char fifo_path[256];
   fifo_path[0] = '\0';
+  int shm = -1;
+  char shm_path[256];
+  shm_path[0] = '\0';
+
+  // BATCH MODE
+  if (argc > 1 && is_batch_option(argv[1])) {
+    return run_batch(argc, argv);
+  }
 
   // PARSE ARGS
   arguments_t args;
@@ -58,14 +134,36 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
+  // SOCKET TRANSPORT
+  if (args.response == RESPONSE_SOCKET) {
+    return send_socket_request(argv[0], &args);
+  }
+
   // CREATE REQUEST
   rq.pid = getpid();
   strncpy(rq.path, args.input, PATH_MAX - 1);
   rq.path[PATH_MAX - 1] = '\0';
-  rq.filter = args.filter;
+  memcpy(rq.filters, args.filters, sizeof(rq.filters));
+  rq.filter_count = args.filter_count;
+  rq.border = args.border;
+  rq.response = args.response;
+  rq.priority = args.priority;
+  rq.output[0] = '\0';
+  if (args.response == RESPONSE_FILE &&
+      absolute_path(args.output, rq.output) == -1) {
+    MESSAGE_ERR(argv[0], args.output);
+    return EXIT_FAILURE;
+  }
 
-  // MUTEX
-  if ((mutex_empty = sem_open(REQUEST_EMPTY_PATH, 0)) == SEM_FAILED) {
+  struct stat s;
+  if (stat(args.input, &s) != 0) {
+    MESSAGE_ERR(argv[0], "stat");
+    return EXIT_FAILURE;
+  }
+
+  // SHM
+  fd = shm_open(REQUEST_FIFO_PATH, O_RDWR, 0);
+  if (fd == -1) {
     if (errno == ENOENT) {
       fprintf(stderr,
               "%s: Error: Server is not running. Please "
@@ -74,32 +172,15 @@ int main(int argc, char *argv[]) {
       ret = EXIT_FAILURE;
       goto dispose;
     } else {
-      MESSAGE_ERR(argv[0], "sem_open");
+      MESSAGE_ERR(argv[0], "shm_open");
       ret = EXIT_FAILURE;
       goto dispose;
     }
   }
-  if ((mutex_full = sem_open(REQUEST_FULL_PATH, 0)) == SEM_FAILED) {
-    MESSAGE_ERR(argv[0], "sem_open");
-    ret = EXIT_FAILURE;
-    goto dispose;
-  }
-  if ((mutex_write = sem_open(REQUEST_WRITE_PATH, 0)) == SEM_FAILED) {
-    MESSAGE_ERR(argv[0], "sem_open");
-    ret = EXIT_FAILURE;
-    goto dispose;
-  }
-  // SHM
-  fd = shm_open(REQUEST_FIFO_PATH, O_RDWR, 0);
-  if (fd == -1) {
-    MESSAGE_ERR(argv[0], "shm_open");
-    ret = EXIT_FAILURE;
-    goto dispose;
-  }
-  rqs = mmap(nullptr, sizeof(request_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-             0);
-  if (rqs == MAP_FAILED) {
-    MESSAGE_ERR(argv[0], "mmap");
+  // The capacity is chosen by the server and read from the ring header
+  rqs = request_ring_attach(fd);
+  if (rqs == nullptr) {
+    MESSAGE_ERR(argv[0], "request_ring_attach");
     ret = EXIT_FAILURE;
     goto dispose;
   }
@@ -110,13 +191,31 @@ int main(int argc, char *argv[]) {
     ret = EXIT_FAILURE;
     goto dispose;
   }
+  // RESPONSE SHM
+  // Created with the size of the image, the worker reads the image in it and
+  // filters it in place
+  if (args.response == RESPONSE_SHM) {
+    snprintf(shm_path, sizeof(shm_path), "%s%d", RESPONSE_SHM_BASE_PATH,
+             getpid());
+    shm = shm_open(shm_path, O_CREAT | O_EXCL | O_RDWR, PERMS);
+    if (shm == -1) {
+      MESSAGE_ERR(argv[0], "shm_open");
+      shm_path[0] = '\0';
+      ret = EXIT_FAILURE;
+      goto dispose;
+    }
+    if (ftruncate(shm, s.st_size) == -1) {
+      MESSAGE_ERR(argv[0], "ftruncate");
+      ret = EXIT_FAILURE;
+      goto dispose;
+    }
+  }
   // WRITE REQUEST
-  P(mutex_empty);
-  P(mutex_write);
-  rqs->buffer[rqs->write] = rq;
-  rqs->write = (rqs->write + 1) % REQUEST_FIFO_SIZE;
-  V(mutex_write);
-  V(mutex_full);
+  if (request_ring_push(rqs, &rq) == -1) {
+    MESSAGE_ERR(argv[0], "request_ring_push");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
   // WAIT RESPONSE
   fifo = open(fifo_path, O_RDONLY);
   if (fifo == -1) {
@@ -124,10 +223,19 @@ int main(int argc, char *argv[]) {
     ret = EXIT_FAILURE;
     goto dispose;
   }
+  // Timeouts are handled by polling, re-armed on each progress
+  if (fcntl(fifo, F_SETFL, O_NONBLOCK) == -1) {
+    MESSAGE_ERR(argv[0], "fcntl");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
   // READ TO DETECT EXIT_FAILURE OF THE SERVER
   int err;
-  set_read_timeout(5);
-  full_read(fifo, &err, sizeof(err));
+  if (full_read_until(fifo, &err, sizeof(err), READ_TIMEOUT) != sizeof(err)) {
+    MESSAGE_ERR(argv[0], "full_read_until");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
   if (err != EXIT_SUCCESS) {
     errno = err;
     MESSAGE_ERR(argv[0], "server");
@@ -136,7 +244,12 @@ int main(int argc, char *argv[]) {
   } else {
     printf("filter applyed with succes, getting the image back...\n");
   }
-  alarm(0);
+
+  // WRITTEN BY THE SERVER
+  if (args.response == RESPONSE_FILE) {
+    printf("Image created with success\n");
+    goto dispose;
+  }
 
   // READ IMAGE BACK
   int fd_out = open(args.output, O_WRONLY | O_CREAT | O_TRUNC, PERMS);
@@ -146,36 +259,39 @@ int main(int argc, char *argv[]) {
     goto dispose;
   }
 
-  struct stat s;
-  if (stat(args.input, &s) != 0) {
-    MESSAGE_ERR(argv[0], "stat");
-    close(fd_out);
-    ret = EXIT_FAILURE;
-    goto dispose;
-  }
-
-  size_t count = (size_t)s.st_size;
-  char buffer[PIPE_BUF];
-  while (count > 0) {
-    set_read_timeout(5);
-    size_t n_r = count;
-    if (n_r > PIPE_BUF) {
-      n_r = PIPE_BUF;
-    }
-    if (full_read(fifo, buffer, n_r) == -1) {
-      MESSAGE_ERR(argv[0], "full_read");
+  // FROM SHM
+  if (args.response == RESPONSE_SHM) {
+    void *image = mmap(nullptr, (size_t)s.st_size, PROT_READ, MAP_SHARED, shm,
+                       0);
+    if (image == MAP_FAILED) {
+      MESSAGE_ERR(argv[0], "mmap");
       close(fd_out);
       ret = EXIT_FAILURE;
       goto dispose;
     }
-    if (full_write(fd_out, buffer, n_r) == -1) {
+    if (full_write(fd_out, image, (size_t)s.st_size) != s.st_size) {
       MESSAGE_ERR(argv[0], "full_write");
+      munmap(image, (size_t)s.st_size);
       close(fd_out);
       ret = EXIT_FAILURE;
       goto dispose;
     }
-    count -= n_r;
-    alarm(0);
+    if (munmap(image, (size_t)s.st_size) == -1) {
+      MESSAGE_ERR(argv[0], "munmap");
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  // FROM FIFO
+  // Moved from the pipe to the output file without going through user space
+  size_t count = args.response == RESPONSE_FIFO ? (size_t)s.st_size : 0;
+  // The server may take longer than READ_TIMEOUT for the whole image, never
+  // without sending anything
+  if (full_splice(fifo, fd_out, count, READ_TIMEOUT) != (ssize_t)count) {
+    MESSAGE_ERR(argv[0], "full_splice");
+    close(fd_out);
+    ret = EXIT_FAILURE;
+    goto dispose;
   }
   if (close(fd_out) == -1) {
     MESSAGE_ERR(argv[0], "close output file");
@@ -186,9 +302,8 @@ int main(int argc, char *argv[]) {
   printf("Image created with success\n");
 
 dispose:
-  alarm(0);
-  if (rqs != MAP_FAILED) {
-    if (munmap(rqs, sizeof(request_t)) == -1) {
+  if (rqs != nullptr) {
+    if (request_ring_detach(rqs) == -1) {
       MESSAGE_ERR(argv[0], "munmap");
       ret = EXIT_FAILURE;
     }
@@ -197,24 +312,20 @@ dispose:
     MESSAGE_ERR(argv[0], "close");
     ret = EXIT_FAILURE;
   }
-  if (mutex_empty != SEM_FAILED && sem_close(mutex_empty) == -1) {
-    MESSAGE_ERR(argv[0], "sem_close");
-    ret = EXIT_FAILURE;
-  }
-  if (mutex_full != SEM_FAILED && sem_close(mutex_full) == -1) {
-    MESSAGE_ERR(argv[0], "sem_close");
+  if (fifo != -1 && close(fifo) == -1) {
+    MESSAGE_ERR(argv[0], "close");
     ret = EXIT_FAILURE;
   }
-  if (mutex_write != SEM_FAILED && sem_close(mutex_write) == -1) {
-    MESSAGE_ERR(argv[0], "sem_close");
+  if (fifo_path[0] != '\0' && unlink(fifo_path) == -1) {
+    MESSAGE_ERR(argv[0], "unlink");
     ret = EXIT_FAILURE;
   }
-  if (fifo != -1 && close(fifo) == -1) {
+  if (shm != -1 && close(shm) == -1) {
     MESSAGE_ERR(argv[0], "close");
     ret = EXIT_FAILURE;
   }
-  if (fifo_path[0] != '\0' && unlink(fifo_path) == -1) {
-    MESSAGE_ERR(argv[0], "unlink");
+  if (shm_path[0] != '\0' && shm_unlink(shm_path) == -1) {
+    MESSAGE_ERR(argv[0], "shm_unlink");
     ret = EXIT_FAILURE;
   }
   return ret;
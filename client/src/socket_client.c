@@ -0,0 +1,31 @@
+#include "socket_client.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+
+bmpfilter_session_t *socket_client_open(const char *prog,
+                                        uint32_t max_in_flight) {
+  bmpfilter_session_t *session = bmpfilter_open(max_in_flight);
+  if (session == nullptr) {
+    if (errno == ENOENT || errno == ECONNREFUSED) {
+      fprintf(stderr,
+              "%s: Error: Server is not running. Please "
+              "start the server first.\n",
+              prog);
+    } else {
+      MESSAGE_ERR(prog, "bmpfilter_open");
+    }
+  }
+  return session;
+}
+
+void socket_client_options(const arguments_t *args,
+                           bmpfilter_options_t *options) {
+  memcpy(options->filters, args->filters, sizeof(options->filters));
+  options->filter_count = args->filter_count;
+  options->border = args->border;
+  options->priority = args->priority;
+}
@@ -0,0 +1,20 @@
+#ifndef SOCKET_CLIENT_H
+#define SOCKET_CLIENT_H
+
+#include <stdint.h>
+
+#include "bmpfilter.h"
+#include "opt_to_request.h"
+
+// socket_client_open: ouvre une session libbmpfilter avec au plus
+// max_in_flight requêtes en cours. Renvoit la session, nullptr en cas d'échec
+// (un message est affiché au nom du programme prog).
+bmpfilter_session_t *socket_client_open(const char *prog,
+                                        uint32_t max_in_flight);
+
+// socket_client_options: écrit dans options les filtres, la politique de bord
+// et la priorité de args
+void socket_client_options(const arguments_t *args,
+                           bmpfilter_options_t *options);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef BMP_H
 #define BMP_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/mman.h>
@@ -35,20 +36,75 @@ typedef struct {
   void *pixels;
 } bmp_mapped_image_t;
 
+// bmp_headers_valid: renvoit true si les en-têtes pointés par file_h et dib_h,
+// au début d'un fichier de size octets, décrivent une image dont toutes les
+// lignes tiennent dans ce fichier. Ils ne sont lus que si size les contient.
+// Les filtres font confiance à pixel_array_offset, width et height : toute
+// image reçue est vérifiée avant le premier filtre.
+bool bmp_headers_valid(const bmp_file_header_t *file_h,
+                       const bmp_dib_header_t *dib_h, size_t size);
+
+// POLITIQUE DE BORD
+// Valeur utilisée par les filtres de convolution pour les pixels voisins situés
+// hors de l'image : pixel du bord le plus proche (clamp), pixel symétrique par
+// rapport au bord sans répéter celui-ci (mirror), pixel du bord opposé (wrap)
+// ou noir (zero).
+typedef enum {
+  BORDER_CLAMP,
+  BORDER_MIRROR,
+  BORDER_WRAP,
+  BORDER_ZERO,
+  BORDER_POLICY_COUNT
+} border_policy_t;
+
+// HALOS
+// Les filtres de convolution modifient l'image en place, bande par bande. Une
+// bande lit les lignes voisines des bandes adjacentes, qui peuvent déjà avoir
+// été filtrées par un autre thread : avant qu'une frontière de bande (multiple
+// de band_rows, ou height) sépare les bandes de deux threads, les halo lignes
+// situées de part et d'autre sont copiées dans boundaries[k]. Seules ces
+// frontières sont copiées, les bandes consécutives d'un même thread se
+// transmettant leurs dernières lignes par carry.
+#define FILTER_FAILED ((void *)-1)
+
+#define BMP_MAX_HALO 2 // demi-taille de la plus grande matrice (5x5)
+
+typedef struct {
+  const uint8_t *pixels;
+  uint8_t **boundaries; // nullptr pour une frontière non copiée
+  int32_t halo;
+  int32_t band_rows;
+  int32_t band_count;
+  int32_t height;
+  int32_t row_size;
+} bmp_halo_t;
+
 typedef struct {
   bmp_mapped_image_t *img;
   int32_t start_line; // (inclusif)
   int32_t end_line;   // (exclusif)
-  bmp_mapped_image_t *ref_img;
+  bmp_halo_t *halo;
+  border_policy_t border;
+  void *carry; // état conservé par le filtre d'une bande à la suivante d'un
+               // même thread, libéré par free() après la dernière bande
 } thread_filter_args_t;
 
+// Fonction de filtre (voir ci-dessous), arg pointant vers un
+// thread_filter_args_t
+typedef void *(*filter_func_t)(void *);
+
 // Toutes les fonction suivantes prennent un parametre de type void *arg pour la
 // compataibilité avec des appels par des threads mais qui attend en réalité un
 // pointeur vers une structure de type thread_filter_args_t afin d'appliqué le
 // filtre spécifié dans leur nom sur l'image en mémoire pointé par img entre les
 // lignes start_Line inclusif et end_line exclusif. Cette fonction modifie
-// l'image pointé par img. Elle utilise l'image pointé par ref_img comme
-// référence pour les valeurs des pixels voisins.
+// l'image pointé par img. Les lignes voisines extérieures à [start_line,
+// end_line) sont lues dans carry si la bande précédente du thread se terminait
+// à start_line, sinon dans les halos pointés par halo, qui doivent avoir été
+// copiés (voir bmp_halo_capture) pour les frontières partagées avec un autre
+// thread. halo peut valoir nullptr si aucune autre bande de l'image n'est
+// filtrée en même temps. Renvoit nullptr en cas de succes, FILTER_FAILED si un
+// tampon n'a pas pu être alloué.
 void *blurbox_filter(void *arg);
 void *gaussian_blur_filter(void *arg);
 void *gaussian_blur5x5_filter(void *arg);
@@ -83,4 +139,26 @@ void *yellow_filter(void *arg);
 void *sepia_filter(void *arg);
 void *invert_filter(void *arg);
 
+// bmp_halo_init: initialise la structure pointé par halo pour un découpage en
+// bandes de band_rows lignes (au moins 2 * halo_rows) de l'image pointé par
+// img, de hauteur height, et copie les frontières 0 et height (lues par la
+// politique de bord wrap). Renvoit 0 en cas de succes, -1 si l'allocation a
+// échoué.
+int bmp_halo_init(bmp_halo_t *halo, const bmp_mapped_image_t *img,
+                  int32_t height, int32_t band_rows, int32_t halo_rows);
+
+// bmp_halo_capture: copie les lignes de part et d'autre de la frontière
+// située au début de la bande band (band_count pour la fin de l'image), si
+// elle ne l'est pas déjà. Les bandes adjacentes ne doivent pas être en cours
+// de filtrage. Renvoit 0 en cas de succes, -1 si l'allocation a échoué.
+int bmp_halo_capture(bmp_halo_t *halo, int32_t band);
+
+// bmp_halo_row: renvoit la copie de la ligne row conservée dans les halos
+// pointés par halo, ou nullptr si cette ligne n'est proche d'aucune frontière
+// copiée.
+const uint8_t *bmp_halo_row(const bmp_halo_t *halo, int32_t row);
+
+// bmp_halo_dispose: libère les copies de lignes des halos pointés par halo.
+void bmp_halo_dispose(bmp_halo_t *halo);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef BMPFILTER_H
+#define BMPFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opt_to_request.h"
+
+// LIBBMPFILTER
+// Bibliothèque cliente asynchrone du serveur : une session est une connexion
+// au socket REQUEST_SOCKET_PATH sur laquelle de nombreuses requêtes peuvent
+// être en cours à la fois. bmpfilter_submit_* envoie une requête sans
+// attendre ; sa fonction de rappel est appelée, avec le statut de la requête,
+// par bmpfilter_poll ou bmpfilter_wait lorsque sa réponse arrive, dans un
+// ordre quelconque. Une session n'est pas partagée entre threads.
+// Les images peuvent être des fichiers, ou des tampons bmpfilter_buffer_t
+// projetés depuis un memfd : le worker lit l'image d'entrée et écrit l'image
+// filtrée directement dans les pages du tampon de sortie, sans copie
+// intermédiaire ni fichier.
+
+#define BMPFILTER_DEFAULT_IN_FLIGHT 128
+#define BMPFILTER_MAX_IN_FLIGHT 1024
+#define BMPFILTER_MAX_RETRIES 3 // renvois d'une requête refusée (EBUSY)
+
+typedef struct bmpfilter_session bmpfilter_session_t;
+
+typedef struct {
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+  request_priority_t priority; // PRIORITY_NORMAL si nulle
+} bmpfilter_options_t;
+
+// Tampon en mémoire partagée avec le serveur, de size octets
+typedef struct {
+  void *data;
+  size_t size;
+  int fd; // memfd
+} bmpfilter_buffer_t;
+
+// Fonction de rappel d'une requête terminée : status vaut 0 en cas de succes,
+// une valeur d'errno sinon. user_data est celui donné à la soumission.
+typedef void (*bmpfilter_callback_t)(int status, void *user_data);
+
+// bmpfilter_open: ouvre une session avec au plus max_in_flight requêtes en
+// cours (entre 1 et BMPFILTER_MAX_IN_FLIGHT). Renvoit la session, nullptr en
+// cas d'échec (errno est positionné, ENOENT ou ECONNREFUSED si le serveur ne
+// fonctionne pas).
+bmpfilter_session_t *bmpfilter_open(uint32_t max_in_flight);
+
+// bmpfilter_close: ferme la session pointé par session. Les requêtes encore
+// en cours sont abandonnées sans appel de leur fonction de rappel.
+void bmpfilter_close(bmpfilter_session_t *session);
+
+// bmpfilter_fd: renvoit le descripteur de la session, lisible lorsqu'une
+// réponse est arrivée, à surveiller par poll ou epoll avant bmpfilter_poll
+int bmpfilter_fd(const bmpfilter_session_t *session);
+
+// bmpfilter_in_flight: renvoit le nombre de requêtes en cours de la session
+uint32_t bmpfilter_in_flight(const bmpfilter_session_t *session);
+
+// bmpfilter_buffer_init: crée dans buffer un tampon partagé de size octets,
+// initialisés à zéro. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné).
+int bmpfilter_buffer_init(bmpfilter_buffer_t *buffer, size_t size);
+
+// bmpfilter_buffer_dispose: libère le tampon pointé par buffer
+void bmpfilter_buffer_dispose(bmpfilter_buffer_t *buffer);
+
+// bmpfilter_submit_file: soumet le filtrage de l'image input vers le fichier
+// output (créé s'il n'existe pas, remplacé sinon) selon options. Renvoit 0 si
+// la requête a été envoyée, -1 sinon (errno est positionné, EAGAIN si la
+// session a déjà max_in_flight requêtes en cours : attendre une réponse par
+// bmpfilter_wait puis recommencer).
+int bmpfilter_submit_file(bmpfilter_session_t *session, const char *input,
+                          const char *output,
+                          const bmpfilter_options_t *options,
+                          bmpfilter_callback_t callback, void *user_data);
+
+// bmpfilter_submit_buffer: soumet le filtrage de l'image occupant tout le
+// tampon input vers le tampon output, d'au moins input->size octets, selon
+// options. Les deux tampons ne doivent pas être modifiés ni soumis à nouveau
+// avant l'appel de la fonction de rappel. Renvoit 0 si la requête a été
+// envoyée, -1 sinon (voir bmpfilter_submit_file, EINVAL si output est trop
+// petit).
+int bmpfilter_submit_buffer(bmpfilter_session_t *session,
+                            const bmpfilter_buffer_t *input,
+                            bmpfilter_buffer_t *output,
+                            const bmpfilter_options_t *options,
+                            bmpfilter_callback_t callback, void *user_data);
+
+// bmpfilter_poll: traite, sans attendre, les réponses arrivées en appelant
+// leur fonction de rappel, qui peut soumettre de nouvelles requêtes. Renvoit
+// le nombre de requêtes terminées, -1 si la connexion est perdue (les
+// requêtes en cours sont alors terminées avec le statut ECONNRESET).
+int bmpfilter_poll(bmpfilter_session_t *session);
+
+// bmpfilter_wait: attend au plus timeout_ms millisecondes (-1 sans limite)
+// qu'au moins une requête se termine, puis traite les réponses arrivées (voir
+// bmpfilter_poll). Renvoit le nombre de requêtes terminées, 0 si aucune ne
+// s'est terminée dans le délai ou s'il n'y en a pas en cours, -1 en cas
+// d'échec.
+int bmpfilter_wait(bmpfilter_session_t *session, int timeout_ms);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <stdint.h>
+
+#include "bmp.h"
+
+#define CONVOLUTION_MAX_SIZE (2 * BMP_MAX_HALO + 1)
+
+// MATRICE CONVOLUTION
+// Lorsque la matrice est séparable (produit d'un vecteur colonne par un vecteur
+// ligne), row et col la décrivent et permettent de l'appliquer en deux passes.
+// Sinon ils valent nullptr. Les poids sont entiers : les sommes sont calculées
+// en entiers 32 bits et normalisées sans division flottante.
+typedef struct {
+  int16_t *matrix;
+  int32_t size; // 3 5 (au plus CONVOLUTION_MAX_SIZE)
+  const int16_t *row;
+  const int16_t *col;
+} convolution_matrix_t;
+
+// generic_convolution_filter : applique une matrice de convolution générique
+// conv à l'image décrite par arg (pointeur vers un thread_filter_args_t), en
+// place, sur les lignes entre start_line et end_line. Les valeurs d'origine
+// des lignes voisines sont lues dans l'image, dans un tampon circulaire des
+// dernières lignes écrites ou dans les halos args->halo. L'intérieur de
+// l'image est traité par des noyaux vectoriels choisis au démarrage selon le
+// processeur (AVX2, SSE4.1 ou générique) sans aucun test de bord, les pixels
+// dont le voisinage sort de l'image par le chemin scalaire selon la politique
+// de bord border. Renvoit nullptr en cas de succes, FILTER_FAILED en cas
+// d'échec d'allocation.
+void *generic_convolution_filter(void *arg, convolution_matrix_t *conv);
+
+#endif
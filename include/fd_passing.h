@@ -0,0 +1,28 @@
+#ifndef FD_PASSING_H
+#define FD_PASSING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define FD_PASSING_MAX_FDS 4 // descripteurs au plus par message
+
+// send_fds: envoie sur le socket sock le message buf de len octets accompagné
+// (SCM_RIGHTS) des fd_count descripteurs du tableau fds, avec les options
+// flags de sendmsg. Renvoit le nombre d'octets envoyés, -1 en cas d'échec
+// (errno est positionné).
+ssize_t send_fds(int sock, const void *buf, size_t len, const int *fds,
+                 int fd_count, int flags);
+
+// recv_fds: reçoit depuis le socket sock un message d'au plus len octets dans
+// buf, avec les options flags de recvmsg. Les descripteurs qui l'accompagnent
+// (au plus FD_PASSING_MAX_FDS, fermés à l'exec) sont écrits dans fds et leur
+// nombre dans fd_count. Renvoit la taille du message, 0 si le pair a fermé la
+// connexion, -1 en cas d'échec (errno est positionné, EMSGSIZE si le message
+// ou ses descripteurs ont été tronqués : ceux reçus sont alors fermés).
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int *fd_count,
+                 int flags);
+
+// close_fds: ferme les fd_count descripteurs du tableau fds
+void close_fds(const int *fds, int fd_count);
+
+#endif
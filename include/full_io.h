@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <sys/types.h>
+#include <time.h>
 
 // full_read: Tente de lire count octets depuis le descripteur de fichier pointé
 // par fd et les place dans l'espace mémoire pointé par buf en supposant qu'il
@@ -14,4 +15,46 @@ ssize_t full_read(int fd, void *buf, size_t count);
 // en supposant qu'il est au moins de taille count
 ssize_t full_write(int fd, const void *buf, size_t count);
 
+// full_pwrite: Tente d'écrire count octets à la position offset du fichier
+// référencé par le descripteur de fichier fd depuis l'espace mémoire pointé
+// par buf, sans modifier la position courante du descripteur
+ssize_t full_pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+// full_pread: Tente de lire count octets à la position offset du fichier
+// référencé par le descripteur de fichier fd dans l'espace mémoire pointé par
+// buf, sans modifier la position courante du descripteur. Renvoit moins de
+// count octets si la fin du fichier est atteinte ou en cas d'erreur.
+ssize_t full_pread(int fd, void *buf, size_t count, off_t offset);
+
+// TRANSFERTS À ÉCHÉANCE
+// Les fonctions suivantes opèrent sur des descripteurs non bloquants (FIFO de
+// réponse) : lorsqu'une opération bloquerait, elles attendent par poll que le
+// descripteur soit prêt, au plus timeout secondes, au lieu d'armer une alarme
+// par bloc. L'échéance est réarmée à chaque progrès : un transfert échoue
+// lorsque l'autre extrémité n'avance plus, quelle que soit sa durée totale.
+// Elles renvoient le nombre d'octets transférés, inférieur à count en cas
+// d'échec : errno vaut alors ETIMEDOUT si l'échéance est dépassée, EIO si
+// l'autre extrémité du tube a été fermée avant la fin du transfert.
+
+// full_read_until: lit count octets depuis fd dans buf
+ssize_t full_read_until(int fd, void *buf, size_t count,
+                        unsigned int timeout);
+
+// full_write_until: écrit dans fd les count octets de buf
+ssize_t full_write_until(int fd, const void *buf, size_t count,
+                         unsigned int timeout);
+
+// full_vmsplice: place dans le tube fd les count octets de buf par vmsplice,
+// sans les copier : les pages de buf sont référencées par le tube jusqu'à leur
+// lecture et ne doivent plus être modifiées, elles peuvent en revanche être
+// libérées par munmap
+ssize_t full_vmsplice(int fd, const void *buf, size_t count,
+                      unsigned int timeout);
+
+// full_splice: transfère count octets du tube fd_in vers le fichier fd_out par
+// splice, sans passer par l'espace utilisateur, ou par read et write si fd_out
+// ne le permet pas
+ssize_t full_splice(int fd_in, int fd_out, size_t count,
+                    unsigned int timeout);
+
 #endif
@@ -30,6 +30,7 @@
 // filtre individuel.
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -38,13 +39,11 @@
 #include "filters.h"
 #include <linux/limits.h>
 
-#define REQUEST_FIFO_SIZE 10
+#define REQUEST_MAX_FILTERS 8 // nombre maximum de filtres d'un pipeline
 #define MAX_PATH_LENGTH 4096
 
 #define REQUEST_FIFO_PATH "/filter_request_fifo"
-#define REQUEST_EMPTY_PATH "/mutex_empty"
-#define REQUEST_FULL_PATH "/mutex_full"
-#define REQUEST_WRITE_PATH "/mutex_write"
+#define REQUEST_SOCKET_PATH "/tmp/bmp_server.sock"
 
 #ifndef OPT_TO_REQUEST_SHORT_PREFIX
 #define OPT_TO_REQUEST_SHORT_PREFIX "-"
@@ -62,6 +61,62 @@
 #define OPT_TO_REQUEST_LONG_HELP "help"
 #endif
 
+#ifndef OPT_TO_REQUEST_SHORT_BORDER
+#define OPT_TO_REQUEST_SHORT_BORDER "bd"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_BORDER
+#define OPT_TO_REQUEST_LONG_BORDER "border"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_PRIORITY
+#define OPT_TO_REQUEST_SHORT_PRIORITY "pr"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_PRIORITY
+#define OPT_TO_REQUEST_LONG_PRIORITY "priority"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_SHM
+#define OPT_TO_REQUEST_SHORT_SHM "shm"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_SHM
+#define OPT_TO_REQUEST_LONG_SHM "shared-memory"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_SERVER_WRITE
+#define OPT_TO_REQUEST_SHORT_SERVER_WRITE "sw"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_SERVER_WRITE
+#define OPT_TO_REQUEST_LONG_SERVER_WRITE "server-write"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_SOCKET
+#define OPT_TO_REQUEST_SHORT_SOCKET "so"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_SOCKET
+#define OPT_TO_REQUEST_LONG_SOCKET "socket"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_BATCH
+#define OPT_TO_REQUEST_SHORT_BATCH "ba"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_BATCH
+#define OPT_TO_REQUEST_LONG_BATCH "batch"
+#endif
+
+#ifndef OPT_TO_REQUEST_SHORT_WINDOW
+#define OPT_TO_REQUEST_SHORT_WINDOW "wi"
+#endif
+
+#ifndef OPT_TO_REQUEST_LONG_WINDOW
+#define OPT_TO_REQUEST_LONG_WINDOW "window"
+#endif
+
 #define OPT_TO_REQUEST_SIMPLE_FILTER(filter, ...) filter,
 #define OPT_TO_REQUEST_COMPLEX_FILTER(filter, ...) filter,
 
@@ -76,23 +131,79 @@ typedef enum {
 #undef OPT_TO_REQUEST_COMPLEX_FILTER
 } filter_t;
 
+// MODE DE RÉPONSE
+// L'image filtrée est renvoyée par la FIFO de réponse (par défaut), écrite
+// par le worker dans le segment de mémoire partagée créé par le client
+// (RESPONSE_SHM_BASE_PATH suivi de son pid), de la taille de l'image, ou
+// écrite par le worker dans le fichier output de la requête (chemin absolu)
+// avec les droits du propriétaire de la FIFO de réponse. Dans ces deux derniers
+// cas, seul le code de retour transite par la FIFO. RESPONSE_SOCKET n'utilise
+// ni la file partagée ni de FIFO : la requête est envoyée sur le socket
+// REQUEST_SOCKET_PATH (voir socket_request_t).
+typedef enum {
+  RESPONSE_FIFO,
+  RESPONSE_SHM,
+  RESPONSE_FILE,
+  RESPONSE_SOCKET
+} response_mode_t;
+
+// PRIORITÉ
+// Classe de priorité d'une requête : le serveur traite les requêtes en attente
+// d'une classe avant celles des classes inférieures (politiques priority et
+// fair, voir scheduling_policy dans la configuration). La valeur nulle est la
+// priorité normale.
+typedef enum {
+  PRIORITY_LOW = -1,
+  PRIORITY_NORMAL = 0,
+  PRIORITY_HIGH = 1
+} request_priority_t;
+
+#define PRIORITY_COUNT 3
+
 // STRUCTURE
+// Les filtres filters[0] à filters[filter_count - 1] sont appliqués dans cet
+// ordre à l'image.
 typedef struct {
   char *input;
   char *output;
-  filter_t filter;
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+  response_mode_t response;
+  request_priority_t priority;
 } arguments_t;
 
 typedef struct {
   pid_t pid;
   char path[PATH_MAX];
-  filter_t filter;
+  char output[PATH_MAX]; // RESPONSE_FILE uniquement
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+  response_mode_t response;
+  request_priority_t priority;
 } filter_request_t;
 
+// REQUÊTE PAR SOCKET
+// Message envoyé sur une connexion SOCK_SEQPACKET au socket
+// REQUEST_SOCKET_PATH, accompagné (SCM_RIGHTS) de deux descripteurs : l'image
+// d'entrée, ouverte en lecture, puis le fichier de sortie, ouvert en écriture,
+// que le worker tronque à la taille de l'image. Une connexion peut envoyer
+// plusieurs requêtes sans attendre : elles sont traitées en parallèle par les
+// workers et chaque réponse, qui porte l'identifiant id choisi par le client,
+// est envoyée dès la fin de sa requête, dans un ordre quelconque.
+typedef struct {
+  uint64_t id;
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+  request_priority_t priority;
+} socket_request_t;
+
 typedef struct {
-  int write;
-  filter_request_t buffer[REQUEST_FIFO_SIZE];
-} request_t;
+  uint64_t id;
+  int32_t status; // EXIT_SUCCESS, sinon valeur d'errno
+} socket_response_t;
 
 // process_options_to_request: traite les arguments de la liste de chaine de
 // carractère pointé par argv de taille argc et remplit la strucuture pointé par
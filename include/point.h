@@ -0,0 +1,39 @@
+#ifndef POINT_H
+#define POINT_H
+
+#include <stdint.h>
+
+#include "bmp.h"
+
+#define POINT_MATRIX_SCALE 1000 // coefficients des matrices en millièmes
+
+// TABLE DE CORRESPONDANCE
+// Valeur de sortie de chaque canal, dans l'ordre des octets d'un pixel (bleu,
+// vert, rouge), pour chacune de ses 256 valeurs d'entrée.
+typedef struct {
+  uint8_t table[3][256];
+} point_lut_t;
+
+// MATRICE COULEUR
+// La ligne c contient les coefficients, en millièmes, des canaux d'entrée
+// bleu, vert et rouge donnant le canal de sortie c. La somme pondérée est
+// calculée en entiers, tronquée puis ramenée dans [0, 255].
+typedef struct {
+  int16_t matrix[3][3];
+} point_matrix_t;
+
+// generic_lut_filter : applique la table de correspondance lut à chaque pixel
+// de l'image décrite par arg (pointeur vers un thread_filter_args_t), en
+// place, sur les lignes entre start_line et end_line. Les tables de la forme
+// (v & masque) ^ inversion (identité, suppression d'un canal, négatif) sont
+// appliquées par lignes entières par des opérations bit à bit vectorielles,
+// les autres octet par octet. Renvoit nullptr.
+void *generic_lut_filter(void *arg, const point_lut_t *lut);
+
+// generic_matrix_filter : applique la matrice couleur matrix à chaque pixel de
+// l'image décrite par arg, en place, sur les lignes entre start_line et
+// end_line. Les lignes sont traitées par des noyaux vectoriels choisis au
+// démarrage selon le processeur (AVX2, SSE4.1 ou générique). Renvoit nullptr.
+void *generic_matrix_filter(void *arg, const point_matrix_t *matrix);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef REQUEST_RING_H
+#define REQUEST_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "opt_to_request.h"
+
+#define REQUEST_RING_LINE 64 // taille d'une ligne de cache
+
+// FILE PARTAGÉE
+// File circulaire sans verrou à producteurs (clients) et consommateurs
+// multiples, placée dans le segment REQUEST_FIFO_PATH, vidée par le
+// répartiteur du serveur (voir dispatcher.h). Sa capacité
+// en cases, une puissance de 2, est choisie par le serveur à la création du
+// segment (queue_size de la configuration) et lue par les clients dans
+// l'en-tête.
+// Une requête est encodée en un enregistrement de taille variable
+// (request_record_t suivi de ses chemins) réparti sur span cases consécutives
+// d'une ligne de cache chacune : deux cases suffisent pour des chemins
+// courts. Chaque case porte un numéro de séquence : la case de la position
+// pos est libre pour un producteur si seq == pos, l'enregistrement qui y
+// commence prêt pour un consommateur si seq == pos + 1. Un producteur réserve
+// les span positions d'un coup par compare-and-swap sur head une fois toutes
+// ces cases libres, les remplit puis publie l'enregistrement en écrivant le
+// seq de la première ; un consommateur le réserve par compare-and-swap sur
+// tail, le copie puis libère ses cases.
+// Les attentes (file vide ou pleine) se font par futex sur les compteurs
+// d'évènements ready et space, incrémentés à chaque publication et chaque
+// libération ; l'appel système de réveil n'est fait que s'il y a des
+// processus en attente.
+
+#define REQUEST_SLOT_SIZE REQUEST_RING_LINE
+#define REQUEST_SLOT_PAYLOAD                                                   \
+  (REQUEST_SLOT_SIZE - sizeof(uint64_t) - sizeof(uint32_t))
+
+// En-tête d'un enregistrement, suivi de path puis de output, sans '\0'
+typedef struct {
+  pid_t pid;
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+  response_mode_t response;
+  request_priority_t priority;
+  uint16_t path_length;
+  uint16_t output_length;
+} request_record_t;
+
+#define REQUEST_RECORD_MAX (sizeof(request_record_t) + 2 * (PATH_MAX - 1))
+// Cases occupées au plus par un enregistrement, capacité minimale de la file
+#define REQUEST_RING_MAX_SPAN                                                  \
+  ((REQUEST_RECORD_MAX + REQUEST_SLOT_PAYLOAD - 1) / REQUEST_SLOT_PAYLOAD)
+
+typedef struct {
+  _Alignas(REQUEST_RING_LINE) _Atomic uint64_t seq;
+  _Atomic uint32_t span; // cases de l'enregistrement (case de tête)
+  unsigned char payload[REQUEST_SLOT_PAYLOAD];
+} request_slot_t;
+
+typedef struct {
+  uint32_t capacity;
+  uint32_t mask;
+  _Alignas(REQUEST_RING_LINE) _Atomic uint64_t head; // prochaine écriture
+  _Alignas(REQUEST_RING_LINE) _Atomic uint64_t tail; // prochaine lecture
+  _Alignas(REQUEST_RING_LINE) _Atomic uint32_t ready; // futex
+  _Atomic uint32_t ready_waiters;
+  _Alignas(REQUEST_RING_LINE) _Atomic uint32_t space; // futex
+  _Atomic uint32_t space_waiters;
+  _Alignas(REQUEST_RING_LINE) request_slot_t slots[];
+} request_t;
+
+// request_ring_size: renvoit la taille en octets d'une file de capacity cases
+size_t request_ring_size(uint32_t capacity);
+
+// request_ring_create: dimensionne le segment de mémoire partagée fd pour
+// une file de capacity cases (puissance de 2, au moins REQUEST_RING_MAX_SPAN),
+// le projette et initialise la file. Renvoit la file, nullptr en cas d'échec
+// (errno est positionné).
+request_t *request_ring_create(int fd, uint32_t capacity);
+
+// request_ring_attach: projette la file créée par le serveur dans le segment
+// fd, après avoir vérifié que sa capacité correspond à la taille du segment.
+// Renvoit la file, nullptr en cas d'échec (errno est positionné, EPROTO si le
+// segment n'est pas une file valide).
+request_t *request_ring_attach(int fd);
+
+// request_ring_detach: supprime la projection de la file pointé par ring.
+// Renvoit 0 en cas de succes, -1 sinon.
+int request_ring_detach(request_t *ring);
+
+// request_ring_push: encode la requête pointé par rq dans la file pointé par
+// ring, en attendant que assez de cases se libèrent si elle est pleine, puis
+// réveille un consommateur. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné).
+int request_ring_push(request_t *ring, const filter_request_t *rq);
+
+// request_ring_try_pop: retire la plus ancienne requête de la file pointé par
+// ring et la décode dans rq, sans attendre. Renvoit 0 en cas de succes, -1 si
+// la file est vide (errno vaut EAGAIN) ou si l'enregistrement retiré est
+// invalide (errno vaut EBADMSG).
+int request_ring_try_pop(request_t *ring, filter_request_t *rq);
+
+// request_ring_ready: renvoit le compteur de publications de la file pointé
+// par ring, à relever avant de chercher du travail puis à passer à
+// request_ring_wait si aucun n'a été trouvé.
+uint32_t request_ring_ready(request_t *ring);
+
+// request_ring_wait: attend une publication (requête de la file ou
+// request_ring_notify) postérieure au relevé seen de request_ring_ready.
+// Renvoit immédiatement si elle a déjà eu lieu. Renvoit 0 au réveil, -1 si
+// l'attente a été interrompue par un signal (errno vaut EINTR).
+int request_ring_wait(request_t *ring, uint32_t seen);
+
+// request_ring_notify: signale une publication et réveille un consommateur
+// en attente sur la file pointé par ring (arrêt d'un consommateur).
+void request_ring_notify(request_t *ring);
+
+#endif
@@ -4,6 +4,8 @@
 #include <errno.h>
 #include <semaphore.h>
 
+// Taille d'une image filtrée par max_threads threads, et d'un tampon de
+// libbmpfilter au plus
 #define MAX_SIZE_FILE 100000000 // 100MB
 
 #define PERMS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
@@ -15,5 +17,6 @@
 #define P(sem) sem_wait(sem)
 
 #define FIFO_RESPONSE_BASE_PATH "/tmp/fifo_rep_" // ajouter le pid à la fin
+#define RESPONSE_SHM_BASE_PATH "/bmp_rep_"       // ajouter le pid à la fin
 
 #endif
@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bmpfilter.h"
+
+// BULK FILTER
+// bulk_filter <input> <output> [count] [in_flight]
+// Exemple de libbmpfilter : un seul thread soumet count requêtes (10000 par
+// défaut) filtrant en sépia l'image input, chargée une fois dans un tampon
+// partagé par toutes les requêtes, avec au plus in_flight requêtes en cours
+// (BMPFILTER_DEFAULT_IN_FLIGHT par défaut), chacune écrivant dans l'un des
+// in_flight tampons de sortie. La dernière image filtrée est écrite dans
+// output, puis le débit est affiché.
+
+#define DEFAULT_COUNT 10000
+
+typedef struct {
+  bmpfilter_buffer_t *outputs;
+  int *free_outputs; // tampons de sortie disponibles
+  int free_count;
+  int last; // dernier tampon rempli avec succes, -1 s'il n'y en a pas
+  size_t done;
+  size_t failed;
+} bulk_t;
+
+// Contexte de la requête écrivant dans le tampon de sortie index
+typedef struct {
+  bulk_t *bulk;
+  int index;
+} output_ctx_t;
+
+// on_filtered: fonction de rappel d'une requête terminée
+static void on_filtered(int status, void *user_data) {
+  output_ctx_t *ctx = user_data;
+  bulk_t *bulk = ctx->bulk;
+  if (status == 0) {
+    bulk->done++;
+    bulk->last = ctx->index;
+  } else {
+    bulk->failed++;
+    fprintf(stderr, "request: %s\n", strerror(status));
+  }
+  bulk->free_outputs[bulk->free_count++] = ctx->index;
+}
+
+// load: charge l'image path dans le tampon partagé input. Renvoit 0 en cas de
+// succes, -1 sinon.
+static int load(const char *path, bmpfilter_buffer_t *input) {
+  int fd = open(path, O_RDONLY);
+  struct stat s;
+  if (fd == -1 || fstat(fd, &s) == -1 ||
+      bmpfilter_buffer_init(input, (size_t)s.st_size) == -1) {
+    perror(path);
+    if (fd != -1) {
+      close(fd);
+    }
+    return -1;
+  }
+  size_t total = 0;
+  while (total < input->size) {
+    ssize_t n = read(fd, (char *)input->data + total, input->size - total);
+    if (n <= 0) {
+      if (n == 0) {
+        errno = EIO;
+      }
+      perror(path);
+      close(fd);
+      return -1;
+    }
+    total += (size_t)n;
+  }
+  close(fd);
+  return 0;
+}
+
+// save: écrit les size premiers octets de data dans le fichier path. Renvoit
+// 0 en cas de succes, -1 sinon.
+static int save(const char *path, const void *data, size_t size) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  size_t total = 0;
+  while (fd != -1 && total < size) {
+    ssize_t n = write(fd, (const char *)data + total, size - total);
+    if (n == -1) {
+      break;
+    }
+    total += (size_t)n;
+  }
+  if (fd == -1 || total < size || close(fd) == -1) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int ret = EXIT_SUCCESS;
+  if (argc < 3 || argc > 5) {
+    fprintf(stderr, "Usage: %s <input> <output> [count] [in_flight]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  long count = argc > 3 ? strtol(argv[3], nullptr, 10) : DEFAULT_COUNT;
+  long in_flight = argc > 4 ? strtol(argv[4], nullptr, 10)
+                            : BMPFILTER_DEFAULT_IN_FLIGHT;
+  if (count < 1 || in_flight < 1 || in_flight > BMPFILTER_MAX_IN_FLIGHT) {
+    fprintf(stderr, "%s: Invalid count or in_flight\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  bmpfilter_buffer_t input = {.fd = -1};
+  bulk_t bulk = {.last = -1};
+  output_ctx_t *ctxs = calloc((size_t)in_flight, sizeof(*ctxs));
+  bulk.outputs = calloc((size_t)in_flight, sizeof(*bulk.outputs));
+  bulk.free_outputs = calloc((size_t)in_flight, sizeof(*bulk.free_outputs));
+  bmpfilter_session_t *session = nullptr;
+  if (ctxs == nullptr || bulk.outputs == nullptr ||
+      bulk.free_outputs == nullptr) {
+    perror("calloc");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+  for (long i = 0; i < in_flight; ++i) {
+    bulk.outputs[i].fd = -1;
+  }
+
+  // BUFFERS
+  if (load(argv[1], &input) == -1) {
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+  for (int i = 0; i < (int)in_flight; ++i) {
+    if (bmpfilter_buffer_init(&bulk.outputs[i], input.size) == -1) {
+      perror("bmpfilter_buffer_init");
+      ret = EXIT_FAILURE;
+      goto dispose;
+    }
+    ctxs[i] = (output_ctx_t){.bulk = &bulk, .index = i};
+    bulk.free_outputs[bulk.free_count++] = i;
+  }
+
+  // SESSION
+  session = bmpfilter_open((uint32_t)in_flight);
+  if (session == nullptr) {
+    perror("bmpfilter_open");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
+  bmpfilter_options_t options = {.filters = {sepia},
+                                 .filter_count = 1,
+                                 .border = BORDER_CLAMP};
+
+  // SUBMIT FROM ONE THREAD
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long submitted = 0;
+  while (submitted < count || bmpfilter_in_flight(session) > 0) {
+    while (submitted < count && bulk.free_count > 0) {
+      int index = bulk.free_outputs[bulk.free_count - 1];
+      if (bmpfilter_submit_buffer(session, &input, &bulk.outputs[index],
+                                  &options, on_filtered, &ctxs[index]) == -1) {
+        if (errno == EAGAIN) {
+          break;
+        }
+        perror("bmpfilter_submit_buffer");
+        bulk.failed += (size_t)(count - submitted);
+        submitted = count;
+        break;
+      }
+      bulk.free_count--;
+      submitted++;
+    }
+    if (bmpfilter_wait(session, -1) == -1) {
+      perror("bmpfilter_wait");
+      bulk.failed += (size_t)(count - submitted);
+      break;
+    }
+  }
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // REPORT
+  double elapsed = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%zu images filtered, %zu failed in %.3f s (%.1f images/s)\n",
+         bulk.done, bulk.failed, elapsed,
+         elapsed > 0 ? (double)bulk.done / elapsed : 0);
+  if (bulk.failed > 0 || bulk.last == -1 ||
+      save(argv[2], bulk.outputs[bulk.last].data, input.size) == -1) {
+    ret = EXIT_FAILURE;
+  }
+
+dispose:
+  bmpfilter_close(session);
+  if (bulk.outputs != nullptr) {
+    for (long i = 0; i < in_flight; ++i) {
+      bmpfilter_buffer_dispose(&bulk.outputs[i]);
+    }
+  }
+  bmpfilter_buffer_dispose(&input);
+  free(bulk.outputs);
+  free(bulk.free_outputs);
+  free(ctxs);
+  return ret;
+}
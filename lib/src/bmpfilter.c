@@ -0,0 +1,407 @@
+#define _GNU_SOURCE // memfd_create
+
+#include "bmpfilter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fd_passing.h"
+#include "utils.h"
+
+typedef enum { PENDING_FILE, PENDING_BUFFER } pending_kind_t;
+
+// Requête en cours, d'identifiant son indice dans le tableau de la session
+typedef struct {
+  bool active;
+  pending_kind_t kind;
+  socket_request_t rq;
+  char *input; // fichiers, rouverts à chaque envoi
+  char *output;
+  int fd_in; // tampons
+  bmpfilter_buffer_t *buffer;
+  bmpfilter_callback_t callback;
+  void *user_data;
+  int retries;
+} pending_t;
+
+struct bmpfilter_session {
+  int sock;
+  uint32_t capacity;
+  uint32_t in_flight;
+  pending_t *pending;
+  uint32_t *free_ids;
+  uint32_t free_count;
+  // Requêtes refusées (EBUSY) à renvoyer dès que le socket l'accepte
+  uint32_t *resend;
+  uint32_t resend_count;
+};
+
+//---- [SESSION] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+bmpfilter_session_t *bmpfilter_open(uint32_t max_in_flight) {
+  if (max_in_flight < 1 || max_in_flight > BMPFILTER_MAX_IN_FLIGHT) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  bmpfilter_session_t *s = calloc(1, sizeof(*s));
+  if (s == nullptr) {
+    return nullptr;
+  }
+  s->sock = -1;
+  s->capacity = max_in_flight;
+  s->pending = calloc(max_in_flight, sizeof(*s->pending));
+  s->free_ids = malloc(max_in_flight * sizeof(*s->free_ids));
+  s->resend = malloc(max_in_flight * sizeof(*s->resend));
+  if (s->pending == nullptr || s->free_ids == nullptr || s->resend == nullptr) {
+    goto error;
+  }
+  for (uint32_t i = max_in_flight; i > 0; --i) {
+    s->free_ids[s->free_count++] = i - 1;
+  }
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strcpy(addr.sun_path, REQUEST_SOCKET_PATH);
+  s->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (s->sock == -1 ||
+      connect(s->sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    goto error;
+  }
+  return s;
+
+error:;
+  int err = errno;
+  bmpfilter_close(s);
+  errno = err;
+  return nullptr;
+}
+
+void bmpfilter_close(bmpfilter_session_t *session) {
+  if (session == nullptr) {
+    return;
+  }
+  if (session->sock != -1) {
+    close(session->sock);
+  }
+  if (session->pending != nullptr) {
+    for (uint32_t i = 0; i < session->capacity; ++i) {
+      free(session->pending[i].input);
+      free(session->pending[i].output);
+    }
+  }
+  free(session->pending);
+  free(session->free_ids);
+  free(session->resend);
+  free(session);
+}
+
+int bmpfilter_fd(const bmpfilter_session_t *session) { return session->sock; }
+
+uint32_t bmpfilter_in_flight(const bmpfilter_session_t *session) {
+  return session->in_flight;
+}
+
+//---- [BUFFERS] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+int bmpfilter_buffer_init(bmpfilter_buffer_t *buffer, size_t size) {
+  buffer->data = nullptr;
+  buffer->size = size;
+  buffer->fd = -1;
+  if (size == 0 || size > MAX_SIZE_FILE) {
+    errno = EINVAL;
+    return -1;
+  }
+  buffer->fd = memfd_create("bmpfilter", MFD_CLOEXEC);
+  if (buffer->fd == -1) {
+    return -1;
+  }
+  if (ftruncate(buffer->fd, (off_t)size) == -1) {
+    goto error;
+  }
+  buffer->data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+  if (buffer->data == MAP_FAILED) {
+    buffer->data = nullptr;
+    goto error;
+  }
+  return 0;
+
+error:;
+  int err = errno;
+  close(buffer->fd);
+  buffer->fd = -1;
+  errno = err;
+  return -1;
+}
+
+void bmpfilter_buffer_dispose(bmpfilter_buffer_t *buffer) {
+  if (buffer->data != nullptr) {
+    munmap(buffer->data, buffer->size);
+    buffer->data = nullptr;
+  }
+  if (buffer->fd != -1) {
+    close(buffer->fd);
+    buffer->fd = -1;
+  }
+}
+
+//---- [REQUESTS] ------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// send_pending: envoie sans attendre la requête id de session avec les
+// descripteurs de ses images. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné, EAGAIN si le socket est plein).
+static int send_pending(bmpfilter_session_t *session, uint32_t id) {
+  pending_t *p = &session->pending[id];
+  int fds[2] = {-1, -1};
+  int ret = 0;
+  if (p->kind == PENDING_BUFFER) {
+    fds[0] = p->fd_in;
+    fds[1] = p->buffer->fd;
+  } else {
+    fds[0] = open(p->input, O_RDONLY | O_CLOEXEC);
+    // Truncated by the server to the size of the image: it may be the input
+    fds[1] = fds[0] == -1
+                 ? -1
+                 : open(p->output, O_WRONLY | O_CREAT | O_CLOEXEC, PERMS);
+    if (fds[1] == -1) {
+      ret = -1;
+      goto dispose;
+    }
+  }
+  if (send_fds(session->sock, &p->rq, sizeof(p->rq), fds, 2,
+               MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(p->rq)) {
+    ret = -1;
+  }
+
+dispose:
+  if (p->kind == PENDING_FILE) {
+    int err = errno;
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i] != -1) {
+        close(fds[i]);
+      }
+    }
+    errno = err;
+  }
+  return ret;
+}
+
+// release: libère la requête id de session, dont l'identifiant peut être
+// réutilisé
+static void release(bmpfilter_session_t *session, uint32_t id) {
+  pending_t *p = &session->pending[id];
+  free(p->input);
+  free(p->output);
+  p->input = nullptr;
+  p->output = nullptr;
+  p->active = false;
+  session->free_ids[session->free_count++] = id;
+  session->in_flight--;
+}
+
+// complete: termine la requête id de session avec le statut status et appelle
+// sa fonction de rappel, une fois son identifiant libéré
+static void complete(bmpfilter_session_t *session, uint32_t id, int status) {
+  pending_t *p = &session->pending[id];
+  if (p->kind == PENDING_BUFFER &&
+      ftruncate(p->buffer->fd, (off_t)p->buffer->size) == -1 && status == 0) {
+    // The server shrank the memfd to the image: the buffer must stay whole
+    status = errno;
+  }
+  bmpfilter_callback_t callback = p->callback;
+  void *user_data = p->user_data;
+  release(session, id);
+  if (callback != nullptr) {
+    callback(status, user_data);
+  }
+}
+
+// acquire: prend un identifiant libre de session pour une requête avec
+// options, callback et user_data, écrit dans id. Renvoit la requête, nullptr
+// sinon (errno est positionné, EAGAIN si tous les identifiants sont pris).
+static pending_t *acquire(bmpfilter_session_t *session,
+                          const bmpfilter_options_t *options,
+                          bmpfilter_callback_t callback, void *user_data,
+                          uint32_t *id) {
+  if (options->filter_count < 0 ||
+      options->filter_count > REQUEST_MAX_FILTERS ||
+      options->priority < PRIORITY_LOW || options->priority > PRIORITY_HIGH) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  if (session->free_count == 0) {
+    errno = EAGAIN;
+    return nullptr;
+  }
+  *id = session->free_ids[--session->free_count];
+  session->in_flight++;
+  pending_t *p = &session->pending[*id];
+  *p = (pending_t){.active = true,
+                   .rq = {.id = *id,
+                          .filter_count = options->filter_count,
+                          .border = options->border,
+                          .priority = options->priority},
+                   .fd_in = -1,
+                   .callback = callback,
+                   .user_data = user_data};
+  memcpy(p->rq.filters, options->filters, sizeof(p->rq.filters));
+  return p;
+}
+
+// dispatch: envoie la requête id de session, libérée en cas d'échec. Renvoit
+// 0 en cas de succes, -1 sinon (errno est positionné).
+static int dispatch(bmpfilter_session_t *session, uint32_t id) {
+  if (send_pending(session, id) == -1) {
+    int err = errno;
+    release(session, id);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+int bmpfilter_submit_file(bmpfilter_session_t *session, const char *input,
+                          const char *output,
+                          const bmpfilter_options_t *options,
+                          bmpfilter_callback_t callback, void *user_data) {
+  uint32_t id;
+  pending_t *p = acquire(session, options, callback, user_data, &id);
+  if (p == nullptr) {
+    return -1;
+  }
+  p->kind = PENDING_FILE;
+  p->input = strdup(input);
+  p->output = strdup(output);
+  if (p->input == nullptr || p->output == nullptr) {
+    release(session, id);
+    errno = ENOMEM;
+    return -1;
+  }
+  return dispatch(session, id);
+}
+
+int bmpfilter_submit_buffer(bmpfilter_session_t *session,
+                            const bmpfilter_buffer_t *input,
+                            bmpfilter_buffer_t *output,
+                            const bmpfilter_options_t *options,
+                            bmpfilter_callback_t callback, void *user_data) {
+  if (input->fd == -1 || output->fd == -1 || output->size < input->size) {
+    errno = EINVAL;
+    return -1;
+  }
+  uint32_t id;
+  pending_t *p = acquire(session, options, callback, user_data, &id);
+  if (p == nullptr) {
+    return -1;
+  }
+  p->kind = PENDING_BUFFER;
+  p->fd_in = input->fd;
+  p->buffer = output;
+  return dispatch(session, id);
+}
+
+//---- [COMPLETIONS] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// flush_resend: renvoie les requêtes refusées de session tant que le socket
+// les accepte. Renvoit le nombre de requêtes terminées par un échec d'envoi.
+static int flush_resend(bmpfilter_session_t *session) {
+  int done = 0;
+  uint32_t sent = 0;
+  while (sent < session->resend_count) {
+    uint32_t id = session->resend[sent];
+    if (send_pending(session, id) == -1) {
+      if (errno == EAGAIN) {
+        break;
+      }
+      complete(session, id, errno);
+      done++;
+    }
+    sent++;
+  }
+  session->resend_count -= sent;
+  memmove(session->resend, session->resend + sent,
+          session->resend_count * sizeof(*session->resend));
+  return done;
+}
+
+// fail_all: termine les requêtes en cours de session avec le statut status
+static void fail_all(bmpfilter_session_t *session, int status) {
+  session->resend_count = 0;
+  for (uint32_t id = 0; id < session->capacity; ++id) {
+    if (session->pending[id].active) {
+      complete(session, id, status);
+    }
+  }
+}
+
+int bmpfilter_poll(bmpfilter_session_t *session) {
+  int done = flush_resend(session);
+  for (;;) {
+    socket_response_t rep;
+    ssize_t n = recv(session->sock, &rep, sizeof(rep), MSG_DONTWAIT);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      break;
+    }
+    if (n != (ssize_t)sizeof(rep)) {
+      int err = n == -1 ? errno : n == 0 ? ECONNRESET : EPROTO;
+      fail_all(session, ECONNRESET);
+      errno = err;
+      return -1;
+    }
+    if (rep.id >= session->capacity || !session->pending[rep.id].active) {
+      continue;
+    }
+    uint32_t id = (uint32_t)rep.id;
+    pending_t *p = &session->pending[id];
+    if (rep.status == EBUSY && p->retries < BMPFILTER_MAX_RETRIES) {
+      p->retries++;
+      session->resend[session->resend_count++] = id;
+      continue;
+    }
+    complete(session, id, rep.status);
+    done++;
+  }
+  return done + flush_resend(session);
+}
+
+int bmpfilter_wait(bmpfilter_session_t *session, int timeout_ms) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (;;) {
+    int done = bmpfilter_poll(session);
+    if (done != 0 || session->in_flight == 0) {
+      return done;
+    }
+    int remaining = -1;
+    if (timeout_ms >= 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+                     (now.tv_nsec - start.tv_nsec) / 1000000;
+      remaining = elapsed >= timeout_ms ? 0 : timeout_ms - (int)elapsed;
+    }
+    struct pollfd pfd = {.fd = session->sock, .events = POLLIN};
+    if (session->resend_count > 0) {
+      pfd.events |= POLLOUT;
+    }
+    int n = poll(&pfd, 1, remaining);
+    if (n <= 0) {
+      return n;
+    }
+  }
+}
@@ -16,9 +16,39 @@ void config_init_default(server_config_t *config) {
   config->max_workers = DEFAULT_MAX_WORKERS;
   config->min_threads = DEFAULT_MIN_THREADS;
   config->max_threads = DEFAULT_MAX_THREADS;
+  config->queue_size = DEFAULT_QUEUE_SIZE;
+  config->scheduling_policy = DEFAULT_SCHEDULING_POLICY;
+  config->scheduling_client = DEFAULT_SCHEDULING_CLIENT;
+  config->small_image_size = DEFAULT_SMALL_IMAGE_SIZE;
+  config->cache_size = DEFAULT_CACHE_SIZE;
+  snprintf(config->cache_dir, sizeof(config->cache_dir), "%s",
+           DEFAULT_CACHE_DIR);
+  config->stream_size = DEFAULT_STREAM_SIZE;
+  config->memory_budget = DEFAULT_MEMORY_BUDGET;
   config->is_valid = true;
 }
 
+static const char *policy_names[SCHEDULING_POLICY_COUNT] = {
+    [SCHEDULING_FIFO] = "fifo",
+    [SCHEDULING_PRIORITY] = "priority",
+    [SCHEDULING_FAIR] = "fair",
+};
+
+static const char *client_names[SCHEDULING_CLIENT_COUNT] = {
+    [SCHEDULING_BY_UID] = "uid",
+    [SCHEDULING_BY_PID] = "pid",
+};
+
+// find_name: renvoit l'indice de name dans le tableau names de count noms,
+// count s'il n'y figure pas
+static int find_name(const char *name, const char *const *names, int count) {
+  int i = 0;
+  while (i < count && strcmp(name, names[i]) != 0) {
+    i++;
+  }
+  return i;
+}
+
 // trim: supprime les caratère espace au début et à la fin de la chaine de
 // caractère pointé par str
 static char *trim(char *str) {
@@ -57,6 +87,24 @@ static int parse_config_line(server_config_t *config, char *line) {
     config->min_threads = atoi(value);
   } else if (strcmp(key, "max_threads") == 0) {
     config->max_threads = atoi(value);
+  } else if (strcmp(key, "queue_size") == 0) {
+    config->queue_size = atoi(value);
+  } else if (strcmp(key, "scheduling_policy") == 0) {
+    config->scheduling_policy = (scheduling_policy_t)find_name(
+        value, policy_names, SCHEDULING_POLICY_COUNT);
+  } else if (strcmp(key, "scheduling_client") == 0) {
+    config->scheduling_client = (scheduling_client_t)find_name(
+        value, client_names, SCHEDULING_CLIENT_COUNT);
+  } else if (strcmp(key, "small_image_size") == 0) {
+    config->small_image_size = atoi(value);
+  } else if (strcmp(key, "cache_size") == 0) {
+    config->cache_size = atoi(value);
+  } else if (strcmp(key, "cache_dir") == 0) {
+    snprintf(config->cache_dir, sizeof(config->cache_dir), "%s", value);
+  } else if (strcmp(key, "stream_size") == 0) {
+    config->stream_size = atoi(value);
+  } else if (strcmp(key, "memory_budget") == 0) {
+    config->memory_budget = atoi(value);
   }
   return 0;
 }
@@ -128,6 +176,66 @@ bool config_validate(server_config_t *config) {
     return false;
   }
 
+  // Vérifier queue_size
+  if (config->queue_size < ABSOLUTE_MIN_QUEUE_SIZE ||
+      config->queue_size > ABSOLUTE_MAX_QUEUE_SIZE ||
+      (config->queue_size & (config->queue_size - 1)) != 0) {
+    fprintf(stderr,
+            "Config error: queue_size must be a power of 2 between %d and %d "
+            "(got %d)\n",
+            ABSOLUTE_MIN_QUEUE_SIZE, ABSOLUTE_MAX_QUEUE_SIZE,
+            config->queue_size);
+    return false;
+  }
+
+  // Vérifier l'ordonnancement
+  if (config->scheduling_policy == SCHEDULING_POLICY_COUNT) {
+    fprintf(stderr, "Config error: scheduling_policy must be fifo, priority "
+                    "or fair\n");
+    return false;
+  }
+  if (config->scheduling_client == SCHEDULING_CLIENT_COUNT) {
+    fprintf(stderr, "Config error: scheduling_client must be uid or pid\n");
+    return false;
+  }
+  if (config->small_image_size < 0 ||
+      config->small_image_size > MAX_SIZE_FILE) {
+    fprintf(stderr,
+            "Config error: small_image_size must be between 0 and %d (got "
+            "%d)\n",
+            MAX_SIZE_FILE, config->small_image_size);
+    return false;
+  }
+
+  // Vérifier le cache de résultats
+  if (config->cache_size < 0 || config->cache_size > ABSOLUTE_MAX_CACHE_SIZE) {
+    fprintf(stderr,
+            "Config error: cache_size must be between 0 and %d (got %d)\n",
+            ABSOLUTE_MAX_CACHE_SIZE, config->cache_size);
+    return false;
+  }
+  if (config->cache_dir[0] != '/') {
+    fprintf(stderr, "Config error: cache_dir must be an absolute path\n");
+    return false;
+  }
+
+  // Vérifier l'envoi pendant le filtrage
+  if (config->stream_size < 0 || config->stream_size > MAX_SIZE_FILE / 1024) {
+    fprintf(stderr,
+            "Config error: stream_size must be between 0 and %d (got %d)\n",
+            MAX_SIZE_FILE / 1024, config->stream_size);
+    return false;
+  }
+
+  // Vérifier le budget mémoire
+  if (config->memory_budget < 1 ||
+      config->memory_budget > ABSOLUTE_MAX_MEMORY_BUDGET) {
+    fprintf(stderr,
+            "Config error: memory_budget must be between 1 and %d (got %d)\n",
+            ABSOLUTE_MAX_MEMORY_BUDGET, config->memory_budget);
+    return false;
+  }
+
   return true;
 }
 
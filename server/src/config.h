@@ -1,6 +1,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <linux/limits.h>
 #include <semaphore.h>
 #include <stdbool.h>
 
@@ -10,15 +11,53 @@
 #define DEFAULT_MAX_WORKERS 10
 #define DEFAULT_MIN_THREADS 4
 #define DEFAULT_MAX_THREADS 8
+#define DEFAULT_QUEUE_SIZE 1024
+#define DEFAULT_SCHEDULING_POLICY SCHEDULING_FAIR
+#define DEFAULT_SCHEDULING_CLIENT SCHEDULING_BY_UID
+#define DEFAULT_SMALL_IMAGE_SIZE (1024 * 1024)
+#define DEFAULT_CACHE_SIZE 256 // Mio
+#define DEFAULT_CACHE_DIR "/dev/shm/bmp_cache"
+#define DEFAULT_STREAM_SIZE 1024 // Kio
+#define DEFAULT_MEMORY_BUDGET 128 // Mio
 
 #define ABSOLUTE_MIN_THREADS 1
 #define ABSOLUTE_MAX_THREADS 32
 #define ABSOLUTE_MAX_WORKERS 100
+#define ABSOLUTE_MIN_QUEUE_SIZE 256 // au moins REQUEST_RING_MAX_SPAN
+#define ABSOLUTE_MAX_QUEUE_SIZE 65536
+#define ABSOLUTE_MAX_CACHE_SIZE 65536 // Mio
+#define ABSOLUTE_MAX_MEMORY_BUDGET 4095 // Mio, taille d'une fenêtre sur 32 bits
+
+// Ordre de remise aux workers des requêtes en attente (voir dispatcher.h)
+typedef enum {
+  SCHEDULING_FIFO,     // ordre d'arrivée
+  SCHEDULING_PRIORITY, // classe de priorité, petites images, ordre d'arrivée
+  SCHEDULING_FAIR,     // classe de priorité, partage équitable entre clients
+  SCHEDULING_POLICY_COUNT
+} scheduling_policy_t;
+
+// Identité d'un client pour le partage équitable
+typedef enum {
+  SCHEDULING_BY_UID,
+  SCHEDULING_BY_PID,
+  SCHEDULING_CLIENT_COUNT
+} scheduling_client_t;
 
 typedef struct {
   int max_workers;
   int min_threads;
   int max_threads;
+  int queue_size; // cases de 64 octets de la file partagée (puissance de
+                  // 2), lue au démarrage uniquement
+  scheduling_policy_t scheduling_policy;
+  scheduling_client_t scheduling_client;
+  int small_image_size; // octets au plus d'une petite image
+  int cache_size;       // Mio du cache de résultats, 0 le désactive
+  char cache_dir[PATH_MAX]; // lu au démarrage uniquement
+  int stream_size; // Kio au moins d'une image envoyée pendant son filtrage,
+                   // 0 désactive l'envoi pendant le filtrage
+  int memory_budget; // Mio au plus d'une image en mémoire dans un worker,
+                     // les plus grandes sont traitées par fenêtres
   bool is_valid;
 } server_config_t;
 
@@ -0,0 +1,742 @@
+#define _GNU_SOURCE // F_DUPFD_CLOEXEC, pipe2
+
+#include "dispatcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fd_passing.h"
+#include "utils.h"
+
+// Identité d'un client de la file sans FIFO de réponse : sa requête échoue
+#define UNKNOWN_CLIENT UINT64_MAX
+
+// Statut des requêtes d'un worker terminé après leur réception
+#define WORKER_DIED EIO
+
+// Message de channel : requête du frontal par socket (accompagnée de la
+// connexion, de l'image et du fichier de sortie) ou de la file partagée
+typedef struct {
+  uint64_t ticket;
+  job_source_t source;
+  union {
+    socket_request_t socket;
+    filter_request_t ring;
+  };
+} dispatch_msg_t;
+
+#define SOCKET_MSG_SIZE                                                        \
+  (offsetof(dispatch_msg_t, socket) + sizeof(socket_request_t))
+
+// Message du tube done : requête de ticket ticket reçue par le worker worker,
+// ou terminée si worker vaut 0
+typedef struct {
+  uint64_t ticket;
+  int64_t worker;
+} dispatch_note_t;
+
+// post: ajoute 1 à l'eventfd fd
+static void post(int fd) {
+  uint64_t one = 1;
+  // Only fails once the counter is saturated: fd is readable anyway
+  if (write(fd, &one, sizeof(one)) == -1) {
+    return;
+  }
+}
+
+// release: libère les ressources de la requête en attente p
+static void release(pending_job_t *p) {
+  if (p->source == JOB_SOCKET) {
+    close_fds(p->fds, 3);
+  }
+  free(p->request);
+  p->request = nullptr;
+}
+
+// fail: répond sans attendre au client de la requête p, qu'aucun worker n'a
+// commencée, qu'elle a échoué avec le statut status
+static void fail(const pending_job_t *p, int32_t status) {
+  if (p->source == JOB_SOCKET) {
+    socket_response_t rep = {.id = p->rq.id, .status = status};
+    // A client that does not read its replies loses this one
+    send(p->fds[0], &rep, sizeof(rep), MSG_DONTWAIT | MSG_NOSIGNAL);
+    return;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "%s%d", FIFO_RESPONSE_BASE_PATH,
+           p->request->pid);
+  // Only a client waiting on its FIFO is answered, never blocking on it
+  int fifo = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fifo == -1) {
+    return;
+  }
+  if (write(fifo, &status, sizeof(status)) == -1) {
+    close(fifo);
+    return;
+  }
+  close(fifo);
+}
+
+//---- [RING PUMP] -----------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// pump_ring: thread du processus principal, ajoute 1 à ring_event après
+// chaque publication dans la file jusqu'à l'arrêt du répartiteur arg
+static void *pump_ring(void *arg) {
+  dispatcher_t *d = arg;
+  uint32_t seen = request_ring_ready(d->ring);
+  // Requests published before the thread started
+  post(d->ring_event);
+  while (!atomic_load(&d->stopping)) {
+    request_ring_wait(d->ring, seen);
+    seen = request_ring_ready(d->ring);
+    post(d->ring_event);
+  }
+  return nullptr;
+}
+
+// find_flow: renvoit l'indice du flux de la requête p dans d, -1 s'il n'existe
+// pas
+static int32_t find_flow(const dispatcher_t *d, const pending_job_t *p) {
+  for (int32_t i = 0; i < d->flow_count; ++i) {
+    const dispatch_flow_t *f = &d->flows[i];
+    if (f->client == p->client && f->priority == p->priority &&
+        f->small == p->small) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//---- [COALESCING] ----------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// set_key: écrit la clé de regroupement de la requête p, de fichier d'entrée
+// décrit par s et de pipeline filters, filter_count et border
+static void set_key(pending_job_t *p, const struct stat *s,
+                    const filter_t *filters, int32_t filter_count,
+                    border_policy_t border) {
+  // Compared with memcmp: no garbage in unused filters
+  memset(&p->key, 0, sizeof(p->key));
+  p->key.dev = (uint64_t)s->st_dev;
+  p->key.ino = (uint64_t)s->st_ino;
+  p->key.size = (int64_t)s->st_size;
+  p->key.mtime_sec = (int64_t)s->st_mtim.tv_sec;
+  p->key.mtime_nsec = (int64_t)s->st_mtim.tv_nsec;
+  if (filter_count > 0 && filter_count <= REQUEST_MAX_FILTERS) {
+    memcpy(p->key.filters, filters, sizeof(*filters) * (size_t)filter_count);
+  }
+  p->key.filter_count = filter_count;
+  p->key.border = border;
+  p->keyed = true;
+}
+
+// coalescible: renvoit true si la requête p peut suivre un meneur de d ou en
+// être un, son résultat tenant dans le cache
+static bool coalescible(const dispatcher_t *d, const pending_job_t *p) {
+  return p->keyed && !p->replay && d->coalesce_size > 0 &&
+         p->key.size <= d->coalesce_size;
+}
+
+// follow: fait suivre à la requête p le meneur de même clé remis par d, s'il
+// y en a un
+static void follow(dispatcher_t *d, pending_job_t *p) {
+  p->leader = 0;
+  if (!coalescible(d, p)) {
+    return;
+  }
+  for (int32_t i = 0; i < d->running_count; ++i) {
+    if (d->running[i].leads &&
+        memcmp(&d->running[i].job.key, &p->key, sizeof(p->key)) == 0) {
+      p->leader = d->running[i].ticket;
+      d->coalesced++;
+      return;
+    }
+  }
+}
+
+// lead: compte la requête en attente d'indice i comme remise au worker
+// d'emplacement slot avec le ticket ticket, ses ressources avec elle, et en
+// fait le meneur des requêtes identiques encore en attente dans d
+static void lead(dispatcher_t *d, int32_t i, int32_t slot, uint64_t ticket) {
+  const pending_job_t *p = &d->pending[i];
+  // Never full: at most one request per worker
+  dispatch_running_t *r = &d->running[d->running_count++];
+  *r = (dispatch_running_t){
+      .ticket = ticket, .slot = slot, .leads = coalescible(d, p), .job = *p};
+  if (!coalescible(d, p)) {
+    return;
+  }
+  for (int32_t k = 0; k < d->count; ++k) {
+    pending_job_t *q = &d->pending[k];
+    if (k != i && q->leader == 0 && coalescible(d, q) &&
+        memcmp(&q->key, &p->key, sizeof(p->key)) == 0) {
+      q->leader = ticket;
+      d->coalesced++;
+    }
+  }
+}
+
+// taken: note que la requête remise par d avec le ticket ticket a été reçue
+// par le worker worker
+static void taken(dispatcher_t *d, uint64_t ticket, pid_t worker) {
+  for (int32_t i = 0; i < d->running_count; ++i) {
+    if (d->running[i].ticket == ticket &&
+        d->slots[d->running[i].slot].pid == worker) {
+      d->running[i].taken = true;
+      return;
+    }
+  }
+}
+
+// finish: compte la fin de la requête remise par d avec le ticket ticket,
+// libère ses ressources et ses suiveurs, servis par le cache à partir de son
+// résultat
+static void finish(dispatcher_t *d, uint64_t ticket) {
+  for (int32_t i = 0; i < d->running_count; ++i) {
+    if (d->running[i].ticket == ticket) {
+      release(&d->running[i].job);
+      d->running[i] = d->running[--d->running_count];
+      break;
+    }
+  }
+  // Served together from the cache, none waits for another
+  for (int32_t i = 0; i < d->count; ++i) {
+    if (d->pending[i].leader == ticket) {
+      d->pending[i].leader = 0;
+      d->pending[i].replay = true;
+    }
+  }
+}
+
+//---- [SCHEDULING] ----------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// enqueue: met en attente dans d la requête p, de taille d'image size, en
+// lui donnant son ordre d'arrivée et ses étiquettes virtuelles
+static void enqueue(dispatcher_t *d, pending_job_t *p, off_t size) {
+  p->small = size <= d->small_image_size;
+  p->seq = d->seq++;
+  int32_t i = find_flow(d, p);
+  if (i == -1) {
+    i = d->flow_count++;
+    d->flows[i] = (dispatch_flow_t){.client = p->client,
+                                    .priority = p->priority,
+                                    .small = p->small,
+                                    .finish = d->vtime};
+  }
+  dispatch_flow_t *f = &d->flows[i];
+  p->start = f->finish > d->vtime ? f->finish : d->vtime;
+  p->finish = p->start + (uint64_t)size + DISPATCH_REQUEST_COST;
+  f->finish = p->finish;
+  f->count++;
+  follow(d, p);
+  d->pending[d->count++] = *p;
+  d->count_by_source[p->source]++;
+}
+
+// remove_pending: retire de d la requête en attente d'indice i, remise à un
+// worker ou abandonnée
+static void remove_pending(dispatcher_t *d, int32_t i) {
+  pending_job_t *p = &d->pending[i];
+  int32_t f = find_flow(d, p);
+  if (f != -1 && --d->flows[f].count == 0) {
+    d->flows[f] = d->flows[--d->flow_count];
+  }
+  if (p->start > d->vtime) {
+    d->vtime = p->start;
+  }
+  d->count_by_source[p->source]--;
+  *p = d->pending[--d->count];
+}
+
+// precedes: renvoit true si la requête a passe avant b selon la politique de d
+static bool precedes(const dispatcher_t *d, const pending_job_t *a,
+                     const pending_job_t *b) {
+  if (d->policy != SCHEDULING_FIFO && a->priority != b->priority) {
+    return a->priority > b->priority;
+  }
+  if (d->policy == SCHEDULING_PRIORITY && a->small != b->small) {
+    return a->small;
+  }
+  if (d->policy == SCHEDULING_FAIR && a->finish != b->finish) {
+    return a->finish < b->finish;
+  }
+  return a->seq < b->seq;
+}
+
+// pick: renvoit l'indice de la requête à remettre en premier parmi celles en
+// attente dans d qui ne suivent pas de meneur, -1 s'il n'y en a pas
+static int32_t pick(const dispatcher_t *d) {
+  int32_t best = -1;
+  for (int32_t i = 0; i < d->count; ++i) {
+    if (d->pending[i].leader == 0 &&
+        (best == -1 || precedes(d, &d->pending[i], &d->pending[best]))) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+// client_of: renvoit l'identité selon la configuration de d du client
+// d'utilisateur uid et de pid pid, si ce pid est vérifié. Les pid sont
+// distingués des uid par le bit 32.
+static uint64_t client_of(const dispatcher_t *d, pid_t pid, bool pid_checked,
+                          uid_t uid) {
+  if (d->client == SCHEDULING_BY_PID && pid_checked) {
+    return (uint64_t)1 << 32 | (uint32_t)pid;
+  }
+  return (uint64_t)uid;
+}
+
+// ring_client: renvoit l'identité du client de la requête rq de la file,
+// que tout processus peut écrire : son utilisateur est le propriétaire de sa
+// FIFO de réponse (un client ne peut pas en créer au nom d'un autre), son pid
+// n'est retenu que s'il désigne un processus de cet utilisateur. Un client
+// qui change de pid à chaque requête n'a ainsi que la part de son
+// utilisateur, ou de ses processus réels.
+static uint64_t ring_client(const dispatcher_t *d,
+                            const filter_request_t *rq) {
+  char path[64];
+  struct stat fifo;
+  struct stat proc;
+  snprintf(path, sizeof(path), "%s%d", FIFO_RESPONSE_BASE_PATH, rq->pid);
+  if (rq->pid <= 0 || lstat(path, &fifo) == -1 || !S_ISFIFO(fifo.st_mode)) {
+    return UNKNOWN_CLIENT;
+  }
+  snprintf(path, sizeof(path), "/proc/%d", rq->pid);
+  bool pid_checked = stat(path, &proc) == 0 && proc.st_uid == fifo.st_uid;
+  return client_of(d, rq->pid, pid_checked, fifo.st_uid);
+}
+
+//---- [MAIN PROCESS] --------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+int dispatcher_init(dispatcher_t *d, request_t *ring,
+                    const server_config_t *config) {
+  d->ring = ring;
+  d->count = 0;
+  d->flow_count = 0;
+  d->count_by_source[JOB_SOCKET] = 0;
+  d->count_by_source[JOB_RING] = 0;
+  d->running_count = 0;
+  d->ticket = 0;
+  d->coalesced = 0;
+  d->seq = 0;
+  d->vtime = 0;
+  d->pump_started = false;
+  d->self = -1;
+  for (int32_t i = 0; i < ABSOLUTE_MAX_WORKERS; ++i) {
+    d->slots[i] = (dispatch_slot_t){.pid = 0, .channel = {-1, -1}};
+  }
+  atomic_store(&d->stopping, false);
+  dispatcher_configure(d, config);
+  // Notes are written whole: 16 bytes is less than PIPE_BUF
+  if (pipe2(d->done, O_CLOEXEC) == -1 ||
+      fcntl(d->done[0], F_SETFL, O_NONBLOCK) == -1) {
+    return -1;
+  }
+  d->ring_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  d->epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (d->ring_event == -1 || d->epoll == -1) {
+    return -1;
+  }
+  int fds[2] = {d->done[0], d->ring_event};
+  for (int i = 0; i < 2; ++i) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[i]};
+    if (epoll_ctl(d->epoll, EPOLL_CTL_ADD, fds[i], &ev) == -1) {
+      return -1;
+    }
+  }
+  errno = pthread_create(&d->pump, nullptr, pump_ring, d);
+  if (errno != 0) {
+    return -1;
+  }
+  d->pump_started = true;
+  return 0;
+}
+
+void dispatcher_configure(dispatcher_t *d, const server_config_t *config) {
+  d->policy = config->scheduling_policy;
+  d->client = config->scheduling_client;
+  d->small_image_size = config->small_image_size;
+  d->workers = config->max_workers;
+  // Followers are served from the leader's cached result, which images
+  // filtered by windows never have
+  d->coalesce_size = (off_t)config->cache_size << 20;
+  if (d->coalesce_size > (off_t)config->memory_budget << 20) {
+    d->coalesce_size = (off_t)config->memory_budget << 20;
+  }
+}
+
+int dispatcher_fd(const dispatcher_t *d) { return d->epoll; }
+
+int32_t dispatcher_pending(const dispatcher_t *d, job_source_t source) {
+  return d->count_by_source[source];
+}
+
+int dispatcher_push_socket(dispatcher_t *d, const socket_request_t *rq,
+                           int conn, int fd_in, int fd_out, pid_t pid,
+                           uid_t uid) {
+  if (d->count_by_source[JOB_SOCKET] >= DISPATCH_MAX_PENDING) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (rq->priority < PRIORITY_LOW || rq->priority > PRIORITY_HIGH) {
+    errno = EINVAL;
+    return -1;
+  }
+  // The connection may be closed by the front end before the request is run
+  int conn_copy = fcntl(conn, F_DUPFD_CLOEXEC, 0);
+  if (conn_copy == -1) {
+    return -1;
+  }
+  struct stat s;
+  pending_job_t p = {.source = JOB_SOCKET,
+                     .priority = rq->priority,
+                     .client = client_of(d, pid, true, uid),
+                     .rq = *rq,
+                     .fds = {conn_copy, fd_in, fd_out}};
+  off_t size = 0;
+  if (fstat(fd_in, &s) == 0) {
+    set_key(&p, &s, rq->filters, rq->filter_count, rq->border);
+    size = s.st_size;
+  }
+  enqueue(d, &p, size);
+  return 0;
+}
+
+// drain_ring: retire de la file les requêtes publiées tant que d a de la
+// place. Renvoit 0 en cas de succes, -1 si un enregistrement invalide a été
+// ignoré (errno vaut EBADMSG) ou en cas d'échec d'allocation.
+static int drain_ring(dispatcher_t *d) {
+  int ret = 0;
+  while (d->count_by_source[JOB_RING] < DISPATCH_MAX_PENDING) {
+    filter_request_t *rq = malloc(sizeof(*rq));
+    if (rq == nullptr) {
+      return -1;
+    }
+    if (request_ring_try_pop(d->ring, rq) == -1) {
+      int err = errno;
+      free(rq);
+      if (err == EAGAIN) {
+        break;
+      }
+      ret = -1;
+      continue;
+    }
+    struct stat s;
+    pending_job_t p = {.source = JOB_RING,
+                       .priority = rq->priority,
+                       .client = ring_client(d, rq),
+                       .fds = {-1, -1, -1},
+                       .request = rq};
+    // Unknown size: the worker fails at once, a cheap request
+    off_t size = 0;
+    if (stat(rq->path, &s) == 0) {
+      set_key(&p, &s, rq->filters, rq->filter_count, rq->border);
+      size = s.st_size;
+    }
+    enqueue(d, &p, size);
+  }
+  if (ret == -1) {
+    errno = EBADMSG;
+  }
+  return ret;
+}
+
+// send_job: remet la requête en attente p au worker d'emplacement slot par
+// son channel avec le ticket ticket, sans attendre. Renvoit 0 en cas de
+// succes, -1 sinon (errno est positionné).
+static int send_job(const dispatcher_t *d, int32_t slot,
+                    const pending_job_t *p, uint64_t ticket) {
+  int channel = d->slots[slot].channel[0];
+  dispatch_msg_t msg = {.ticket = ticket, .source = p->source};
+  if (p->source == JOB_SOCKET) {
+    msg.socket = p->rq;
+    return send_fds(channel, &msg, SOCKET_MSG_SIZE, p->fds, 3,
+                    MSG_DONTWAIT | MSG_NOSIGNAL) == -1
+               ? -1
+               : 0;
+  }
+  msg.ring = *p->request;
+  return send_fds(channel, &msg, sizeof(msg), nullptr, 0,
+                  MSG_DONTWAIT | MSG_NOSIGNAL) == -1
+             ? -1
+             : 0;
+}
+
+// read_notes: traite les messages des workers en attente dans le tube done
+// de d
+static void read_notes(dispatcher_t *d) {
+  dispatch_note_t notes[64];
+  ssize_t n;
+  while ((n = read(d->done[0], notes, sizeof(notes))) > 0) {
+    for (ssize_t k = 0; k < n / (ssize_t)sizeof(*notes); ++k) {
+      if (notes[k].worker != 0) {
+        taken(d, notes[k].ticket, (pid_t)notes[k].worker);
+      } else {
+        finish(d, notes[k].ticket);
+      }
+    }
+  }
+}
+
+// idle_slot: renvoit l'emplacement d'un worker de d sans requête remise, -1
+// s'il n'y en a pas
+static int32_t idle_slot(const dispatcher_t *d) {
+  for (int32_t slot = 0; slot < d->workers; ++slot) {
+    bool busy = d->slots[slot].pid == 0;
+    for (int32_t i = 0; i < d->running_count && !busy; ++i) {
+      busy = d->running[i].slot == slot;
+    }
+    if (!busy) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+int dispatcher_run(dispatcher_t *d) {
+  int ret = 0;
+  read_notes(d);
+  uint64_t count;
+  // Only wakes the main loop up: the ring itself is drained below
+  if (read(d->ring_event, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    ret = -1;
+  }
+  if (drain_ring(d) == -1) {
+    ret = -1;
+  }
+  int32_t i;
+  int32_t slot;
+  while ((slot = idle_slot(d)) != -1 && (i = pick(d)) != -1) {
+    uint64_t ticket = d->ticket + 1;
+    if (send_job(d, slot, &d->pending[i], ticket) == -1) {
+      // Worker gone: sent to another one once it is reaped
+      if (errno != EPIPE) {
+        ret = -1;
+      }
+      break;
+    }
+    d->ticket = ticket;
+    lead(d, i, slot, ticket);
+    remove_pending(d, i);
+  }
+  return ret;
+}
+
+int dispatcher_open_slot(dispatcher_t *d, int32_t slot) {
+  int *channel = d->slots[slot].channel;
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel) == -1) {
+    return -1;
+  }
+  if (shutdown(channel[0], SHUT_RD) == -1 ||
+      shutdown(channel[1], SHUT_WR) == -1) {
+    int err = errno;
+    dispatcher_bind_slot(d, slot, -1);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+void dispatcher_bind_slot(dispatcher_t *d, int32_t slot, pid_t pid) {
+  dispatch_slot_t *s = &d->slots[slot];
+  close(s->channel[1]);
+  s->channel[1] = -1;
+  if (pid == -1) {
+    close(s->channel[0]);
+    s->channel[0] = -1;
+    return;
+  }
+  s->pid = pid;
+}
+
+void dispatcher_forget(dispatcher_t *d, pid_t worker) {
+  // Its last notes may still be in the pipe
+  read_notes(d);
+  int32_t slot = 0;
+  while (slot < ABSOLUTE_MAX_WORKERS && d->slots[slot].pid != worker) {
+    ++slot;
+  }
+  if (slot == ABSOLUTE_MAX_WORKERS) {
+    return;
+  }
+  close(d->slots[slot].channel[0]);
+  d->slots[slot] = (dispatch_slot_t){.pid = 0, .channel = {-1, -1}};
+  int32_t r = 0;
+  while (r < d->running_count && d->running[r].slot != slot) {
+    ++r;
+  }
+  if (r == d->running_count) {
+    return;
+  }
+  dispatch_running_t run = d->running[r];
+  d->running[r] = d->running[--d->running_count];
+
+  // NOT RECEIVED
+  // Nothing was started: pending again, its followers with it
+  if (!run.taken) {
+    for (int32_t k = 0; k < d->count; ++k) {
+      if (d->pending[k].leader == run.ticket) {
+        d->pending[k].leader = 0;
+      }
+    }
+    pending_job_t p = run.job;
+    enqueue(d, &p, p.keyed ? p.key.size : 0);
+    return;
+  }
+
+  // RECEIVED
+  // It may be what killed the worker: failed with its followers, which
+  // would otherwise run it again. Its own FIFO may already carry part of an
+  // image: a ring client learns it from the FIFO closed by the worker's end.
+  if (run.job.source == JOB_SOCKET) {
+    fail(&run.job, WORKER_DIED);
+  }
+  release(&run.job);
+  for (int32_t k = 0; k < d->count;) {
+    if (d->pending[k].leader != run.ticket) {
+      ++k;
+      continue;
+    }
+    fail(&d->pending[k], WORKER_DIED);
+    release(&d->pending[k]);
+    remove_pending(d, k);
+  }
+}
+
+//---- [WORKERS] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+void dispatcher_close_front(dispatcher_t *d, int32_t slot) {
+  int fds[3] = {d->epoll, d->ring_event, d->done[0]};
+  for (int i = 0; i < 3; ++i) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  d->epoll = -1;
+  d->ring_event = -1;
+  d->done[0] = -1;
+  // Only the main process may send: workers learn its end from EOF
+  for (int32_t i = 0; i < ABSOLUTE_MAX_WORKERS; ++i) {
+    if (d->slots[i].channel[0] != -1) {
+      close(d->slots[i].channel[0]);
+      d->slots[i].channel[0] = -1;
+    }
+  }
+  d->self = slot;
+  // The pump thread is not copied by fork
+  d->pump_started = false;
+  for (int32_t i = 0; i < d->count; ++i) {
+    release(&d->pending[i]);
+  }
+  d->count = 0;
+  for (int32_t i = 0; i < d->running_count; ++i) {
+    release(&d->running[i].job);
+  }
+  d->running_count = 0;
+}
+
+// note: écrit dans le tube done de d que la requête de ticket ticket a été
+// reçue par le worker worker, ou terminée si worker vaut 0
+static void note(const dispatcher_t *d, uint64_t ticket, pid_t worker) {
+  dispatch_note_t msg = {.ticket = ticket, .worker = worker};
+  // A lost note would hold the followers of this request forever
+  while (write(d->done[1], &msg, sizeof(msg)) == -1 && errno == EINTR) {
+  }
+}
+
+int dispatcher_take(const dispatcher_t *d, job_t *job) {
+  int channel = d->slots[d->self].channel[1];
+  dispatch_msg_t msg;
+  int fds[FD_PASSING_MAX_FDS];
+  int fd_count;
+  ssize_t n;
+  // recv_fds restarts after a signal: the wait is a poll, which does not
+  do {
+    struct pollfd pfd = {.fd = channel, .events = POLLIN};
+    if (poll(&pfd, 1, -1) == -1) {
+      return -1;
+    }
+    n = recv_fds(channel, &msg, sizeof(msg), fds, &fd_count, MSG_DONTWAIT);
+  } while (n == -1 && errno == EAGAIN);
+  if (n == -1) {
+    return -1;
+  }
+  if (n == 0) {
+    errno = EPIPE;
+    return -1;
+  }
+  job->source = msg.source;
+  job->ticket = msg.ticket;
+  if (msg.source == JOB_SOCKET && n == (ssize_t)SOCKET_MSG_SIZE &&
+      fd_count == 3) {
+    job->rq = msg.socket;
+    job->conn = fds[0];
+    job->fd_in = fds[1];
+    job->fd_out = fds[2];
+  } else if (msg.source == JOB_RING && n == (ssize_t)sizeof(msg) &&
+             fd_count == 0) {
+    job->request = msg.ring;
+  } else {
+    close_fds(fds, fd_count);
+    errno = EPROTO;
+    return -1;
+  }
+  // Should this worker die, the request is not dispatched again
+  note(d, job->ticket, getpid());
+  return 0;
+}
+
+void dispatcher_done(const dispatcher_t *d, const job_t *job) {
+  note(d, job->ticket, 0);
+}
+
+void dispatcher_dispose(dispatcher_t *d) {
+  if (d->pump_started) {
+    atomic_store(&d->stopping, true);
+    request_ring_notify(d->ring);
+    pthread_join(d->pump, nullptr);
+    d->pump_started = false;
+  }
+  // Slots are set up by dispatcher_init, before the epoll
+  for (int32_t i = 0; d->epoll != -1 && i < ABSOLUTE_MAX_WORKERS; ++i) {
+    for (int k = 0; k < 2; ++k) {
+      if (d->slots[i].channel[k] != -1) {
+        close(d->slots[i].channel[k]);
+      }
+    }
+    d->slots[i] = (dispatch_slot_t){.pid = 0, .channel = {-1, -1}};
+  }
+  int fds[4] = {d->epoll, d->done[0], d->done[1], d->ring_event};
+  for (int i = 0; i < 4; ++i) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  d->epoll = -1;
+  d->done[0] = -1;
+  d->done[1] = -1;
+  d->ring_event = -1;
+  for (int32_t i = 0; i < d->count; ++i) {
+    release(&d->pending[i]);
+  }
+  d->count = 0;
+  for (int32_t i = 0; i < d->running_count; ++i) {
+    release(&d->running[i].job);
+  }
+  d->running_count = 0;
+}
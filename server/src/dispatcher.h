@@ -0,0 +1,230 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "opt_to_request.h"
+#include "request_ring.h"
+
+#define DISPATCH_MAX_PENDING 1024 // requêtes en attente de chaque source
+// Coût fixe en octets d'une requête pour le partage équitable, ajouté à la
+// taille de son image
+#define DISPATCH_REQUEST_COST 65536
+
+// RÉPARTITEUR
+// Le processus principal retire les requêtes de la file partagée ring (un
+// thread change ses publications en évènements lisibles par epoll) et reçoit
+// celles du frontal par socket, puis les garde en attente et remet aux workers
+// libres, par le socket interne channel de chacun, au plus une requête par
+// worker : l'ordre de traitement est ainsi choisi au dernier moment parmi
+// toutes les requêtes en attente, selon la politique de la configuration :
+// - fifo : ordre d'arrivée ;
+// - priority : classe de priorité la plus haute, puis images d'au plus
+//   small_image_size octets, puis ordre d'arrivée ;
+// - fair : classe de priorité la plus haute, puis partage équitable du temps
+//   des workers entre clients (utilisateur ou processus, scheduling_client).
+//   L'identité d'un client est établie par le noyau, jamais lue dans sa
+//   requête (voir client_of).
+//   Chaque flux (client, priorité, petite image ou non) reçoit des étiquettes
+//   de fin virtuelles croissantes, son étiquette précédente (ou l'horloge
+//   virtuelle si elle est plus récente) plus le coût de la requête (taille de
+//   l'image plus DISPATCH_REQUEST_COST), et la plus petite étiquette passe en
+//   premier : un client qui envoie mille grosses images n'attend que sa part,
+//   et les petites images passent devant les grosses.
+// Chaque requête remise porte un ticket, que le worker écrit dans le tube
+// done avec son pid à sa réception, puis seul une fois la requête terminée.
+// Le processus principal garde la requête et ses descripteurs jusque-là : un
+// worker terminé anormalement avant de signaler sa réception n'a rien
+// commencé, la requête est remise à nouveau ; après, elle échoue (EIO) avec
+// ses suiveurs.
+// REGROUPEMENT
+// Lorsque le cache de résultats est actif, une requête identique à une
+// requête remise non terminée (même fichier d'entrée, par son inode, sa
+// taille et sa date de modification, et même pipeline) n'est pas remise tout
+// de suite : elle suit cette dernière, son meneur, et reste en attente jusqu'à
+// sa fin. Elle est alors servie par le cache à partir du résultat du meneur,
+// sans appliquer à nouveau les filtres, en même temps que les autres suiveurs.
+// Les requêtes identiques en attente suivent de même la première remise
+// d'entre elles.
+
+typedef enum { JOB_SOCKET, JOB_RING } job_source_t;
+
+// Requête remise à un worker
+typedef struct {
+  job_source_t source;
+  // JOB_SOCKET : requête, connexion du client et fichiers
+  socket_request_t rq;
+  int conn;
+  int fd_in;
+  int fd_out;
+  // JOB_RING
+  filter_request_t request;
+  uint64_t ticket;
+} job_t;
+
+// Identité d'une requête pour le regroupement
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+} dispatch_key_t;
+
+// Requête en attente dans le processus principal
+typedef struct {
+  job_source_t source;
+  request_priority_t priority;
+  uint64_t client; // voir client_of
+  bool small;
+  uint64_t seq;    // ordre d'arrivée
+  uint64_t start;  // étiquettes virtuelles (fair)
+  uint64_t finish;
+  socket_request_t rq;
+  int fds[3];                // JOB_SOCKET : conn, fd_in, fd_out
+  filter_request_t *request; // JOB_RING
+  bool keyed;                // key est connue (fichier d'entrée lisible)
+  dispatch_key_t key;
+  uint64_t leader; // ticket du meneur suivi, 0 si la requête peut être remise
+  bool replay;     // suiveur libéré, servi par le cache : ne mène plus
+} pending_job_t;
+
+// Requête remise non terminée, avec ses ressources
+typedef struct {
+  uint64_t ticket;
+  int32_t slot; // emplacement du worker à qui elle a été remise
+  bool taken;   // réception signalée par le worker
+  bool leads;   // meneur possible, de clé job.key
+  pending_job_t job;
+} dispatch_running_t;
+
+// Emplacement d'un worker
+typedef struct {
+  pid_t pid;      // 0 si l'emplacement est libre
+  int channel[2]; // envoi (processus principal), réception (worker)
+} dispatch_slot_t;
+
+// Flux de requêtes en attente (fair)
+typedef struct {
+  uint64_t client;
+  request_priority_t priority;
+  bool small;
+  uint64_t finish; // étiquette de sa dernière requête
+  int32_t count;   // requêtes en attente
+} dispatch_flow_t;
+
+typedef struct {
+  int epoll;   // done et ring_event
+  int done[2]; // tube des tickets terminés : lecture, écriture (workers)
+  int ring_event; // eventfd, publications de la file partagée
+  request_t *ring;
+  pthread_t pump;
+  bool pump_started;
+  atomic_bool stopping;
+  scheduling_policy_t policy;
+  scheduling_client_t client;
+  off_t small_image_size;
+  off_t coalesce_size; // images regroupées au plus (taille du cache et budget
+                       // mémoire), 0 aucune
+  int32_t workers;     // emplacements auxquels des requêtes sont remises
+  dispatch_slot_t slots[ABSOLUTE_MAX_WORKERS];
+  int32_t self; // emplacement du worker, -1 dans le processus principal
+  // Requêtes remises à un worker terminé avant de les recevoir : en attente
+  // à nouveau, au-delà de DISPATCH_MAX_PENDING
+  pending_job_t pending[2 * DISPATCH_MAX_PENDING + ABSOLUTE_MAX_WORKERS];
+  int32_t count;
+  int32_t count_by_source[2];
+  dispatch_flow_t flows[2 * DISPATCH_MAX_PENDING + ABSOLUTE_MAX_WORKERS];
+  int32_t flow_count;
+  uint64_t seq;
+  uint64_t vtime; // horloge virtuelle : début de la dernière requête remise
+  dispatch_running_t running[ABSOLUTE_MAX_WORKERS]; // requêtes remises
+  int32_t running_count;
+  uint64_t ticket;    // dernier ticket donné
+  uint64_t coalesced; // requêtes ayant suivi un meneur
+} dispatcher_t;
+
+#define DISPATCHER_INITIALIZER                                                 \
+  {.epoll = -1, .done = {-1, -1}, .ring_event = -1, .self = -1}
+
+// dispatcher_init: crée le tube done, l'eventfd et l'epoll du
+// répartiteur pointé par d, appliqué à la configuration config, puis démarre
+// le thread qui surveille la file ring. Renvoit 0 en cas de succes, -1 sinon
+// (errno est positionné).
+int dispatcher_init(dispatcher_t *d, request_t *ring,
+                    const server_config_t *config);
+
+// dispatcher_configure: applique à d la politique, le nombre de workers, la
+// taille du cache de résultats et le budget mémoire de config (rechargement
+// de la configuration)
+void dispatcher_configure(dispatcher_t *d, const server_config_t *config);
+
+// dispatcher_fd: renvoit l'epoll de d, lisible lorsqu'une requête est
+// terminée ou publiée dans la file, à surveiller par la boucle principale
+int dispatcher_fd(const dispatcher_t *d);
+
+// dispatcher_pending: renvoit le nombre de requêtes en attente de la source
+// source
+int32_t dispatcher_pending(const dispatcher_t *d, job_source_t source);
+
+// dispatcher_push_socket: met en attente la requête rq du frontal par socket,
+// reçue de la connexion conn du client de pid pid et d'utilisateur uid avec
+// l'image fd_in et le fichier de sortie fd_out. Les descripteurs appartiennent
+// ensuite à d (conn est dupliqué). Renvoit 0 en cas de succes, -1 sinon
+// (errno est positionné, EBUSY s'il y a déjà DISPATCH_MAX_PENDING requêtes
+// en attente) : les descripteurs restent alors à l'appelant.
+int dispatcher_push_socket(dispatcher_t *d, const socket_request_t *rq,
+                           int conn, int fd_in, int fd_out, pid_t pid,
+                           uid_t uid);
+
+// dispatcher_run: traite sans attendre les évènements de d, retire de la file
+// les requêtes publiées tant qu'il y a de la place, puis remet aux workers
+// libres les requêtes choisies par la politique. Renvoit 0 en cas de succes,
+// -1 si un enregistrement invalide de la file a été ignoré (errno vaut
+// EBADMSG) ou si une requête n'a pas pu être remise (errno est positionné,
+// elle reste en attente).
+int dispatcher_run(dispatcher_t *d);
+
+// dispatcher_open_slot: crée le socket interne de l'emplacement slot de d,
+// libre, avant la création de son worker. Renvoit 0 en cas de succes, -1
+// sinon (errno est positionné).
+int dispatcher_open_slot(dispatcher_t *d, int32_t slot);
+
+// dispatcher_bind_slot: attribue l'emplacement slot de d au worker pid qui
+// vient d'être créé, ou le libère si pid vaut -1 (échec de fork)
+void dispatcher_bind_slot(dispatcher_t *d, int32_t slot, pid_t pid);
+
+// dispatcher_forget: libère l'emplacement du worker worker, terminé. Sa
+// requête non terminée est remise à nouveau s'il n'a pas signalé sa
+// réception, sinon elle échoue avec ses suiveurs : leurs clients par socket
+// reçoivent EIO, ceux de la file qui suivaient également, par leur FIFO.
+void dispatcher_forget(dispatcher_t *d, pid_t worker);
+
+// dispatcher_close_front: ferme, dans le worker d'emplacement slot, les
+// descripteurs et libère les requêtes du processus principal hérités à sa
+// création, sauf la réception de son channel et l'écriture de done
+void dispatcher_close_front(dispatcher_t *d, int32_t slot);
+
+// dispatcher_take: attend qu'une requête soit remise au worker par son
+// channel, signale sa réception au processus principal et l'écrit dans job.
+// Renvoit 0 en cas de succes, -1 sinon (errno est positionné, EINTR si
+// l'attente a été interrompue par un signal, EPIPE si le processus principal
+// s'est terminé).
+int dispatcher_take(const dispatcher_t *d, job_t *job);
+
+// dispatcher_done: signale au processus principal la fin de la requête job
+void dispatcher_done(const dispatcher_t *d, const job_t *job);
+
+// dispatcher_dispose: arrête le thread, ferme les descripteurs et libère les
+// requêtes en attente du répartiteur pointé par d
+void dispatcher_dispose(dispatcher_t *d);
+
+#endif
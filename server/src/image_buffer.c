@@ -0,0 +1,104 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS, MAP_POPULATE, MAP_HUGETLB, madvise
+
+#include "image_buffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "full_io.h"
+
+image_buffer_kind_t image_buffer_kind(size_t size) {
+  if (size >= IMAGE_BUFFER_HUGE_MIN) {
+    return IMAGE_BUFFER_HUGE;
+  }
+  return size >= IMAGE_BUFFER_MAP_MIN ? IMAGE_BUFFER_MAP : IMAGE_BUFFER_READ;
+}
+
+// map_huge: projette une zone anonyme de size octets, arrondie aux grandes
+// pages et alignée sur elles, dans les pages réservées si possible. Écrit sa
+// taille dans mapped. Renvoit son adresse ou MAP_FAILED en cas d'échec (errno
+// est positionné).
+static void *map_huge(size_t size, size_t *mapped) {
+  size_t length = (size + IMAGE_BUFFER_HUGE_PAGE - 1) &
+                  ~(size_t)(IMAGE_BUFFER_HUGE_PAGE - 1);
+  *mapped = length;
+  // HUGETLB
+  // Only when the administrator reserved some (vm.nr_hugepages)
+  void *data = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                        (21 << MAP_HUGE_SHIFT),
+                    -1, 0);
+  if (data != MAP_FAILED) {
+    return data;
+  }
+
+  // TRANSPARENT HUGE PAGES
+  // One more huge page to align on: the slack on both sides is unmapped
+  uint8_t *area = mmap(nullptr, length + IMAGE_BUFFER_HUGE_PAGE,
+                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+  if (area == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  size_t head = (IMAGE_BUFFER_HUGE_PAGE -
+                 (uintptr_t)area % IMAGE_BUFFER_HUGE_PAGE) %
+                IMAGE_BUFFER_HUGE_PAGE;
+  if (head > 0) {
+    munmap(area, head);
+  }
+  munmap(area + head + length, IMAGE_BUFFER_HUGE_PAGE - head);
+  // Best effort: small pages if THP is disabled
+  madvise(area + head, length, MADV_HUGEPAGE);
+  return area + head;
+}
+
+int image_buffer_load(image_buffer_t *b, int fd, size_t size) {
+  *b = (image_buffer_t){
+      .size = size, .mapped = size, .kind = image_buffer_kind(size)};
+  // The file is read once, from start to end
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  void *data = MAP_FAILED;
+  switch (b->kind) {
+  case IMAGE_BUFFER_READ:
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    break;
+  case IMAGE_BUFFER_MAP:
+    // Written by the filters: copied now rather than on each page fault
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    break;
+  case IMAGE_BUFFER_HUGE:
+    data = map_huge(size, &b->mapped);
+    break;
+  }
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  b->data = data;
+  if (b->kind == IMAGE_BUFFER_MAP) {
+    return 0;
+  }
+
+  ssize_t n = full_pread(fd, b->data, size, 0);
+  if (n != (ssize_t)size) {
+    int err = n >= 0 ? EIO : errno; // image truncated since stat
+    image_buffer_release(b);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+int image_buffer_release(image_buffer_t *b) {
+  if (b->data == nullptr) {
+    return 0;
+  }
+  int ret = munmap(b->data, b->mapped);
+  b->data = nullptr;
+  return ret;
+}
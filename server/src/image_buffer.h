@@ -0,0 +1,61 @@
+#ifndef IMAGE_BUFFER_H
+#define IMAGE_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Taille d'une grande page (huge page) de la MMU
+#define IMAGE_BUFFER_HUGE_PAGE (2 * 1024 * 1024)
+
+// Taille minimale d'une image projetée depuis son fichier
+#define IMAGE_BUFFER_MAP_MIN (64 * 1024)
+
+// Taille minimale d'une image lue en grandes pages
+#define IMAGE_BUFFER_HUGE_MIN IMAGE_BUFFER_HUGE_PAGE
+
+// CHARGEMENT DES IMAGES
+// Une image est filtrée sur place dans une copie privée : projetée depuis son
+// fichier avec MAP_PRIVATE, chaque page de 4 Kio écrite par un filtre coûte
+// un défaut de page et sa copie (copy-on-write). La manière de charger
+// l'image est donc choisie selon sa taille :
+// - IMAGE_BUFFER_READ : une petite image est lue par pread dans une
+//   projection anonyme préchargée (MAP_POPULATE), sans projection de fichier
+//   à mettre en place ;
+// - IMAGE_BUFFER_MAP : une image moyenne est projetée depuis son fichier avec
+//   MAP_POPULATE, qui copie toutes ses pages d'un coup dans le noyau au lieu
+//   d'un défaut de page par page écrite ;
+// - IMAGE_BUFFER_HUGE : une grande image est lue par pread dans une
+//   projection anonyme alignée sur les grandes pages, prise dans les pages
+//   réservées (MAP_HUGETLB) s'il y en a, sinon en pages transparentes
+//   (MADV_HUGEPAGE) : un défaut de page couvre alors 2 Mio.
+// Dans tous les cas le tampon est privé au worker, ses pages peuvent être
+// placées dans un tube par vmsplice puis libérées.
+
+typedef enum {
+  IMAGE_BUFFER_READ,
+  IMAGE_BUFFER_MAP,
+  IMAGE_BUFFER_HUGE,
+} image_buffer_kind_t;
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  size_t mapped; // taille de la projection à data (arrondie aux grandes pages)
+  image_buffer_kind_t kind;
+} image_buffer_t;
+
+#define IMAGE_BUFFER_INITIALIZER {.data = nullptr}
+
+// image_buffer_kind: renvoit la manière de charger une image de size octets
+image_buffer_kind_t image_buffer_kind(size_t size);
+
+// image_buffer_load: charge dans b, modifiable, l'image de size octets du
+// fichier fd selon image_buffer_kind. Renvoit 0 en cas de succes, -1 sinon
+// (errno est positionné, EIO si le fichier compte moins de size octets).
+int image_buffer_load(image_buffer_t *b, int fd, size_t size);
+
+// image_buffer_release: libère le tampon b s'il est chargé. Renvoit 0 en cas
+// de succes, -1 sinon (errno est positionné).
+int image_buffer_release(image_buffer_t *b);
+
+#endif
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE // copy_file_range, F_SETPIPE_SZ
+
 #include <fcntl.h>
+#include <inttypes.h>
 #include <linux/limits.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -7,20 +10,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/fsuid.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "bmp.h"
 #include "config.h"
+#include "dispatcher.h"
 #include "full_io.h"
+#include "image_buffer.h"
+#include "out_of_core.h"
+#include "request_ring.h"
+#include "result_cache.h"
+#include "row_stream.h"
+#include "socket_server.h"
+#include "thread_pool.h"
+#include "tile_scheduler.h"
 #include "utils.h"
 
 #define PID_FILE "/tmp/bmp_server.pid"
-#define MUTEX_WORKER_COUNT "/mutex_worker_count"
 #define MUTEX_CONFIG_BMP "/mutex_bmp_config"
+// Délai en secondes de chaque transfert (statut, image) vers la FIFO de réponse
 #define WRITE_TIMEOUT 5
+// Taille demandée pour le tube de la FIFO de réponse (plafonnée par
+// /proc/sys/fs/pipe-max-size pour un serveur non root)
+#define RESPONSE_PIPE_SIZE (1024 * 1024)
 
 //---- [FILTERS] -------------------------------------------------------------//
 //----------------------------------------------------------------------------//
@@ -32,6 +54,7 @@
 //----------------------------------------------------------------------------//
 
 void start_worker(filter_request_t *rq);
+static void serve_socket_job(job_t *job);
 
 //---- [LOG] -----------------------------------------------------------------//
 //----------------------------------------------------------------------------//
@@ -54,51 +77,14 @@ void start_worker(filter_request_t *rq);
     }                                                                          \
   }
 
-//---- [TIME OUT] ------------------------------------------------------------//
-//----------------------------------------------------------------------------//
-
-void handle_sigalrm(int sig) {
-  (void)sig;
-  syslog(LOG_ERR, "Write operation timed out");
-  exit(EXIT_FAILURE);
-}
-
-static void set_write_timeout(unsigned int seconds) {
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = handle_sigalrm;
-  sa.sa_flags = 0;
-  sigaction(SIGALRM, &sa, NULL);
-  alarm(seconds);
-}
-
 //---- [STOP] ----------------------------------------------------------------//
 //----------------------------------------------------------------------------//
 
 static atomic_int running = 1;
-static sem_t *g_mutex_full = SEM_FAILED;
 
 void handle_sigint(int sig) {
   (void)sig;
   running = 0;
-
-  if (g_mutex_full != SEM_FAILED)
-    sem_post(g_mutex_full);
-}
-
-//---- [SIGCHLD] -------------------------------------------------------------//
-//----------------------------------------------------------------------------//
-
-static sem_t *g_mutex_worker_count = SEM_FAILED;
-void handle_sigchld(int sig) {
-  (void)sig;
-  int saved_errno = errno;
-  while (waitpid(-1, NULL, WNOHANG) > 0) {
-    if (g_mutex_worker_count != SEM_FAILED) {
-      sem_post(g_mutex_worker_count);
-    }
-  }
-  errno = saved_errno;
 }
 
 //---- [CONFIG] --------------------------------------------------------------//
@@ -107,36 +93,27 @@ void handle_sigchld(int sig) {
 static server_config_t g_config;
 static sem_t *g_config_mutex = SEM_FAILED;
 
-void handle_sighup(int sig) {
-  (void)sig;
-  P(g_config_mutex);
-  int old_max_worker = g_config.max_workers;
+// reload_config: recharge la configuration du server. En cas d'échec la
+// configuration courante est conservée. Retourne 0 en cas de succès sinon -1
+static int reload_config(void) {
+  server_config_t config;
   // LOCAL
-  if (config_load(&g_config, CONFIG_FILE_PATH_LOCAL) < 0) {
+  if (config_load(&config, CONFIG_FILE_PATH_LOCAL) < 0) {
     // SYS
-    if (config_load(&g_config, CONFIG_FILE_PATH_SYSTEM) < 0) {
+    if (config_load(&config, CONFIG_FILE_PATH_SYSTEM) < 0) {
       syslog(LOG_WARNING, "Failed to reload config, keeping current settings");
-      V(g_config_mutex);
-      return;
-    }
-  }
-  // MAX WORKER
-  if (g_config.max_workers < old_max_worker) {
-    for (int k = 0; k < old_max_worker - g_config.max_workers; ++k) {
-      P(g_mutex_worker_count);
-    }
-  } else {
-    for (int k = 0; k < g_config.max_workers - old_max_worker; ++k) {
-      V(g_mutex_worker_count);
+      return -1;
     }
   }
+  P(g_config_mutex);
+  g_config = config;
+  V(g_config_mutex);
 
   syslog(LOG_INFO, "Config reloaded from %s", CONFIG_FILE_PATH_LOCAL);
-  syslog(LOG_INFO, "max_workers = %d", g_config.max_workers);
-  syslog(LOG_INFO, "min_threads = %d", g_config.min_threads);
-  syslog(LOG_INFO, "max_threads = %d", g_config.max_threads);
-
-  V(g_config_mutex);
+  syslog(LOG_INFO, "max_workers = %d", config.max_workers);
+  syslog(LOG_INFO, "min_threads = %d", config.min_threads);
+  syslog(LOG_INFO, "max_threads = %d", config.max_threads);
+  return 0;
 }
 
 //---- [DEAMON] --------------------------------------------------------------//
@@ -180,7 +157,8 @@ int daemonize(void) {
   default:
     exit(EXIT_SUCCESS);
   }
-  umask(0);
+  // Objects shared with clients are given their permissions explicitly
+  umask(S_IWGRP | S_IWOTH);
   if (chdir("/") < 0) {
     return -1;
   }
@@ -199,6 +177,268 @@ int daemonize(void) {
   return 0;
 }
 
+//---- [EVENT LOOP] ----------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// La boucle principale attend par un seul epoll les signaux (signalfd), la
+// fin du délai avant une nouvelle tentative après un échec (timerfd) et les
+// évènements du frontal par socket.
+
+#define RETRY_DELAY_MS 500 // délai avant de recréer les workers ou d'accepter
+                           // à nouveau des connexions après un échec
+
+static int g_epoll = -1;
+static int g_signal_fd = -1;
+static int g_retry_fd = -1;
+
+// events_init: crée les descripteurs de la boucle principale, qui lit les
+// signaux de mask (bloqués) et surveille l'epoll socket_epoll du frontal et
+// l'epoll dispatch_epoll du répartiteur. Renvoit 0 en cas de succes, -1 sinon
+// (errno est positionné).
+static int events_init(const sigset_t *mask, int socket_epoll,
+                       int dispatch_epoll) {
+  g_signal_fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  g_retry_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  g_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (g_signal_fd == -1 || g_retry_fd == -1 || g_epoll == -1) {
+    return -1;
+  }
+  int fds[4] = {g_signal_fd, g_retry_fd, socket_epoll, dispatch_epoll};
+  for (int i = 0; i < 4; ++i) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[i]};
+    if (epoll_ctl(g_epoll, EPOLL_CTL_ADD, fds[i], &ev) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// events_close: ferme les descripteurs de la boucle principale (à l'arrêt, ou
+// dans un worker qui les a hérités)
+static void events_close(void) {
+  int fds[3] = {g_epoll, g_signal_fd, g_retry_fd};
+  for (int i = 0; i < 3; ++i) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  g_epoll = -1;
+  g_signal_fd = -1;
+  g_retry_fd = -1;
+}
+
+// arm_retry: programme une nouvelle tentative dans RETRY_DELAY_MS
+static void arm_retry(void) {
+  struct itimerspec t = {
+      .it_value = {.tv_sec = RETRY_DELAY_MS / 1000,
+                   .tv_nsec = (RETRY_DELAY_MS % 1000) * 1000000L}};
+  timerfd_settime(g_retry_fd, 0, &t, nullptr);
+}
+
+//---- [WORKER POOL] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les workers sont des processus créés au démarrage du server (et recréés
+// lorsqu'ils se terminent) qui reçoivent les requêtes du répartiteur du
+// processus principal, ce qui évite un fork par requête. Leur nombre est
+// définit par max_workers.
+
+static pid_t g_workers[ABSOLUTE_MAX_WORKERS];
+static thread_pool_t g_pool;
+static socket_server_t g_socket = SOCKET_SERVER_INITIALIZER;
+static dispatcher_t g_dispatch = DISPATCHER_INITIALIZER;
+static result_cache_t g_cache = RESULT_CACHE_INITIALIZER;
+
+// worker_loop: boucle principale d'un worker, reçoit les requêtes remises par
+// le répartiteur et les traite jusqu'à la réception de SIGINT ou SIGTERM. Une
+// requête en cours de traitement est toujours terminée.
+static void worker_loop(const char *prog) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_sigint;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGHUP, &sa, nullptr);
+  sigaction(SIGUSR1, &sa, nullptr);
+  // A client gone before the final status write must not kill the worker
+  sigaction(SIGPIPE, &sa, nullptr);
+  sa.sa_handler = SIG_DFL;
+  sigaction(SIGCHLD, &sa, nullptr);
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+  errno = thread_pool_init(&g_pool, g_config.max_threads);
+  if (errno != 0) {
+    MESSAGE_ERR_D(prog, "thread_pool_init");
+    exit(EXIT_FAILURE);
+  }
+
+  while (running) {
+    job_t job;
+    if (dispatcher_take(&g_dispatch, &job) == -1) {
+      if (errno == EPIPE) {
+        break;
+      }
+      if (errno != EINTR) {
+        MESSAGE_ERR_D(prog, "dispatcher_take");
+      }
+      continue;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    // The worker serves one request at a time: the whole process is counted,
+    // filtering and sending threads included
+    struct rusage usage_start;
+    struct rusage usage_end;
+    getrusage(RUSAGE_SELF, &usage_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    MESSAGE_INFO_D(prog, "Processing new request");
+    if (job.source == JOB_SOCKET) {
+      serve_socket_job(&job);
+    } else {
+      start_worker(&job.request);
+    }
+    dispatcher_done(&g_dispatch, &job);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &usage_end);
+
+    char msg[160];
+    double elapsed_ms = (double)(end.tv_sec - start.tv_sec) * 1e3 +
+                        (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    snprintf(msg, sizeof(msg),
+             "Processing ended for a request (%.3f ms, %ld minor and %ld "
+             "major page faults)",
+             elapsed_ms, usage_end.ru_minflt - usage_start.ru_minflt,
+             usage_end.ru_majflt - usage_start.ru_majflt);
+    MESSAGE_INFO_D(prog, msg);
+  }
+  thread_pool_destroy(&g_pool);
+}
+
+// fill_worker_pool: crée les workers manquant pour atteindre max_workers.
+// Retourne 0 en cas de succès sinon -1
+static int fill_worker_pool(const char *prog) {
+  for (int i = 0; i < g_config.max_workers; ++i) {
+    if (g_workers[i] != 0) {
+      continue;
+    }
+    if (dispatcher_open_slot(&g_dispatch, i) == -1) {
+      return -1;
+    }
+    pid_t pid = fork();
+    switch (pid) {
+    case -1:
+      dispatcher_bind_slot(&g_dispatch, i, -1);
+      return -1;
+    case 0:
+      events_close();
+      socket_server_close_front(&g_socket);
+      dispatcher_close_front(&g_dispatch, i);
+      worker_loop(prog);
+      exit(EXIT_SUCCESS);
+    default:
+      dispatcher_bind_slot(&g_dispatch, i, pid);
+      g_workers[i] = pid;
+      break;
+    }
+  }
+  return 0;
+}
+
+// reap_workers: récupère les workers terminés et libère leur emplacement
+static void reap_workers(const char *prog) {
+  pid_t pid;
+  int status;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (int i = 0; i < ABSOLUTE_MAX_WORKERS; ++i) {
+      if (g_workers[i] == pid) {
+        g_workers[i] = 0;
+        break;
+      }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      MESSAGE_INFO_D(prog, "A worker terminated abnormally");
+    }
+    // It may have been serving a dispatched request
+    dispatcher_forget(&g_dispatch, pid);
+  }
+}
+
+// retire_workers: demande aux workers de se terminer après leur requête en
+// cours, ils seront recréés par fill_worker_pool (rechargement de la config)
+static void retire_workers(void) {
+  for (int i = 0; i < ABSOLUTE_MAX_WORKERS; ++i) {
+    if (g_workers[i] != 0) {
+      kill(g_workers[i], SIGTERM);
+    }
+  }
+}
+
+// stop_workers: termine tout les workers et attend leur fin
+static void stop_workers(void) {
+  retire_workers();
+  for (int i = 0; i < ABSOLUTE_MAX_WORKERS; ++i) {
+    if (g_workers[i] != 0) {
+      while (waitpid(g_workers[i], nullptr, 0) == -1 && errno == EINTR) {
+      }
+      g_workers[i] = 0;
+    }
+  }
+}
+
+// log_stats: écrit les compteurs du répartiteur et du cache de résultats dans
+// le journal
+static void log_stats(const char *prog) {
+  char msg[256];
+  snprintf(msg, sizeof(msg), "Dispatcher: %" PRIu64 " requests coalesced",
+           g_dispatch.coalesced);
+  MESSAGE_INFO_D(prog, msg);
+  if (g_cache.table == nullptr) {
+    return;
+  }
+  result_cache_stats_t st;
+  result_cache_stats(&g_cache, &st);
+  snprintf(msg, sizeof(msg),
+           "Result cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+           " stores, %" PRIu64 " evictions, %d entries, %" PRIu64 "/%" PRIu64
+           " bytes",
+           st.hits, st.misses, st.stores, st.evictions, st.entries, st.used,
+           st.capacity);
+  MESSAGE_INFO_D(prog, msg);
+}
+
+// handle_signals: traite les signaux lus sur g_signal_fd : arrêt (SIGINT),
+// rechargement de la configuration (SIGHUP), fin de workers (SIGCHLD) et
+// statistiques (SIGUSR1)
+static void handle_signals(const char *prog) {
+  struct signalfd_siginfo info;
+  while (read(g_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    switch (info.ssi_signo) {
+    case SIGINT:
+      running = 0;
+      break;
+    case SIGHUP:
+      if (reload_config() == 0) {
+        dispatcher_configure(&g_dispatch, &g_config);
+        result_cache_configure(&g_cache, (uint64_t)g_config.cache_size << 20);
+        retire_workers();
+      }
+      break;
+    case SIGCHLD:
+      reap_workers(prog);
+      break;
+    case SIGUSR1:
+      log_stats(prog);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
 //---- [MAIN] ----------------------------------------------------------------//
 //----------------------------------------------------------------------------//
 //----------------------------------------------------------------------------//
@@ -206,10 +446,7 @@ int daemonize(void) {
 int main(int argc, char *argv[]) {
   (void)argc;
   int ret = EXIT_SUCCESS;
-  request_t *rqs = MAP_FAILED;
-  sem_t *mutex_empty = SEM_FAILED;
-  sem_t *mutex_full = SEM_FAILED;
-  sem_t *mutex_write = SEM_FAILED;
+  request_t *rqs = nullptr;
   int fd = -1;
 
   //---- [PARSE ARGS        ] ------------------------------------------------//
@@ -252,22 +489,14 @@ int main(int argc, char *argv[]) {
   }
 
   //---- [SIGNAL HANDLER    ] ------------------------------------------------//
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = handle_sigint;
-  sigaction(SIGINT, &sa, nullptr);
-
-  struct sigaction sa_hup;
-  memset(&sa_hup, 0, sizeof(sa_hup));
-  sa_hup.sa_handler = handle_sighup;
-  sa_hup.sa_flags = SA_RESTART;
-  sigaction(SIGHUP, &sa_hup, nullptr);
-
-  struct sigaction sa_chld;
-  memset(&sa_chld, 0, sizeof(sa_chld));
-  sa_chld.sa_handler = handle_sigchld;
-  sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-  sigaction(SIGCHLD, &sa_chld, nullptr);
+  // Only read by the main loop through a signalfd (workers unblock them)
+  sigset_t signal_mask;
+  sigemptyset(&signal_mask);
+  sigaddset(&signal_mask, SIGINT);
+  sigaddset(&signal_mask, SIGHUP);
+  sigaddset(&signal_mask, SIGCHLD);
+  sigaddset(&signal_mask, SIGUSR1);
+  sigprocmask(SIG_BLOCK, &signal_mask, nullptr);
 
   //---- [SHM               ] ------------------------------------------------//
   fd = shm_open(REQUEST_FIFO_PATH, O_CREAT | O_EXCL | O_RDWR, PERMS);
@@ -281,6 +510,13 @@ int main(int argc, char *argv[]) {
     ret = EXIT_FAILURE;
     goto dispose;
   }
+  // Every local user is a client, whatever the umask: records are not
+  // trusted for who sent them (see dispatcher.h)
+  if (fchmod(fd, PERMS) == -1) {
+    MESSAGE_ERR_D(argv[0], "fchmod");
+    ret = EXIT_FAILURE;
+    goto dispose;
+  }
 
   //---- [PID FILE          ] ------------------------------------------------//
   if (daemon_mode) {
@@ -290,83 +526,105 @@ int main(int argc, char *argv[]) {
   }
 
   //---- [MAP               ] ------------------------------------------------//
-  if (ftruncate(fd, (off_t)sizeof(request_t)) == -1) {
-    MESSAGE_ERR_D(argv[0], "ftruncate");
+  rqs = request_ring_create(fd, (uint32_t)g_config.queue_size);
+  if (rqs == nullptr) {
+    MESSAGE_ERR_D(argv[0], "request_ring_create");
     ret = EXIT_FAILURE;
     goto dispose;
   }
-  rqs = mmap(nullptr, sizeof(request_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-             0);
-  if (rqs == MAP_FAILED) {
-    MESSAGE_ERR_D(argv[0], "mmap");
+
+  //---- [DISPATCHER       ] ------------------------------------------------//
+  if (dispatcher_init(&g_dispatch, rqs, &g_config) == -1) {
+    MESSAGE_ERR_D(argv[0], "dispatcher_init");
     ret = EXIT_FAILURE;
     goto dispose;
   }
-  rqs->write = 0;
 
-  //---- [MUTEX             ] ------------------------------------------------//
-  if ((mutex_write = sem_open(REQUEST_WRITE_PATH, O_CREAT | O_EXCL, PERMS,
-                              1)) == SEM_FAILED) {
-    MESSAGE_ERR_D(argv[0], "sem_open");
-    ret = EXIT_FAILURE;
-    goto dispose;
+  //---- [RESULT CACHE      ] ------------------------------------------------//
+  // Shared with the workers: created before them
+  if (result_cache_init(&g_cache, g_config.cache_dir,
+                        (uint64_t)g_config.cache_size << 20) == -1) {
+    MESSAGE_ERR_D(argv[0], "result_cache_init");
+    MESSAGE_INFO_D(argv[0], "Running without result cache");
   }
-  if ((mutex_empty = sem_open(REQUEST_EMPTY_PATH, O_CREAT | O_EXCL, PERMS,
-                              REQUEST_FIFO_SIZE)) == SEM_FAILED) {
-    MESSAGE_ERR_D(argv[0], "sem_open");
-    ret = EXIT_FAILURE;
-    goto dispose;
+
+  //---- [SOCKET            ] ------------------------------------------------//
+  // Each connection and each forwarded request holds descriptors
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
   }
-  if ((mutex_full = sem_open(REQUEST_FULL_PATH, O_CREAT | O_EXCL, PERMS, 0)) ==
-      SEM_FAILED) {
-    MESSAGE_ERR_D(argv[0], "sem_open");
+  if (socket_server_init(&g_socket, REQUEST_SOCKET_PATH, &g_dispatch) == -1) {
+    MESSAGE_ERR_D(argv[0], "socket_server_init");
     ret = EXIT_FAILURE;
     goto dispose;
   }
-  P(g_config_mutex);
-  sem_unlink(MUTEX_WORKER_COUNT);
-  if ((g_mutex_worker_count = sem_open(MUTEX_WORKER_COUNT, O_CREAT | O_EXCL,
-                                       PERMS, g_config.max_workers)) ==
-      SEM_FAILED) {
-    MESSAGE_ERR_D(argv[0], "sem_open");
+
+  //---- [WORKER POOL       ] ------------------------------------------------//
+  if (events_init(&signal_mask, g_socket.epoll, dispatcher_fd(&g_dispatch)) ==
+      -1) {
+    MESSAGE_ERR_D(argv[0], "events_init");
     ret = EXIT_FAILURE;
     goto dispose;
   }
-  V(g_config_mutex);
 
-  MESSAGE_INFO_D(argv[0], "BMP Server is runing");
+  if (fill_worker_pool(argv[0]) == -1) {
+    MESSAGE_ERR_D(argv[0], "fork");
+    ret = EXIT_FAILURE;
+    running = 0;
+  } else {
+    MESSAGE_INFO_D(argv[0], "BMP Server is runing");
+  }
 
-  //---- [READ REQUEST      ] ------------------------------------------------//
-  g_mutex_full = mutex_full;
-  int rd = 0;
+  //---- [SUPERVISE WORKERS ] ------------------------------------------------//
   while (running) {
-    P(g_mutex_worker_count);
-    P(mutex_full);
-    if (!running) {
+    struct epoll_event events[4];
+    int n = epoll_wait(g_epoll, events, 4, -1);
+    if (n == -1 && errno != EINTR) {
+      MESSAGE_ERR_D(argv[0], "epoll_wait");
+      ret = EXIT_FAILURE;
       break;
     }
-    filter_request_t rq = rqs->buffer[rd];
-    rd = (rd + 1) % REQUEST_FIFO_SIZE;
-    V(mutex_empty);
-    switch (fork()) {
-    case -1:
+    bool supervise = false;
+    for (int i = 0; i < n; ++i) {
+      int event_fd = events[i].data.fd;
+      if (event_fd == g_signal_fd) {
+        handle_signals(argv[0]);
+        supervise = true;
+      } else if (event_fd == g_retry_fd) {
+        uint64_t expirations;
+        if (read(g_retry_fd, &expirations, sizeof(expirations)) ==
+            sizeof(expirations)) {
+          socket_server_resume_accept(&g_socket);
+          supervise = true;
+        }
+      } else if (event_fd == g_socket.epoll &&
+                 socket_server_handle(&g_socket) == -1) {
+        MESSAGE_ERR_D(argv[0], "accept4");
+        arm_retry();
+      }
+    }
+    // Requests received or finished above are dispatched to idle workers
+    if (dispatcher_run(&g_dispatch) == -1) {
+      MESSAGE_ERR_D(argv[0], "dispatcher_run");
+    }
+    socket_server_update(&g_socket);
+    if (running && supervise && fill_worker_pool(argv[0]) == -1) {
       MESSAGE_ERR_D(argv[0], "fork");
-      V(g_mutex_worker_count);
-      ret = EXIT_FAILURE;
-      running = 0;
-      break;
-    case 0:
-      MESSAGE_INFO_D(argv[0], "Processing new request");
-      start_worker(&rq);
-      MESSAGE_INFO_D(argv[0], "Processing ended for a request");
-      exit(EXIT_SUCCESS);
-    default:
-      break;
+      arm_retry();
     }
   }
+  stop_workers();
+  log_stats(argv[0]);
   MESSAGE_INFO_D(argv[0], "Server is shuting down...");
 dispose:
-  if (rqs != MAP_FAILED && munmap(rqs, sizeof(request_t)) == -1) {
+  events_close();
+  socket_server_dispose(&g_socket, REQUEST_SOCKET_PATH);
+  dispatcher_dispose(&g_dispatch);
+  result_cache_dispose(&g_cache);
+  if (rqs != nullptr && request_ring_detach(rqs) == -1) {
     MESSAGE_ERR_D(argv[0], "munmap");
     ret = EXIT_FAILURE;
   }
@@ -378,43 +636,10 @@ dispose:
     MESSAGE_ERR_D(argv[0], "shm_unlink");
     ret = EXIT_FAILURE;
   }
-  if (mutex_write != SEM_FAILED && sem_close(mutex_write) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_close");
-    ret = EXIT_FAILURE;
-  }
-  if (mutex_empty != SEM_FAILED && sem_close(mutex_empty) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_close");
-    ret = EXIT_FAILURE;
-  }
-  if (mutex_full != SEM_FAILED && sem_close(mutex_full) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_close");
-    ret = EXIT_FAILURE;
-  }
   if (g_config_mutex != SEM_FAILED && sem_close(g_config_mutex) == -1) {
     MESSAGE_ERR_D(argv[0], "sem_close");
     ret = EXIT_FAILURE;
   }
-  if (g_mutex_worker_count != SEM_FAILED &&
-      sem_close(g_mutex_worker_count) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_close");
-    ret = EXIT_FAILURE;
-  }
-  if (sem_unlink(REQUEST_EMPTY_PATH) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_unlink");
-    ret = EXIT_FAILURE;
-  }
-  if (sem_unlink(REQUEST_FULL_PATH) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_unlink");
-    ret = EXIT_FAILURE;
-  }
-  if (sem_unlink(REQUEST_WRITE_PATH) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_unlink");
-    ret = EXIT_FAILURE;
-  }
-  if (sem_unlink(MUTEX_WORKER_COUNT) == -1) {
-    MESSAGE_ERR_D(argv[0], "sem_unlink");
-    ret = EXIT_FAILURE;
-  }
   if (sem_unlink(MUTEX_CONFIG_BMP) == -1) {
     MESSAGE_ERR_D(argv[0], "sem_unlink");
     ret = EXIT_FAILURE;
@@ -431,8 +656,20 @@ dispose:
 //----------------------------------------------------------------------------//
 //----------------------------------------------------------------------------//
 
-// apply_filter: apply filter to the image pointed by img
-int apply_filter(filter_t filter, bmp_mapped_image_t *img);
+// apply_pipeline: apply the filter_count filters of filters, in order, to the
+// image pointed by img, using the border policy border for convolution filters.
+// If stream is not nullptr, the rows are reported to it as they become final.
+int apply_pipeline(const filter_t *filters, int32_t filter_count,
+                   border_policy_t border, bmp_mapped_image_t *img,
+                   row_stream_t *stream);
+
+// filter_by_windows: applique le pipeline de filter_count filtres filters,
+// avec la politique de bord border, à l'image de size octets du fichier fd,
+// fenêtre par fenêtre (voir out_of_core.h), et l'envoie par send(ctx, ...).
+// Renvoit EXIT_SUCCESS ou un code errno.
+static int filter_by_windows(const filter_t *filters, int32_t filter_count,
+                             border_policy_t border, int fd, off_t size,
+                             row_stream_send_t send, void *ctx);
 
 // calculate_thread_count: Computes the optimal number of thread depending of
 // the min and max thread limits define in the config file.
@@ -443,23 +680,303 @@ int calculate_thread_count(off_t file_size) {
   return count;
 }
 
-// calculate_line_distribution: Computes the even distribution of lines
-// among threads. Returns an array of (thread_count + 1) elements
-// containing the start/end indices.
-// Example: height=14, threads=3 -> [0, 5, 10, 14] (sizes: 5, 5, 4)
-int32_t *calculate_line_distribution(int32_t height, int thread_count) {
-  int32_t *distribution = malloc(sizeof(int32_t) * (size_t)(thread_count + 1));
-  if (distribution == nullptr) {
-    return nullptr;
+// open_response_shm: ouvre le segment de réponse créé par le client pid, qui
+// doit avoir la taille size de l'image. Renvoit son descripteur ou -1 en cas
+// d'échec (errno est positionné).
+static int open_response_shm(pid_t pid, off_t size) {
+  char shm_path[255];
+  struct stat s;
+  snprintf(shm_path, sizeof(shm_path), "%s%d", RESPONSE_SHM_BASE_PATH, pid);
+  int shm = shm_open(shm_path, O_RDWR, 0);
+  if (shm == -1) {
+    MESSAGE_ERR_D("server worker", "shm_open");
+    return -1;
+  }
+  if (fstat(shm, &s) == -1) {
+    MESSAGE_ERR_D("server worker", "fstat");
+  } else if (s.st_size != size) {
+    errno = EINVAL;
+    MESSAGE_ERR_D("server worker", "Response shared memory size mismatch");
+  } else {
+    return shm;
+  }
+  int err = errno;
+  close(shm);
+  errno = err;
+  return -1;
+}
+
+// open_output: ouvre en écriture, sans le tronquer, le fichier path avec les
+// droits du client, identifié par le propriétaire de sa FIFO de réponse fifo
+// (un client ne peut pas créer de FIFO au nom d'un autre utilisateur,
+// contrairement au pid de la requête). Un serveur root prend l'identité de
+// ce propriétaire le temps de l'ouverture, sinon il doit s'agir du même
+// utilisateur que le serveur. Renvoit le descripteur ouvert, -1 en cas
+// d'échec (errno est positionné).
+static int open_output(const char *path, int fifo) {
+  struct stat s;
+  if (fstat(fifo, &s) == -1) {
+    return -1;
+  }
+  if (geteuid() != 0) {
+    if (s.st_uid != geteuid()) {
+      errno = EACCES;
+      return -1;
+    }
+    return open(path, O_WRONLY | O_CREAT, PERMS);
+  }
+  setfsgid(s.st_gid);
+  setfsuid(s.st_uid);
+  int fd = open(path, O_WRONLY | O_CREAT, PERMS);
+  int err = errno;
+  setfsuid(geteuid());
+  setfsgid(getegid());
+  errno = err;
+  return fd;
+}
+
+// write_image: écrit l'image filtrée de size octets pointée par data dans le
+// fichier fd_out, tronqué à cette taille. Les header_size premiers octets,
+// inchangés, sont copiés depuis le fichier d'origine fd_in par copy_file_range
+// (sans passer par l'espace utilisateur), les pixels par un seul pwrite.
+// Renvoit 0 en cas de succes, -1 sinon (errno est positionné).
+static int write_image(int fd_out, int fd_in, const void *data, size_t size,
+                       size_t header_size) {
+  struct stat s_in;
+  struct stat s_out;
+  if (fstat(fd_in, &s_in) == -1 || fstat(fd_out, &s_out) == -1 ||
+      ftruncate(fd_out, (off_t)size) == -1) {
+    MESSAGE_ERR_D("server worker", "ftruncate");
+    return -1;
+  }
+  if (header_size > size) {
+    header_size = size;
+  }
+
+  // HEADERS
+  // The output may be the input file itself: its headers are already there
+  size_t copied = 0;
+  if (s_in.st_dev == s_out.st_dev && s_in.st_ino == s_out.st_ino) {
+    copied = header_size;
+  }
+  while (copied < header_size) {
+    off_t in_off = (off_t)copied;
+    off_t out_off = (off_t)copied;
+    ssize_t n = copy_file_range(fd_in, &in_off, fd_out, &out_off,
+                                header_size - copied, 0);
+    if (n <= 0) {
+      break; // not supported here, written with the pixels
+    }
+    copied += (size_t)n;
+  }
+
+  // PIXELS
+  if (full_pwrite(fd_out, (const char *)data + copied, size - copied,
+                  (off_t)copied) != (ssize_t)(size - copied)) {
+    MESSAGE_ERR_D("server worker", "full_pwrite");
+    return -1;
+  }
+  return 0;
+}
+
+// write_output: écrit l'image filtrée (voir write_image) dans le fichier path,
+// au nom du propriétaire de la FIFO fifo. Renvoit 0 en cas de succes, -1
+// sinon (errno est positionné).
+static int write_output(const char *path, int fifo, int fd_in,
+                        const void *data, size_t size, size_t header_size) {
+  int fd_out = open_output(path, fifo);
+  if (fd_out == -1) {
+    MESSAGE_ERR_D("server worker", path);
+    return -1;
   }
-  int32_t base_lines = height / thread_count;
-  int32_t extra_lines = height % thread_count;
-  distribution[0] = 0;
-  for (int i = 0; i < thread_count; i++) {
-    int32_t lines_for_this_thread = base_lines + (i < extra_lines ? 1 : 0);
-    distribution[i + 1] = distribution[i] + lines_for_this_thread;
+  int ret = write_image(fd_out, fd_in, data, size, header_size);
+  int err = errno;
+  if (close(fd_out) == -1 && ret == 0) {
+    MESSAGE_ERR_D("server worker", "close");
+    return -1;
   }
-  return distribution;
+  errno = err;
+  return ret;
+}
+
+// write_cached: écrit dans le fichier fd_out, tronqué à size octets, le
+// résultat de size octets du fichier cache_fd du cache, par copy_file_range
+// (sans passer par l'espace utilisateur). Renvoit 0 en cas de succes, -1
+// sinon (errno est positionné).
+static int write_cached(int fd_out, int cache_fd, size_t size) {
+  if (ftruncate(fd_out, (off_t)size) == -1) {
+    return -1;
+  }
+  size_t copied = 0;
+  while (copied < size) {
+    off_t in_off = (off_t)copied;
+    off_t out_off = (off_t)copied;
+    ssize_t n = copy_file_range(cache_fd, &in_off, fd_out, &out_off,
+                                size - copied, 0);
+    if (n <= 0) {
+      break; // not supported here, written from a mapping
+    }
+    copied += (size_t)n;
+  }
+  if (copied == size) {
+    return 0;
+  }
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, cache_fd, 0);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  int ret = full_pwrite(fd_out, (const char *)data + copied, size - copied,
+                        (off_t)copied) == (ssize_t)(size - copied)
+                ? 0
+                : -1;
+  int err = errno;
+  munmap(data, size);
+  errno = err;
+  return ret;
+}
+
+// cache_result: garde dans le cache de résultats l'image filtrée de size
+// octets pointée par data, de clé key
+static void cache_result(const result_key_t *key, const void *data,
+                         size_t size) {
+  // ENOSPC: every entry is being filled, the next one may find room
+  if (result_cache_store(&g_cache, key, data, size) == -1 && errno != ENOSPC) {
+    MESSAGE_ERR_D("server worker", "result_cache_store");
+  }
+}
+
+// stream_wanted: renvoit true si l'image de size octets est envoyée pendant
+// son filtrage (stream_size de la configuration)
+static bool stream_wanted(off_t size) {
+  return g_config.stream_size > 0 &&
+         size >= (off_t)g_config.stream_size * 1024;
+}
+
+// Destination d'une image envoyée pendant son filtrage par la FIFO de réponse
+typedef struct {
+  int fifo;
+  bool status_sent;
+} fifo_sink_t;
+
+// send_status: écrit dans la FIFO de sink le statut de succès, s'il n'a pas
+// déjà été envoyé. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné).
+static int send_status(fifo_sink_t *sink) {
+  if (sink->status_sent) {
+    return 0;
+  }
+  int status = EXIT_SUCCESS;
+  if (full_write_until(sink->fifo, &status, sizeof(status), WRITE_TIMEOUT) !=
+      sizeof(status)) {
+    return -1;
+  }
+  sink->status_sent = true;
+  return 0;
+}
+
+// send_to_fifo: place par vmsplice les count octets de buf dans la FIFO du
+// fifo_sink_t pointé par ctx, après le statut de succès au premier envoi (voir
+// row_stream_send_t)
+static int send_to_fifo(void *ctx, const void *buf, size_t count,
+                        size_t offset) {
+  (void)offset;
+  fifo_sink_t *sink = (fifo_sink_t *)ctx;
+  if (send_status(sink) == -1) {
+    return -1;
+  }
+  return full_vmsplice(sink->fifo, buf, count, WRITE_TIMEOUT) == (ssize_t)count
+             ? 0
+             : -1;
+}
+
+// copy_to_fifo: comme send_to_fifo, mais copie les octets de buf dans la
+// FIFO : buf peut être réutilisé dès le retour
+static int copy_to_fifo(void *ctx, const void *buf, size_t count,
+                        size_t offset) {
+  (void)offset;
+  fifo_sink_t *sink = (fifo_sink_t *)ctx;
+  if (send_status(sink) == -1) {
+    return -1;
+  }
+  return full_write_until(sink->fifo, buf, count, WRITE_TIMEOUT) ==
+                 (ssize_t)count
+             ? 0
+             : -1;
+}
+
+// send_to_file: écrit les count octets de buf à la position offset du fichier
+// dont le descripteur est pointé par ctx (voir row_stream_send_t)
+static int send_to_file(void *ctx, const void *buf, size_t count,
+                        size_t offset) {
+  int fd_out = *(int *)ctx;
+  return full_pwrite(fd_out, buf, count, (off_t)offset) == (ssize_t)count
+             ? 0
+             : -1;
+}
+
+// stream_pipeline: applique le pipeline de filter_count filtres filters, avec
+// la politique de bord border, à l'image de size octets pointée par img et
+// l'envoie par send(ctx, ...) pendant son filtrage (voir row_stream.h).
+// Renvoit EXIT_SUCCESS ou un code errno.
+static int stream_pipeline(const filter_t *filters, int32_t filter_count,
+                           border_policy_t border, bmp_mapped_image_t *img,
+                           size_t size, row_stream_send_t send, void *ctx) {
+  row_stream_t stream;
+  int32_t row_size = ((img->dib_h->width * 3 + 3) / 4) * 4;
+  if (row_stream_start(&stream, img->file_h, size,
+                       img->file_h->pixel_array_offset, (size_t)row_size, send,
+                       ctx) == -1) {
+    MESSAGE_ERR_D("server worker", "row_stream_start");
+    return errno;
+  }
+  int ret = apply_pipeline(filters, filter_count, border, img, &stream);
+  if (row_stream_finish(&stream, ret == EXIT_SUCCESS) == -1 &&
+      ret == EXIT_SUCCESS) {
+    MESSAGE_ERR_D("server worker", "row_stream_finish");
+    ret = errno;
+  }
+  return ret;
+}
+
+// beyond_budget: renvoit true si l'image de size octets dépasse le budget
+// mémoire d'un worker et doit être traitée par fenêtres
+static bool beyond_budget(off_t size) {
+  return size > (off_t)g_config.memory_budget << 20;
+}
+
+// serve_by_windows: traite par fenêtres la requête rq sur l'image de size
+// octets du fichier fd, dont le résultat est écrit au fur et à mesure dans la
+// FIFO de réponse fifo, le fichier de sortie ou la mémoire partagée du
+// client. status_sent indique si le statut de succès a été écrit dans la FIFO.
+// Renvoit EXIT_SUCCESS ou un code errno.
+static int serve_by_windows(const filter_request_t *rq, int fifo, int fd,
+                            off_t size, bool *status_sent) {
+  if (rq->response == RESPONSE_FIFO) {
+    fifo_sink_t sink = {.fifo = fifo, .status_sent = false};
+    int ret = filter_by_windows(rq->filters, rq->filter_count, rq->border, fd,
+                                size, copy_to_fifo, &sink);
+    *status_sent = sink.status_sent;
+    return ret;
+  }
+  int fd_out = rq->response == RESPONSE_SHM ? open_response_shm(rq->pid, size)
+                                            : open_output(rq->output, fifo);
+  if (fd_out == -1) {
+    MESSAGE_ERR_D("server worker", "open");
+    return errno;
+  }
+  int ret = EXIT_SUCCESS;
+  if (rq->response == RESPONSE_FILE && ftruncate(fd_out, size) == -1) {
+    MESSAGE_ERR_D("server worker", "ftruncate");
+    ret = errno;
+  } else {
+    ret = filter_by_windows(rq->filters, rq->filter_count, rq->border, fd,
+                            size, send_to_file, &fd_out);
+  }
+  if (close(fd_out) == -1 && ret == EXIT_SUCCESS) {
+    MESSAGE_ERR_D("server worker", "close");
+    ret = errno;
+  }
+  return ret;
 }
 
 void start_worker(filter_request_t *rq) {
@@ -469,9 +986,17 @@ void start_worker(filter_request_t *rq) {
   char fifo_path[255];
   fifo_path[0] = '\0';
   int fifo = -1;
+  bool status_sent = false;
   int fd = -1;
-  void *mapped_data = MAP_FAILED;
+  int fd_out = -1;
+  int shm = -1;
+  void *mapped_data = nullptr;
+  image_buffer_t image = IMAGE_BUFFER_INITIALIZER;
   bmp_mapped_image_t img;
+  result_key_t key;
+  bool hit = false;
+  bool store = false;
+  bool streamed = false;
 
   //---- [OPEN FIFO RESPONS ] ------------------------------------------------//
   snprintf(fifo_path, sizeof(fifo_path), "%s%d", FIFO_RESPONSE_BASE_PATH,
@@ -481,6 +1006,14 @@ void start_worker(filter_request_t *rq) {
     ret = errno;
     goto dispose;
   }
+  // Timeouts are handled by polling, re-armed on each progress
+  if (fcntl(fifo, F_SETFL, O_NONBLOCK) == -1) {
+    MESSAGE_ERR_D("server worker", "fcntl");
+    ret = errno;
+    goto dispose;
+  }
+  // Best effort: a bigger pipe takes the image in fewer, larger vmsplice
+  fcntl(fifo, F_SETPIPE_SZ, RESPONSE_PIPE_SIZE);
 
   //---- [CHECK IMAGE SIZE  ] ------------------------------------------------//
   if (lstat(rq->path, &s) != 0) {
@@ -488,10 +1021,6 @@ void start_worker(filter_request_t *rq) {
     ret = errno;
     goto dispose;
   }
-  if (s.st_size > MAX_SIZE_FILE) {
-    ret = EFBIG;
-    goto dispose;
-  }
 
   //---- [OPEN IMAGE FILE   ] ------------------------------------------------//
   fd = open(rq->path, O_RDONLY);
@@ -500,75 +1029,167 @@ void start_worker(filter_request_t *rq) {
     ret = errno;
     goto dispose;
   }
-  mapped_data = mmap(nullptr, (size_t)s.st_size, PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE, fd, 0);
-  if (mapped_data == MAP_FAILED) {
-    MESSAGE_ERR_D("server worker", "mmap");
+  // The file actually opened, not a symlink to it: its identity and size
+  if (fstat(fd, &s) == -1) {
+    MESSAGE_ERR_D("server worker", "fstat");
     ret = errno;
     goto dispose;
   }
-  img.file_h = (bmp_file_header_t *)mapped_data;
 
-  //---- [CHECK TYPE VALIDITY] -----------------------------------------------//
-  if (img.file_h->signature != BMP_SIGNATURE) {
-    ret = EINVAL;
+  //---- [OUT OF CORE       ] ------------------------------------------------//
+  // Larger than the memory budget: neither mapped nor cached
+  if (beyond_budget(s.st_size)) {
+    ret = serve_by_windows(rq, fifo, fd, s.st_size, &status_sent);
     goto dispose;
   }
+  // The client may write its shared memory at any time: the image is only
+  // read, filtered and hashed in a private buffer, then copied there
+  if (rq->response == RESPONSE_SHM &&
+      (shm = open_response_shm(rq->pid, s.st_size)) == -1) {
+    ret = errno;
+    goto dispose;
+  }
+  if (image_buffer_load(&image, fd, (size_t)s.st_size) == -1) {
+    MESSAGE_ERR_D("server worker", "image_buffer_load");
+    ret = errno;
+    goto dispose;
+  }
+  mapped_data = image.data;
+  img.file_h = (bmp_file_header_t *)mapped_data;
+
+  //---- [CHECK TYPE VALIDITY] -----------------------------------------------//
+  // Rows beyond the buffer would be read and written by the filters
   img.dib_h =
       (bmp_dib_header_t *)((char *)mapped_data + sizeof(bmp_file_header_t));
+  if (!bmp_headers_valid(img.file_h, img.dib_h, (size_t)s.st_size)) {
+    errno = EINVAL;
+    MESSAGE_ERR_D("server worker", "Invalid BMP headers");
+    ret = errno;
+    goto dispose;
+  }
   img.pixels = (u_int8_t *)mapped_data + img.file_h->pixel_array_offset;
 
-  if ((ret = apply_filter(rq->filter, &img)) != EXIT_SUCCESS) {
+  //---- [RESULT CACHE      ] ------------------------------------------------//
+  if (result_cache_enabled(&g_cache)) {
+    result_key_init(&g_cache, &key, mapped_data, (size_t)s.st_size, &s,
+                    rq->filters, rq->filter_count, rq->border);
+    int cache_fd = result_cache_open(&g_cache, &key);
+    hit = cache_fd != -1;
+    store = !hit;
+    if (hit) {
+      MESSAGE_INFO_D("server worker", "Result cache hit");
+      // The filtered image replaces the one just read, in pages already there
+      ssize_t n_c = full_read(cache_fd, mapped_data, (size_t)s.st_size);
+      if (n_c != s.st_size) {
+        ret = n_c >= 0 ? EIO : errno;
+      }
+      close(cache_fd);
+      if (ret != EXIT_SUCCESS) {
+        MESSAGE_ERR_D("server worker", "Result cache read");
+        goto dispose;
+      }
+    }
+  }
+
+  //---- [FILTER IMAGE      ] ------------------------------------------------//
+  // A large image goes out while its last rows are still being filtered. The
+  // client of a shared memory reads nothing before the status.
+  streamed = !hit && rq->response != RESPONSE_SHM && stream_wanted(s.st_size);
+  if (streamed && rq->response == RESPONSE_FIFO) {
+    fifo_sink_t sink = {.fifo = fifo, .status_sent = false};
+    ret = stream_pipeline(rq->filters, rq->filter_count, rq->border, &img,
+                          (size_t)s.st_size, send_to_fifo, &sink);
+    status_sent = sink.status_sent;
+  } else if (streamed) {
+    fd_out = open_output(rq->output, fifo);
+    if (fd_out == -1 || ftruncate(fd_out, s.st_size) == -1) {
+      MESSAGE_ERR_D("server worker", rq->output);
+      ret = errno;
+      goto dispose;
+    }
+    ret = stream_pipeline(rq->filters, rq->filter_count, rq->border, &img,
+                          (size_t)s.st_size, send_to_file, &fd_out);
+    if (close(fd_out) == -1 && ret == EXIT_SUCCESS) {
+      MESSAGE_ERR_D("server worker", "close");
+      ret = errno;
+    }
+    fd_out = -1;
+  } else if (!hit) {
+    ret = apply_pipeline(rq->filters, rq->filter_count, rq->border, &img,
+                         nullptr);
+  }
+  if (ret != EXIT_SUCCESS) {
+    goto dispose;
+  }
+
+  //---- [WRITE SHARED MEM  ] ------------------------------------------------//
+  if (shm != -1 &&
+      full_pwrite(shm, mapped_data, (size_t)s.st_size, 0) != s.st_size) {
+    MESSAGE_ERR_D("server worker", "full_pwrite");
+    ret = errno;
+    goto dispose;
+  }
+
+  //---- [WRITE OUTPUT FILE ] ------------------------------------------------//
+  if (rq->response == RESPONSE_FILE && !streamed &&
+      write_output(rq->output, fifo, fd, mapped_data, (size_t)s.st_size,
+                   img.file_h->pixel_array_offset) == -1) {
+    ret = errno;
     goto dispose;
   }
 
   //---- [SEND IMAGE BACK   ] ------------------------------------------------//
 
-  set_write_timeout(WRITE_TIMEOUT);
-  if (full_write(fifo, &ret, sizeof(ret)) == -1) {
-    MESSAGE_ERR_D("server worker", "full_write");
+  // A streamed image is already behind its status in the FIFO
+  if (!status_sent &&
+      full_write_until(fifo, &ret, sizeof(ret), WRITE_TIMEOUT) != sizeof(ret)) {
+    MESSAGE_ERR_D("server worker", "full_write_until");
     ret = errno;
     goto dispose;
   }
-  alarm(0);
+  status_sent = true;
 
-  size_t count = (size_t)s.st_size;
-  const char *ptr = (const char *)mapped_data;
-  while (count > 0) {
-    size_t n_w = count;
-    if (n_w > PIPE_BUF) {
-      n_w = PIPE_BUF;
-    }
-    set_write_timeout(WRITE_TIMEOUT);
-    if (full_write(fifo, ptr, n_w) == -1) {
-      MESSAGE_ERR_D("server worker", "full_write");
-      ret = errno;
-      goto dispose;
-    }
-    alarm(0);
-    ptr += n_w;
-    count -= n_w;
+  // The image is already in the client's shared memory or output file
+  // The pages stay referenced by the pipe after munmap until the client reads
+  // them, and are no longer modified (the cache only reads them)
+  size_t count =
+      rq->response == RESPONSE_FIFO && !streamed ? (size_t)s.st_size : 0;
+  if (full_vmsplice(fifo, mapped_data, count, WRITE_TIMEOUT) !=
+      (ssize_t)count) {
+    MESSAGE_ERR_D("server worker", "full_vmsplice");
+    ret = errno;
+    goto dispose;
+  }
+
+  //---- [STORE RESULT      ] ------------------------------------------------//
+  // Once the client has it, from the private buffer
+  if (store) {
+    cache_result(&key, mapped_data, (size_t)s.st_size);
   }
 
 dispose:
-  alarm(0);
+  if (fd_out != -1) {
+    close(fd_out);
+  }
   if (fd != -1 && close(fd) == -1) {
     MESSAGE_ERR_D("server worker", "close");
     ret = EXIT_FAILURE;
   }
-  if (mapped_data != MAP_FAILED) {
-    if (munmap(mapped_data, (size_t)s.st_size) == -1) {
-      MESSAGE_ERR_D("server worker", "munmap");
-      ret = EXIT_FAILURE;
-    }
+  if (shm != -1) {
+    close(shm);
+  }
+  if (image_buffer_release(&image) == -1) {
+    MESSAGE_ERR_D("server worker", "image_buffer_release");
+    ret = EXIT_FAILURE;
   }
-  set_write_timeout(WRITE_TIMEOUT);
-  if (fifo != -1) {
-    if (full_write(fifo, &ret, sizeof(ret)) == -1) {
-      MESSAGE_ERR_D("server worker", "full_write");
+  // The client only reads one status, a failure while sending the image shows
+  // as a truncated image
+  if (fifo != -1 && !status_sent) {
+    if (full_write_until(fifo, &ret, sizeof(ret), WRITE_TIMEOUT) !=
+        sizeof(ret)) {
+      MESSAGE_ERR_D("server worker", "full_write_until");
     }
   }
-  alarm(0);
   if (fifo != -1 && close(fifo) == -1) {
     MESSAGE_ERR_D("server worker", "close");
     ret = EXIT_FAILURE;
@@ -576,99 +1197,315 @@ dispose:
   return;
 }
 
-int apply_filter(filter_t filter, bmp_mapped_image_t *img) {
+// serve_socket_job: applique le pipeline de la requête de job à l'image du
+// fichier fd_in, écrit le résultat dans le fichier fd_out puis envoie le
+// statut sur la connexion de job et ferme ses descripteurs
+static void serve_socket_job(job_t *job) {
   int ret = EXIT_SUCCESS;
-  int thread_count = calculate_thread_count(img->file_h->file_size);
-  bool is_complex = false;
+  struct stat s;
+  image_buffer_t image = IMAGE_BUFFER_INITIALIZER;
+  void *mapped_data = nullptr;
+  bmp_mapped_image_t img;
+  result_key_t key;
+  bool store = false;
 
-  pthread_t threads[ABSOLUTE_MAX_THREADS];
-  thread_filter_args_t args[ABSOLUTE_MAX_THREADS];
-  int32_t height =
-      img->dib_h->height > 0 ? img->dib_h->height : -img->dib_h->height;
-  int32_t *line_distribution =
-      calculate_line_distribution(height, thread_count);
-  if (line_distribution == nullptr) {
-    MESSAGE_ERR_D("apply_filter", "distribution");
-    return errno;
+  //---- [CHECK IMAGE SIZE  ] ------------------------------------------------//
+  if (fstat(job->fd_in, &s) == -1) {
+    MESSAGE_ERR_D("server worker", "fstat");
+    ret = errno;
+    goto dispose;
+  }
+  off_t headers_size =
+      (off_t)(sizeof(bmp_file_header_t) + sizeof(bmp_dib_header_t));
+  if (!S_ISREG(s.st_mode) || s.st_size < headers_size) {
+    ret = EINVAL;
+    goto dispose;
+  }
+
+  //---- [OUT OF CORE       ] ------------------------------------------------//
+  // Larger than the memory budget: neither mapped nor cached
+  if (beyond_budget(s.st_size)) {
+    if (ftruncate(job->fd_out, s.st_size) == -1) {
+      MESSAGE_ERR_D("server worker", "ftruncate");
+      ret = errno;
+      goto dispose;
+    }
+    ret = filter_by_windows(job->rq.filters, job->rq.filter_count,
+                            job->rq.border, job->fd_in, s.st_size,
+                            send_to_file, &job->fd_out);
+    goto dispose;
   }
 
-  //---- [SELECT FILTER     ] ------------------------------------------------//
-  void *(*filter_func)(void *) = NULL;
+  //---- [LOAD IMAGE FILE   ] ------------------------------------------------//
+  if (image_buffer_load(&image, job->fd_in, (size_t)s.st_size) == -1) {
+    MESSAGE_ERR_D("server worker", "image_buffer_load");
+    ret = errno;
+    goto dispose;
+  }
+  mapped_data = image.data;
+  img.file_h = (bmp_file_header_t *)mapped_data;
+
+  //---- [CHECK TYPE VALIDITY] -----------------------------------------------//
+  // Rows beyond the buffer would be read and written by the filters
+  img.dib_h =
+      (bmp_dib_header_t *)((char *)mapped_data + sizeof(bmp_file_header_t));
+  if (!bmp_headers_valid(img.file_h, img.dib_h, (size_t)s.st_size)) {
+    errno = EINVAL;
+    MESSAGE_ERR_D("server worker", "Invalid BMP headers");
+    ret = errno;
+    goto dispose;
+  }
+  img.pixels = (u_int8_t *)mapped_data + img.file_h->pixel_array_offset;
+
+  //---- [RESULT CACHE      ] ------------------------------------------------//
+  if (result_cache_enabled(&g_cache)) {
+    result_key_init(&g_cache, &key, mapped_data, (size_t)s.st_size, &s,
+                    job->rq.filters, job->rq.filter_count, job->rq.border);
+    int cache_fd = result_cache_open(&g_cache, &key);
+    if (cache_fd != -1) {
+      MESSAGE_INFO_D("server worker", "Result cache hit");
+      if (write_cached(job->fd_out, cache_fd, (size_t)s.st_size) == -1) {
+        MESSAGE_ERR_D("server worker", "write_cached");
+        ret = errno;
+      }
+      close(cache_fd);
+      goto dispose;
+    }
+    store = true;
+  }
+
+  //---- [FILTER IMAGE      ] ------------------------------------------------//
+  // A large image is written while its last rows are still being filtered
+  if (stream_wanted(s.st_size)) {
+    if (ftruncate(job->fd_out, s.st_size) == -1) {
+      MESSAGE_ERR_D("server worker", "ftruncate");
+      ret = errno;
+      goto dispose;
+    }
+    ret = stream_pipeline(job->rq.filters, job->rq.filter_count,
+                          job->rq.border, &img, (size_t)s.st_size,
+                          send_to_file, &job->fd_out);
+    goto dispose;
+  }
+  if ((ret = apply_pipeline(job->rq.filters, job->rq.filter_count,
+                            job->rq.border, &img, nullptr)) != EXIT_SUCCESS) {
+    goto dispose;
+  }
+
+  //---- [WRITE OUTPUT FILE ] ------------------------------------------------//
+  if (write_image(job->fd_out, job->fd_in, mapped_data, (size_t)s.st_size,
+                  img.file_h->pixel_array_offset) == -1) {
+    ret = errno;
+  }
+
+dispose:
+  if (socket_server_reply(job, ret, WRITE_TIMEOUT) == -1) {
+    MESSAGE_ERR_D("server worker", "socket_server_reply");
+  }
+  // Once the client has it
+  if (store && ret == EXIT_SUCCESS) {
+    cache_result(&key, mapped_data, (size_t)s.st_size);
+  }
+  if (image_buffer_release(&image) == -1) {
+    MESSAGE_ERR_D("server worker", "image_buffer_release");
+  }
+}
+
+// select_filter: écrit dans func la fonction du filtre filter et dans
+// is_complex si c'est une convolution. Renvoit 0 en cas de succes, -1 si le
+// filtre est inconnu.
+static int select_filter(filter_t filter, filter_func_t *func,
+                         bool *is_complex) {
+  *is_complex = false;
   // SIMPLE OPTIONS
   switch (filter) {
 #define OPT_TO_REQUEST_SIMPLE_FILTER(filter_name, short_flag, long_flag,       \
                                      description, filter_func_ptr)             \
   case filter_name:                                                            \
-    filter_func = filter_func_ptr;                                             \
-    break;
+    *func = filter_func_ptr;                                                   \
+    return 0;
 #ifdef OPT_TO_REQUEST_SIMPLE_FILTERS
     OPT_TO_REQUEST_SIMPLE_FILTERS
 #endif
 #undef OPT_TO_REQUEST_SIMPLE_FILTER
   default:
-    // COMPLEX OPTIONS
-    is_complex = true;
-    switch (filter) {
+    break;
+  }
+  // COMPLEX OPTIONS
+  *is_complex = true;
+  switch (filter) {
 #define OPT_TO_REQUEST_COMPLEX_FILTER(filter_name, short_flag, long_flag,      \
                                       description, filter_func_ptr)            \
   case filter_name:                                                            \
-    filter_func = filter_func_ptr;                                             \
-    break;
+    *func = filter_func_ptr;                                                   \
+    return 0;
 #ifdef OPT_TO_REQUEST_COMPLEX_FILTERS
-      OPT_TO_REQUEST_COMPLEX_FILTERS
+    OPT_TO_REQUEST_COMPLEX_FILTERS
 #endif
 #undef OPT_TO_REQUEST_COMPLEX_FILTER
-    default:
+  default:
+    return -1;
+  }
+}
+
+// apply_stage: applique, tuile par tuile, les filter_count fonctions de filtre
+// de funcs à l'image pointé par img de hauteur height. Seule la première peut
+// être une convolution (is_complex), elle lit alors les lignes voisines
+// d'origine de chaque tuile dans les halos. Si stream n'est pas nullptr, les
+// tuiles sont filtrées dans l'ordre des lignes et signalées au flux une fois
+// terminées. Renvoit EXIT_SUCCESS ou un code errno.
+static int apply_stage(const filter_func_t *funcs, int32_t filter_count,
+                       bool is_complex, border_policy_t border,
+                       bmp_mapped_image_t *img, int32_t height,
+                       int thread_count, row_stream_t *stream) {
+  int ret = EXIT_SUCCESS;
+  bmp_halo_t halo = {.boundaries = nullptr};
+  int32_t tile_rows = tile_scheduler_tile_rows(
+      img, height, thread_count, is_complex ? 2 * BMP_MAX_HALO : 1);
+
+  //---- [HALOS             ] ------------------------------------------------//
+  // Complex filters run in place: only the rows around the boundaries between
+  // tiles of different threads are copied, each thread keeps its last few
+  // overwritten rows in a rolling buffer.
+  if (is_complex &&
+      bmp_halo_init(&halo, img, height, tile_rows, BMP_MAX_HALO) == -1) {
+    MESSAGE_ERR_D("apply_stage", "malloc");
+    ret = errno;
+    goto dispose;
+  }
+
+  //---- [TILE SCHEDULER    ] ------------------------------------------------//
+  thread_filter_args_t args = {
+      .img = img,
+      .halo = is_complex ? &halo : nullptr,
+      .border = border,
+      .carry = nullptr};
+  tile_stats_t stats;
+  if (stream != nullptr) {
+    tile_scheduler_run_ordered(&g_pool, funcs, filter_count, &args, height,
+                               tile_rows, thread_count, stream, &stats);
+  } else {
+    tile_scheduler_run(&g_pool, funcs, filter_count, &args, height, tile_rows,
+                       thread_count, &stats);
+  }
+  if (stats.failed_count > 0) {
+    errno = ENOMEM;
+    MESSAGE_ERR_D("apply_stage", "filter");
+    ret = errno;
+    goto dispose;
+  }
+
+  char msg[512];
+  int32_t boundaries = 0;
+  for (int32_t k = 0; is_complex && k <= halo.band_count; k++) {
+    boundaries += halo.boundaries[k] != nullptr ? 1 : 0;
+  }
+  int len = snprintf(msg, sizeof(msg),
+                     "%d filters, %d tiles of %d lines, %d steals, "
+                     "%d halo boundaries, busy ms:",
+                     filter_count, stats.tile_count, stats.tile_rows,
+                     stats.steal_count, boundaries);
+  for (int i = 0; i < stats.thread_count && len < (int)sizeof(msg); i++) {
+    len += snprintf(msg + len, sizeof(msg) - (size_t)len, " %.2f",
+                    stats.busy_ms[i]);
+  }
+  MESSAGE_INFO_D("apply_stage", msg);
+
+dispose:
+  bmp_halo_dispose(&halo);
+  return ret;
+}
+
+int apply_pipeline(const filter_t *filters, int32_t filter_count,
+                   border_policy_t border, bmp_mapped_image_t *img,
+                   row_stream_t *stream) {
+  int thread_count = calculate_thread_count(img->file_h->file_size);
+  filter_func_t funcs[REQUEST_MAX_FILTERS];
+  bool is_complex[REQUEST_MAX_FILTERS];
+
+  int32_t height =
+      img->dib_h->height > 0 ? img->dib_h->height : -img->dib_h->height;
+
+  //---- [SELECT FILTERS    ] ------------------------------------------------//
+  if (border < 0 || border >= BORDER_POLICY_COUNT) {
+    errno = EINVAL;
+    MESSAGE_ERR_D("server worker", "Unsuported border policy");
+    return errno;
+  }
+  if (filter_count < 1 || filter_count > REQUEST_MAX_FILTERS) {
+    errno = EINVAL;
+    MESSAGE_ERR_D("server worker", "Invalid filter count");
+    return errno;
+  }
+  for (int32_t i = 0; i < filter_count; i++) {
+    if (select_filter(filters[i], &funcs[i], &is_complex[i]) == -1) {
       errno = EINVAL;
       MESSAGE_ERR_D("server worker", "Unsuported filter");
-      ret = errno;
-      goto dispose;
-    }
-  }
-  bmp_mapped_image_t img_ref;
-  if (is_complex) {
-    size_t image_size = img->file_h->file_size;
-    void *ref_data = malloc(image_size);
-    if (ref_data == NULL) {
-      MESSAGE_ERR_D("apply_filter", "malloc");
-      ret = errno;
-      goto dispose;
+      return errno;
     }
-    memcpy(ref_data, img->file_h, image_size);
-
-    img_ref.file_h = (bmp_file_header_t *)ref_data;
-    img_ref.dib_h =
-        (bmp_dib_header_t *)((char *)ref_data + sizeof(bmp_file_header_t));
-    img_ref.pixels = (uint8_t *)ref_data + img->file_h->pixel_array_offset;
   }
 
-  //---- [THREAD            ] ------------------------------------------------//
-  for (int i = 0; i < thread_count; i++) {
-    args[i].img = img;
-    args[i].start_line = line_distribution[i];
-    args[i].end_line = line_distribution[i + 1];
-    if (is_complex) {
-      args[i].ref_img = &img_ref;
+  //---- [STAGES            ] ------------------------------------------------//
+  // A convolution reads the neighbours of each tile as they were before it:
+  // every tile must be done with the previous filters first. The point
+  // filters following a convolution only read the pixels they write and run
+  // on each tile right after it, while the tile is still in cache.
+  // Only the rows of the last stage are final: it alone feeds the stream.
+  for (int32_t first = 0; first < filter_count;) {
+    int32_t last = first + 1;
+    while (last < filter_count && !is_complex[last]) {
+      last++;
     }
-    if (pthread_create(&threads[i], NULL, filter_func, &args[i]) != 0) {
-      MESSAGE_ERR_D("apply_filter", "pthread_create");
-      for (int j = 0; j < i; j++) {
-        pthread_join(threads[j], NULL);
-      }
-      ret = EXIT_FAILURE;
-      goto dispose;
+    int ret = apply_stage(funcs + first, last - first, is_complex[first],
+                          border, img, height, thread_count,
+                          last == filter_count ? stream : nullptr);
+    if (ret != EXIT_SUCCESS) {
+      return ret;
     }
+    first = last;
   }
+  return EXIT_SUCCESS;
+}
+
+// Pipeline appliqué à chaque fenêtre par filter_by_windows
+typedef struct {
+  const filter_t *filters;
+  int32_t filter_count;
+  border_policy_t border;
+} window_pipeline_t;
 
-  //---- [WAIT              ] ------------------------------------------------//
-  for (int i = 0; i < thread_count; i++) {
-    pthread_join(threads[i], nullptr);
+// filter_window: applique le pipeline window_pipeline_t pointé par ctx à la
+// fenêtre img (voir out_of_core_filter_t)
+static int filter_window(void *ctx, bmp_mapped_image_t *img) {
+  const window_pipeline_t *p = (const window_pipeline_t *)ctx;
+  return apply_pipeline(p->filters, p->filter_count, p->border, img, nullptr);
+}
+
+static int filter_by_windows(const filter_t *filters, int32_t filter_count,
+                             border_policy_t border, int fd, off_t size,
+                             row_stream_send_t send, void *ctx) {
+  // MARGIN
+  // Each convolution spoils at most BMP_MAX_HALO more rows from the edges
+  int32_t margin = 0;
+  for (int32_t i = 0; i < filter_count && i < REQUEST_MAX_FILTERS; i++) {
+    filter_func_t func;
+    bool is_complex;
+    if (select_filter(filters[i], &func, &is_complex) == -1) {
+      errno = EINVAL;
+      MESSAGE_ERR_D("server worker", "Unsuported filter");
+      return errno;
+    }
+    margin += is_complex ? BMP_MAX_HALO : 0;
   }
 
-dispose:
-  if (is_complex) {
-    free(img_ref.file_h);
+  window_pipeline_t pipeline = {
+      .filters = filters, .filter_count = filter_count, .border = border};
+  int ret = out_of_core_run(fd, size, margin, border == BORDER_WRAP,
+                            (size_t)g_config.memory_budget << 20,
+                            filter_window, &pipeline, send, ctx);
+  if (ret != EXIT_SUCCESS) {
+    errno = ret;
+    MESSAGE_ERR_D("server worker", "out_of_core_run");
   }
-  free(line_distribution);
   return ret;
-}
\ No newline at end of file
+}
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE // posix_fadvise
+
+#include "out_of_core.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "full_io.h"
+
+// Description de l'image d'entrée
+typedef struct {
+  int fd;
+  off_t pixels; // position de la première ligne
+  size_t row_size;
+  int32_t height;
+} source_image_t;
+
+// read_rows: lit dans dst count lignes de src à partir de la ligne first,
+// ramenée modulo la hauteur de l'image (marge prise au bord opposé). Renvoit
+// 0 en cas de succes, -1 sinon (errno est positionné).
+static int read_rows(const source_image_t *src, int64_t first, int32_t count,
+                     uint8_t *dst) {
+  while (count > 0) {
+    int64_t row = ((first % src->height) + src->height) % src->height;
+    int32_t run = count;
+    if (row + run > src->height) {
+      run = (int32_t)(src->height - row);
+    }
+    size_t bytes = (size_t)run * src->row_size;
+    off_t offset = src->pixels + (off_t)row * (off_t)src->row_size;
+    ssize_t n = full_pread(src->fd, dst, bytes, offset);
+    if (n != (ssize_t)bytes) {
+      if (n >= 0) {
+        errno = EIO; // image truncated since fstat
+      }
+      return -1;
+    }
+    dst += bytes;
+    first += run;
+    count -= run;
+  }
+  return 0;
+}
+
+// prefetch: demande au noyau de lire à l'avance les lignes [first, end) de src
+static void prefetch(const source_image_t *src, int32_t first, int32_t end) {
+  if (first < end) {
+    posix_fadvise(src->fd, src->pixels + (off_t)first * (off_t)src->row_size,
+                  (off_t)(end - first) * (off_t)src->row_size,
+                  POSIX_FADV_WILLNEED);
+  }
+}
+
+int out_of_core_run(int fd, off_t size, int32_t margin, bool wrap,
+                    size_t budget, out_of_core_filter_t filter,
+                    void *filter_ctx, row_stream_send_t send, void *send_ctx) {
+  int ret = EXIT_SUCCESS;
+  uint8_t *header = nullptr;
+  uint8_t *window = nullptr;
+  uint8_t *saved = nullptr;
+  uint8_t *head = nullptr;
+
+  //---- [HEADERS           ] ------------------------------------------------//
+  bmp_file_header_t file_h;
+  bmp_dib_header_t dib_h;
+  if (size < (off_t)(sizeof(file_h) + sizeof(dib_h)) ||
+      full_pread(fd, &file_h, sizeof(file_h), 0) != (ssize_t)sizeof(file_h) ||
+      full_pread(fd, &dib_h, sizeof(dib_h), (off_t)sizeof(file_h)) !=
+          (ssize_t)sizeof(dib_h) ||
+      !bmp_headers_valid(&file_h, &dib_h, (size_t)size)) {
+    return EINVAL;
+  }
+  source_image_t src = {
+      .fd = fd,
+      .pixels = file_h.pixel_array_offset,
+      .row_size = (((size_t)dib_h.width * 3 + 3) / 4) * 4,
+      .height = dib_h.height > 0 ? dib_h.height : -dib_h.height};
+
+  //---- [WINDOW SIZE       ] ------------------------------------------------//
+  // The window keeps the headers: each one is filtered as a whole image
+  size_t pixels = (size_t)src.pixels;
+  if (budget <= pixels ||
+      (budget - pixels) / src.row_size <= 2 * (size_t)margin) {
+    return EFBIG;
+  }
+  size_t fit_rows = (budget - pixels) / src.row_size;
+  if (fit_rows > (size_t)src.height + 2 * (size_t)margin) {
+    fit_rows = (size_t)src.height + 2 * (size_t)margin;
+  }
+  int32_t window_rows = (int32_t)fit_rows;
+  int32_t core_rows = window_rows - 2 * margin;
+
+  // The output may be the input file itself: the rows read again once
+  // written, the end of the previous window and the first rows (wrap), are
+  // kept from before
+  size_t margin_size = (size_t)margin * src.row_size;
+  header = malloc(pixels);
+  window = malloc(pixels + (size_t)window_rows * src.row_size);
+  saved = malloc(margin_size + 1);
+  head = malloc(margin_size + 1);
+  if (header == nullptr || window == nullptr || saved == nullptr ||
+      head == nullptr) {
+    ret = errno;
+    goto dispose;
+  }
+  if (full_pread(fd, header, pixels, 0) != (ssize_t)pixels ||
+      (wrap && read_rows(&src, 0, margin, head) == -1)) {
+    ret = EIO;
+    goto dispose;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  //---- [WINDOWS           ] ------------------------------------------------//
+  bmp_mapped_image_t img = {
+      .file_h = (bmp_file_header_t *)window,
+      .dib_h = (bmp_dib_header_t *)(window + sizeof(bmp_file_header_t)),
+      .pixels = window + pixels};
+  int32_t saved_rows = 0;
+  for (int32_t first = 0; first < src.height; first += core_rows) {
+    int32_t end = first + core_rows < src.height ? first + core_rows
+                                                 : src.height;
+    // Without wrap, the window stops at the edges of the image
+    int32_t top = wrap || first >= margin ? margin : first;
+    int32_t bottom = wrap || src.height - end >= margin ? margin
+                                                       : src.height - end;
+    int32_t rows = top + (end - first) + bottom;
+    // The next window is read by the kernel while this one is filtered
+    prefetch(&src, end, end + core_rows < src.height ? end + core_rows
+                                                     : src.height);
+
+    memcpy(window, header, pixels);
+    img.dib_h->height = rows;
+    img.file_h->file_size = (uint32_t)(pixels + (size_t)rows * src.row_size);
+    uint8_t *dst = img.pixels;
+    // TOP MARGIN
+    if (first == 0) {
+      if (read_rows(&src, -(int64_t)top, top, dst) == -1) {
+        ret = errno;
+        goto dispose;
+      }
+    } else {
+      memcpy(dst, saved + (size_t)(saved_rows - top) * src.row_size,
+             (size_t)top * src.row_size);
+    }
+    dst += (size_t)top * src.row_size;
+    // ROWS AND BOTTOM MARGIN
+    int32_t in_image = end + bottom <= src.height ? end + bottom : src.height;
+    if (read_rows(&src, first, in_image - first, dst) == -1) {
+      ret = errno;
+      goto dispose;
+    }
+    dst += (size_t)(in_image - first) * src.row_size;
+    memcpy(dst, head, (size_t)(end + bottom - in_image) * src.row_size);
+    // Kept for the top margin of the next window
+    saved_rows = top + (end - first) < margin ? top + (end - first) : margin;
+    memcpy(saved,
+           (uint8_t *)img.pixels +
+               (size_t)(top + (end - first) - saved_rows) * src.row_size,
+           (size_t)saved_rows * src.row_size);
+
+    if ((ret = filter(filter_ctx, &img)) != EXIT_SUCCESS) {
+      goto dispose;
+    }
+
+    // SEND
+    // The headers go out with the first rows: nothing is sent on failure
+    if (first == 0 && send(send_ctx, header, pixels, 0) == -1) {
+      ret = errno;
+      goto dispose;
+    }
+    size_t offset = pixels + (size_t)first * src.row_size;
+    if (send(send_ctx, (uint8_t *)img.pixels + (size_t)top * src.row_size,
+             (size_t)(end - first) * src.row_size, offset) == -1) {
+      ret = errno;
+      goto dispose;
+    }
+  }
+
+  //---- [TRAILING BYTES    ] ------------------------------------------------//
+  // Whatever follows the pixels is sent unchanged
+  size_t window_size = pixels + (size_t)window_rows * src.row_size;
+  for (off_t offset = src.pixels + (off_t)src.height * (off_t)src.row_size;
+       offset < size;) {
+    size_t count = (size_t)(size - offset) < window_size
+                       ? (size_t)(size - offset)
+                       : window_size;
+    if (full_pread(fd, window, count, offset) != (ssize_t)count) {
+      ret = EIO;
+      goto dispose;
+    }
+    if (send(send_ctx, window, count, (size_t)offset) == -1) {
+      ret = errno;
+      goto dispose;
+    }
+    offset += (off_t)count;
+  }
+
+dispose:
+  free(header);
+  free(window);
+  free(saved);
+  free(head);
+  return ret;
+}
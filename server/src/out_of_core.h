@@ -0,0 +1,41 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "bmp.h"
+#include "row_stream.h"
+
+// TRAITEMENT PAR FENÊTRES
+// Une image plus grande que le budget mémoire d'un worker n'est ni projetée ni
+// copiée en entier : elle est lue par fenêtres de lignes consécutives. Chaque
+// fenêtre est filtrée comme une image complète (en-têtes compris, sa hauteur
+// étant celle de la fenêtre), puis ses lignes sont envoyées dans l'ordre du
+// fichier avant la lecture de la suivante.
+// Une fenêtre porte margin lignes de plus de part et d'autre : filtrées sans
+// toutes leurs voisines, elles sont fausses et ne sont pas envoyées. Une
+// convolution de demi-taille h ne fausse que h lignes de plus depuis le bord
+// de la fenêtre, margin est donc la somme des demi-tailles des convolutions
+// du pipeline. Au bord de l'image, la marge est prise au bord opposé pour la
+// politique de bord wrap, sinon il n'y en a pas et la politique s'applique
+// telle quelle au bord de la fenêtre.
+
+// Pipeline appliqué à chaque fenêtre img. Renvoit EXIT_SUCCESS ou un code
+// errno.
+typedef int (*out_of_core_filter_t)(void *ctx, bmp_mapped_image_t *img);
+
+// out_of_core_run: filtre par fenêtres d'au plus budget octets, avec
+// filter(filter_ctx, ...), l'image de size octets du fichier fd, et l'envoie
+// au fur et à mesure par send(send_ctx, ...) (voir row_stream_send_t). Les
+// fenêtres ont margin lignes de marge, prises au bord opposé de l'image si
+// wrap. Renvoit EXIT_SUCCESS ou un code errno : EINVAL si l'image est
+// invalide, EFBIG si une fenêtre de budget octets ne contient aucune ligne
+// hors marge. Une erreur après le premier envoi laisse l'image tronquée.
+int out_of_core_run(int fd, off_t size, int32_t margin, bool wrap,
+                    size_t budget, out_of_core_filter_t filter,
+                    void *filter_ctx, row_stream_send_t send, void *send_ctx);
+
+#endif
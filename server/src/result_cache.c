@@ -0,0 +1,367 @@
+#define _GNU_SOURCE // robust mutexes, MAP_ANONYMOUS
+
+#include "result_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "full_io.h"
+
+//---- [KEY] -----------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+#define PRIME_1 0x9E3779B185EBCA87ULL
+#define PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME_3 0x165667B19E3779F9ULL
+
+static inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// hash_bytes: renvoit une empreinte de 64 bits des size octets pointés par
+// data, avec la clé secret. Quatre accumulateurs indépendants de mots de 8
+// octets, partant chacun d'un mot de la clé, gardent le processeur occupé :
+// l'empreinte coûte bien moins que la lecture de l'image.
+static uint64_t hash_bytes(const uint64_t secret[4], const void *data,
+                           size_t size) {
+  const unsigned char *p = data;
+  uint64_t lanes[4] = {secret[0] + PRIME_1 + PRIME_2, secret[1] + PRIME_2,
+                       secret[2], secret[3] - PRIME_1};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int k = 0; k < 4; ++k) {
+      uint64_t word;
+      memcpy(&word, p + i + 8 * k, sizeof(word));
+      lanes[k] = rotl(lanes[k] + word * PRIME_2, 31) * PRIME_1;
+    }
+  }
+  uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) +
+               rotl(lanes[3], 18);
+  for (; i < size; ++i) {
+    h = rotl(h ^ (p[i] * PRIME_3), 11) * PRIME_1;
+  }
+  h ^= (uint64_t)size;
+  h ^= h >> 33;
+  h *= PRIME_2;
+  h ^= h >> 29;
+  h *= PRIME_3;
+  h ^= h >> 32;
+  return h;
+}
+
+void result_key_init(const result_cache_t *c, result_key_t *key,
+                     const void *data, size_t size, const struct stat *source,
+                     const filter_t *filters, int32_t filter_count,
+                     border_policy_t border) {
+  // Compared with memcmp: no garbage in unused filters
+  memset(key, 0, sizeof(*key));
+  key->dev = (uint64_t)source->st_dev;
+  key->ino = (uint64_t)source->st_ino;
+  key->mtime_sec = (int64_t)source->st_mtim.tv_sec;
+  key->mtime_nsec = (int64_t)source->st_mtim.tv_nsec;
+  key->hash = hash_bytes(c->secret, data, size);
+  key->size = (uint64_t)size;
+  if (filter_count > 0 && filter_count <= REQUEST_MAX_FILTERS) {
+    memcpy(key->filters, filters, sizeof(*filters) * (size_t)filter_count);
+  }
+  key->filter_count = filter_count;
+  key->border = border;
+}
+
+//---- [TABLE] ---------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// lock: prend le mutex de la table t. Un worker terminé en le tenant ne
+// laisse au pire qu'une entrée en cours de remplissage, reprise par
+// is_stale.
+static void lock(result_table_t *t) {
+  if (pthread_mutex_lock(&t->lock) == EOWNERDEAD) {
+    pthread_mutex_consistent(&t->lock);
+  }
+}
+
+static void unlock(result_table_t *t) { pthread_mutex_unlock(&t->lock); }
+
+// entry_name: écrit dans name le nom du fichier de l'entrée i, relatif au
+// répertoire du cache
+static void entry_name(int32_t i, char name[16]) {
+  snprintf(name, 16, "%d", i);
+}
+
+// is_stale: renvoit true si l'entrée e est en cours de remplissage par un
+// worker qui s'est terminé
+static bool is_stale(const result_entry_t *e) {
+  return e->state == CACHE_FILLING && kill(e->owner, 0) == -1 &&
+         errno == ESRCH;
+}
+
+// release: supprime l'entrée i de c et son fichier
+static void release(result_cache_t *c, int32_t i) {
+  result_table_t *t = c->table;
+  char name[16];
+  entry_name(i, name);
+  unlinkat(c->dir_fd, name, 0);
+  t->stats.used -= t->entries[i].key.size;
+  t->stats.entries--;
+  t->entries[i].state = CACHE_FREE;
+}
+
+// find: renvoit l'indice de l'entrée de clé key de c, prête ou, si filling,
+// en cours de remplissage, -1 s'il n'y en a pas. Si filling, les entrées
+// abandonnées sont supprimées en chemin.
+static int32_t find(result_cache_t *c, const result_key_t *key,
+                    bool filling) {
+  result_table_t *t = c->table;
+  for (int32_t i = 0; i < RESULT_CACHE_MAX_ENTRIES; ++i) {
+    const result_entry_t *e = &t->entries[i];
+    // Its owner will never make it ready: stored again by the caller
+    if (filling && is_stale(e)) {
+      release(c, i);
+      continue;
+    }
+    if ((e->state == CACHE_READY || (filling && e->state == CACHE_FILLING)) &&
+        memcmp(&e->key, key, sizeof(*key)) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// least_recent: renvoit l'indice de l'entrée prête la moins récemment utilisée
+// de t (ou d'une entrée abandonnée), -1 s'il n'y en a pas
+static int32_t least_recent(const result_table_t *t) {
+  int32_t victim = -1;
+  for (int32_t i = 0; i < RESULT_CACHE_MAX_ENTRIES; ++i) {
+    const result_entry_t *e = &t->entries[i];
+    if (is_stale(e)) {
+      return i;
+    }
+    if (e->state == CACHE_READY &&
+        (victim == -1 || e->last_used < t->entries[victim].last_used)) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// claim: réserve dans c une entrée libre pour un résultat de size octets, en
+// supprimant les moins récemment utilisées tant que la place ou les entrées
+// manquent. Renvoit son indice, -1 si le résultat ne peut pas être gardé.
+static int32_t claim(result_cache_t *c, uint64_t size) {
+  result_table_t *t = c->table;
+  for (;;) {
+    int32_t slot = -1;
+    for (int32_t i = 0; i < RESULT_CACHE_MAX_ENTRIES && slot == -1; ++i) {
+      if (t->entries[i].state == CACHE_FREE) {
+        slot = i;
+      }
+    }
+    if (slot != -1 && t->stats.used + size <= t->stats.capacity) {
+      return slot;
+    }
+    int32_t victim = least_recent(t);
+    if (victim == -1) {
+      return -1;
+    }
+    release(c, victim);
+    t->stats.evictions++;
+  }
+}
+
+//---- [CACHE] ---------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// clear_dir: supprime les fichiers d'entrée laissés dans le répertoire dir_fd
+// par un serveur précédent
+static void clear_dir(int dir_fd) {
+  int fd = dup(dir_fd);
+  DIR *d = fd == -1 ? nullptr : fdopendir(fd);
+  if (d == nullptr) {
+    if (fd != -1) {
+      close(fd);
+    }
+    return;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(d)) != nullptr) {
+    if (ent->d_name[0] >= '0' && ent->d_name[0] <= '9') {
+      unlinkat(dir_fd, ent->d_name, 0);
+    }
+  }
+  closedir(d);
+}
+
+int result_cache_init(result_cache_t *c, const char *dir, uint64_t capacity) {
+  if (strlen(dir) >= sizeof(c->dir)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(c->dir, dir);
+  // Drawn once, before the workers are forked: they all hash alike
+  if (getrandom(c->secret, sizeof(c->secret), 0) !=
+      (ssize_t)sizeof(c->secret)) {
+    return -1;
+  }
+  if (mkdir(dir, S_IRWXU) == -1 && errno != EEXIST) {
+    return -1;
+  }
+
+  // DIRECTORY CHECK
+  // Possibly created beforehand by another user, or a symlink to elsewhere
+  int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (dir_fd == -1) {
+    return -1;
+  }
+  struct stat s;
+  if (fstat(dir_fd, &s) == -1) {
+    close(dir_fd);
+    return -1;
+  }
+  if (s.st_uid != geteuid() || (s.st_mode & 07777) != S_IRWXU) {
+    close(dir_fd);
+    errno = EPERM;
+    return -1;
+  }
+  clear_dir(dir_fd);
+
+  result_table_t *t = mmap(nullptr, sizeof(*t), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (t == MAP_FAILED) {
+    close(dir_fd);
+    return -1;
+  }
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  errno = pthread_mutex_init(&t->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (errno != 0) {
+    munmap(t, sizeof(*t));
+    close(dir_fd);
+    return -1;
+  }
+  t->stats.capacity = capacity;
+  c->table = t;
+  c->dir_fd = dir_fd;
+  return 0;
+}
+
+void result_cache_configure(result_cache_t *c, uint64_t capacity) {
+  if (c->table == nullptr) {
+    return;
+  }
+  lock(c->table);
+  c->table->stats.capacity = capacity;
+  unlock(c->table);
+}
+
+bool result_cache_enabled(const result_cache_t *c) {
+  return c->table != nullptr && c->table->stats.capacity > 0;
+}
+
+int result_cache_open(result_cache_t *c, const result_key_t *key) {
+  result_table_t *t = c->table;
+  int fd = -1;
+  lock(t);
+  int32_t i = find(c, key, false);
+  if (i == -1) {
+    errno = ENOENT;
+  } else {
+    // Opened under the lock: the file outlives an eviction from now on
+    char name[16];
+    entry_name(i, name);
+    fd = openat(c->dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  }
+  int err = errno;
+  if (fd == -1) {
+    t->stats.misses++;
+  } else {
+    t->entries[i].last_used = ++t->tick;
+    t->stats.hits++;
+  }
+  unlock(t);
+  errno = err;
+  return fd;
+}
+
+int result_cache_store(result_cache_t *c, const result_key_t *key,
+                       const void *data, size_t size) {
+  result_table_t *t = c->table;
+  lock(t);
+  if (size > t->stats.capacity || find(c, key, true) != -1) {
+    unlock(t);
+    return 0;
+  }
+  int32_t i = claim(c, size);
+  if (i == -1) {
+    unlock(t);
+    errno = ENOSPC;
+    return -1;
+  }
+  t->entries[i] = (result_entry_t){
+      .key = *key, .state = CACHE_FILLING, .owner = getpid()};
+  t->stats.used += size;
+  t->stats.entries++;
+  unlock(t);
+
+  // FILL OUTSIDE THE LOCK
+  // A new file each time: readers of an evicted entry keep the old one
+  int ret = 0;
+  char name[16];
+  entry_name(i, name);
+  unlinkat(c->dir_fd, name, 0);
+  int fd = openat(c->dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  S_IRUSR);
+  if (fd == -1 || full_write(fd, data, size) != (ssize_t)size) {
+    ret = -1;
+  }
+  int err = errno;
+  if (fd != -1 && close(fd) == -1) {
+    ret = -1;
+    err = errno;
+  }
+
+  lock(t);
+  if (ret == 0) {
+    t->entries[i].state = CACHE_READY;
+    t->entries[i].last_used = ++t->tick;
+    t->stats.stores++;
+  } else {
+    release(c, i);
+  }
+  unlock(t);
+  errno = err;
+  return ret;
+}
+
+void result_cache_stats(result_cache_t *c, result_cache_stats_t *stats) {
+  lock(c->table);
+  *stats = c->table->stats;
+  unlock(c->table);
+}
+
+void result_cache_dispose(result_cache_t *c) {
+  if (c->table == nullptr) {
+    return;
+  }
+  for (int32_t i = 0; i < RESULT_CACHE_MAX_ENTRIES; ++i) {
+    if (c->table->entries[i].state != CACHE_FREE) {
+      release(c, i);
+    }
+  }
+  close(c->dir_fd);
+  c->dir_fd = -1;
+  rmdir(c->dir);
+  pthread_mutex_destroy(&c->table->lock);
+  munmap(c->table, sizeof(*c->table));
+  c->table = nullptr;
+}
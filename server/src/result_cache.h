@@ -0,0 +1,127 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "opt_to_request.h"
+
+#define RESULT_CACHE_MAX_ENTRIES 4096
+
+// CACHE DE RÉSULTATS
+// Les images filtrées sont gardées dans des fichiers du répertoire dir
+// (cache_dir de la configuration, en mémoire sous /dev/shm par défaut), un
+// par entrée, nommés par l'indice de l'entrée. La table des entrées est
+// projetée en mémoire partagée par le processus principal avant la création
+// des workers et protégée par un mutex partagé entre processus. Une entrée est
+// identifiée par le fichier d'entrée (périphérique, inode et date de
+// modification), une empreinte de son contenu, sa taille, et le pipeline de la
+// requête : un même fichier ouvert par un autre chemin est reconnu, une image
+// modifiée ou une copie dans un autre fichier ne l'est pas. L'empreinte est
+// calculée avec une clé tirée au hasard au démarrage : un client ne peut pas
+// construire une image de même empreinte qu'une autre pour que son résultat
+// soit servi à sa place. Au-delà de capacity octets, les entrées les moins
+// récemment utilisées sont supprimées.
+// Une entrée est remplie (CACHE_FILLING) hors du mutex dans un nouveau
+// fichier : un worker qui lit une entrée ouvre son fichier sous le mutex et le
+// garde lisible même si elle est supprimée ou remplacée entre temps.
+
+typedef struct {
+  uint64_t dev; // fichier d'entrée
+  uint64_t ino;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t hash; // contenu de l'image d'entrée
+  uint64_t size;
+  filter_t filters[REQUEST_MAX_FILTERS];
+  int32_t filter_count;
+  border_policy_t border;
+} result_key_t;
+
+typedef enum { CACHE_FREE, CACHE_FILLING, CACHE_READY } result_state_t;
+
+typedef struct {
+  result_key_t key;
+  uint64_t last_used; // valeur de tick au dernier accès
+  result_state_t state;
+  pid_t owner; // CACHE_FILLING : worker qui la remplit
+} result_entry_t;
+
+// Compteurs du cache, depuis le démarrage du serveur
+typedef struct {
+  uint64_t capacity;
+  uint64_t used; // octets des entrées prêtes ou en cours de remplissage
+  int32_t entries;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+} result_cache_stats_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  uint64_t tick;
+  result_cache_stats_t stats;
+  result_entry_t entries[RESULT_CACHE_MAX_ENTRIES];
+} result_table_t;
+
+typedef struct {
+  result_table_t *table;
+  char dir[PATH_MAX];
+  int dir_fd; // les fichiers sont ouverts et supprimés relativement à lui
+  uint64_t secret[4]; // clé de l'empreinte, commune aux workers
+} result_cache_t;
+
+#define RESULT_CACHE_INITIALIZER {.table = nullptr, .dir_fd = -1}
+
+// result_key_init: écrit dans key la clé pour le cache c du résultat du
+// pipeline de filter_count filtres filters, avec la politique de bord border,
+// appliqué à l'image de size octets pointée par data, lue depuis le fichier
+// décrit par source
+void result_key_init(const result_cache_t *c, result_key_t *key,
+                     const void *data, size_t size, const struct stat *source,
+                     const filter_t *filters, int32_t filter_count,
+                     border_policy_t border);
+
+// result_cache_init: crée le répertoire dir, vidé des fichiers d'un serveur
+// précédent, et la table partagée du cache pointé par c, limité à capacity
+// octets (0 le désactive). Un répertoire dir existant n'est repris que s'il
+// appartient à l'utilisateur effectif du serveur et n'est accessible qu'à lui
+// (droits 0700), pas un lien symbolique : /dev/shm est ouvert à tous. Renvoit
+// 0 en cas de succes, -1 sinon (errno est positionné, EPERM si dir est
+// refusé).
+int result_cache_init(result_cache_t *c, const char *dir, uint64_t capacity);
+
+// result_cache_configure: limite le cache c à capacity octets (rechargement
+// de la configuration), les entrées en trop sont supprimées au prochain ajout.
+// Sans effet si le cache n'a pas pu être créé.
+void result_cache_configure(result_cache_t *c, uint64_t capacity);
+
+// result_cache_enabled: renvoit true si le cache c garde des résultats
+bool result_cache_enabled(const result_cache_t *c);
+
+// result_cache_open: cherche dans c le résultat de clé key. Renvoit un
+// descripteur en lecture seule sur son fichier, à fermer par l'appelant, -1
+// sinon (errno vaut ENOENT si le résultat n'est pas dans le cache).
+int result_cache_open(result_cache_t *c, const result_key_t *key);
+
+// result_cache_store: ajoute à c le résultat de clé key, l'image de size
+// octets pointée par data, en supprimant au besoin les entrées les moins
+// récemment utilisées. Sans effet si le résultat est déjà présent ou plus
+// grand que le cache. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné).
+int result_cache_store(result_cache_t *c, const result_key_t *key,
+                       const void *data, size_t size);
+
+// result_cache_stats: écrit dans stats les compteurs du cache c
+void result_cache_stats(result_cache_t *c, result_cache_stats_t *stats);
+
+// result_cache_dispose: supprime les fichiers et le répertoire du cache c,
+// puis libère sa table (processus principal, à l'arrêt)
+void result_cache_dispose(result_cache_t *c);
+
+#endif
@@ -0,0 +1,97 @@
+#include "row_stream.h"
+
+#include <errno.h>
+#include <signal.h>
+
+// row_stream_run: thread d'envoi, transmet les octets définitifs du flux
+// pointé par arg jusqu'à sa fin ou au premier échec
+static void *row_stream_run(void *arg) {
+  row_stream_t *s = (row_stream_t *)arg;
+  pthread_mutex_lock(&s->mutex);
+  while (true) {
+    while (s->sent == s->ready && !s->closed) {
+      pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    if (s->sent == s->ready || s->abandoned) {
+      break;
+    }
+    // Everything ready so far in one call: fewer, larger transfers
+    size_t from = s->sent;
+    size_t to = s->ready;
+    pthread_mutex_unlock(&s->mutex);
+    int ret = s->send(s->ctx, s->data + from, to - from, from);
+    int err = errno;
+    pthread_mutex_lock(&s->mutex);
+    if (ret == -1) {
+      s->error = err;
+      break;
+    }
+    s->sent = to;
+  }
+  pthread_mutex_unlock(&s->mutex);
+  return nullptr;
+}
+
+int row_stream_start(row_stream_t *s, const void *data, size_t size,
+                     size_t pixels, size_t row_size, row_stream_send_t send,
+                     void *ctx) {
+  *s = (row_stream_t){.data = data,
+                      .size = size,
+                      .pixels = pixels,
+                      .row_size = row_size,
+                      .send = send,
+                      .ctx = ctx};
+  pthread_mutex_init(&s->mutex, nullptr);
+  pthread_cond_init(&s->cond, nullptr);
+
+  // SIGNALS
+  sigset_t all;
+  sigset_t old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int ret = pthread_create(&s->thread, nullptr, row_stream_run, s);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  if (ret != 0) {
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    errno = ret;
+    return -1;
+  }
+  return 0;
+}
+
+void row_stream_ready(row_stream_t *s, int32_t rows) {
+  size_t ready = s->pixels + (size_t)rows * s->row_size;
+  if (ready > s->size) {
+    ready = s->size;
+  }
+  pthread_mutex_lock(&s->mutex);
+  if (ready > s->ready) {
+    s->ready = ready;
+    if (s->ready - s->sent >= ROW_STREAM_MIN_SEND) {
+      pthread_cond_signal(&s->cond);
+    }
+  }
+  pthread_mutex_unlock(&s->mutex);
+}
+
+int row_stream_finish(row_stream_t *s, bool complete) {
+  pthread_mutex_lock(&s->mutex);
+  if (complete) {
+    s->ready = s->size;
+  } else {
+    s->abandoned = true;
+  }
+  s->closed = true;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->mutex);
+
+  pthread_join(s->thread, nullptr);
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mutex);
+  if (s->error != 0) {
+    errno = s->error;
+    return -1;
+  }
+  return 0;
+}
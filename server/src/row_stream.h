@@ -0,0 +1,63 @@
+#ifndef ROW_STREAM_H
+#define ROW_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Octets définitifs non envoyés au moins pour réveiller le thread d'envoi,
+// hors fin de l'image : chaque envoi transfère un bloc assez grand
+#define ROW_STREAM_MIN_SEND (1024 * 1024)
+
+// ENVOI PENDANT LE FILTRAGE
+// Une image est envoyée au client pendant que ses dernières lignes sont encore
+// filtrées : le filtrage signale par row_stream_ready les lignes terminées
+// depuis la première ligne du fichier, et un thread d'envoi transmet au fur et
+// à mesure, dans l'ordre du fichier, les octets devenus définitifs (en-têtes
+// compris). Les lignes sont numérotées dans l'ordre du fichier, qui est celui
+// de la mémoire : la ligne 0 est la ligne du bas d'une image de hauteur
+// positive (stockée de bas en haut), et elle part en premier.
+// Les octets envoyés ne sont plus modifiés par le filtrage.
+
+// Fonction d'envoi des count octets de buf, situés à la position offset de
+// l'image. Renvoit 0 en cas de succes, -1 sinon (errno est positionné).
+typedef int (*row_stream_send_t)(void *ctx, const void *buf, size_t count,
+                                 size_t offset);
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  const uint8_t *data;
+  size_t size;
+  size_t pixels;   // position de la première ligne
+  size_t row_size; // octets d'une ligne (remplissage compris)
+  size_t ready;    // octets définitifs depuis le début de data
+  size_t sent;
+  bool closed;    // plus aucun octet ne deviendra définitif
+  bool abandoned; // le filtrage a échoué, les octets restants ne partent pas
+  int error;      // errno du premier envoi en échec, 0 sinon
+  row_stream_send_t send;
+  void *ctx;
+  pthread_t thread;
+} row_stream_t;
+
+// row_stream_start: démarre le thread qui envoie par send(ctx, ...) l'image de
+// size octets pointée par data, dont les lignes de row_size octets commencent
+// à la position pixels. Les signaux sont bloqués dans ce thread. Renvoit 0 en
+// cas de succes, -1 sinon (errno est positionné).
+int row_stream_start(row_stream_t *s, const void *data, size_t size,
+                     size_t pixels, size_t row_size, row_stream_send_t send,
+                     void *ctx);
+
+// row_stream_ready: signale au flux s que les rows premières lignes de l'image
+// sont définitives
+void row_stream_ready(row_stream_t *s, int32_t rows);
+
+// row_stream_finish: termine le flux s et attend la fin du thread d'envoi.
+// Si complete, toute l'image est définitive et finit d'être envoyée, sinon
+// l'envoi s'arrête au plus tôt. Renvoit 0 en cas de succes, -1 si un envoi a
+// échoué (errno est positionné).
+int row_stream_finish(row_stream_t *s, bool complete);
+
+#endif
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE // accept4
+
+#include "socket_server.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "fd_passing.h"
+#include "full_io.h"
+#include "utils.h"
+
+// watch: change les évènements surveillés du descripteur fd par l'epoll epfd
+// (EPOLLIN si on, aucun sinon)
+static int watch(int epfd, int op, int fd, bool on) {
+  struct epoll_event ev = {.events = on ? EPOLLIN : 0, .data.fd = fd};
+  return epoll_ctl(epfd, op, fd, &ev);
+}
+
+// update_flow: surveille le socket d'écoute tant qu'une connexion peut être
+// acceptée, et les connexions tant qu'une requête peut être mise en attente
+static void update_flow(socket_server_t *ss) {
+  bool accepting =
+      ss->conn_count < SOCKET_MAX_CONNECTIONS && !ss->accept_failed;
+  bool reading =
+      dispatcher_pending(ss->dispatcher, JOB_SOCKET) < SOCKET_MAX_IN_FLIGHT;
+  if (accepting != ss->accepting &&
+      watch(ss->epoll, EPOLL_CTL_MOD, ss->listener, accepting) == 0) {
+    ss->accepting = accepting;
+  }
+  if (reading != ss->reading &&
+      watch(ss->epoll, EPOLL_CTL_MOD, ss->conn_epoll, reading) == 0) {
+    ss->reading = reading;
+  }
+}
+
+// reply_now: répond sans attendre, depuis le processus principal, à la
+// requête id de la connexion conn. Un client qui ne lit pas ses réponses perd
+// celle-ci.
+static void reply_now(int conn, uint64_t id, int32_t status) {
+  socket_response_t rep = {.id = id, .status = status};
+  send(conn, &rep, sizeof(rep), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+// close_conn: ferme la connexion conn du serveur pointé par ss
+static void close_conn(socket_server_t *ss, int conn) {
+  // Workers hold the same file description: it must leave the epoll first
+  epoll_ctl(ss->conn_epoll, EPOLL_CTL_DEL, conn, nullptr);
+  close(conn);
+  for (int i = 0; i < ss->conn_count; ++i) {
+    if (ss->conns[i] == conn) {
+      ss->conns[i] = ss->conns[--ss->conn_count];
+      break;
+    }
+  }
+}
+
+// forward_request: reçoit une requête de la connexion conn et la met en
+// attente dans le répartiteur. Renvoit 1 si une requête a été reçue, 0 s'il n'y en a pas, -1 si
+// la connexion est terminée.
+static int forward_request(socket_server_t *ss, int conn) {
+  socket_request_t rq;
+  int fds[FD_PASSING_MAX_FDS];
+  int fd_count;
+  ssize_t n = recv_fds(conn, &rq, sizeof(rq), fds, &fd_count, MSG_DONTWAIT);
+  if (n == 0 || (n == -1 && errno != EAGAIN && errno != EMSGSIZE)) {
+    return -1;
+  }
+  if (n == -1 && errno == EAGAIN) {
+    return 0;
+  }
+  if (n != (ssize_t)sizeof(rq) || fd_count != 2) {
+    close_fds(fds, fd_count);
+    reply_now(conn, n >= (ssize_t)sizeof(rq.id) ? rq.id : 0, EINVAL);
+    return 1;
+  }
+  // Fair share between the users or processes behind the connections
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 ||
+      dispatcher_push_socket(ss->dispatcher, &rq, conn, fds[0], fds[1],
+                             cred.pid, cred.uid) == -1) {
+    reply_now(conn, rq.id, errno);
+    close_fds(fds, fd_count);
+  }
+  return 1;
+}
+
+// read_conns: transmet les requêtes des connexions prêtes de conn_epoll, au
+// plus SOCKET_READ_BATCH par connexion pour ne pas en privilégier une
+static void read_conns(socket_server_t *ss) {
+  struct epoll_event events[SOCKET_EVENTS];
+  int n = epoll_wait(ss->conn_epoll, events, SOCKET_EVENTS, 0);
+  for (int i = 0; i < n; ++i) {
+    int conn = events[i].data.fd;
+    int status = 1;
+    for (int k = 0;
+         k < SOCKET_READ_BATCH && status == 1 &&
+         dispatcher_pending(ss->dispatcher, JOB_SOCKET) < SOCKET_MAX_IN_FLIGHT;
+         ++k) {
+      status = forward_request(ss, conn);
+    }
+    if (status == -1) {
+      close_conn(ss, conn);
+    }
+  }
+}
+
+// accept_conns: accepte les connexions en attente. Renvoit 0 en cas de
+// succes, -1 si une connexion n'a pas pu être acceptée faute de ressources.
+static int accept_conns(socket_server_t *ss) {
+  while (ss->conn_count < SOCKET_MAX_CONNECTIONS) {
+    int conn =
+        accept4(ss->listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn == -1) {
+      if (errno == EAGAIN || errno == ECONNABORTED || errno == EINTR) {
+        return 0;
+      }
+      ss->accept_failed = true;
+      return -1;
+    }
+    if (watch(ss->conn_epoll, EPOLL_CTL_ADD, conn, true) == -1) {
+      close(conn);
+      ss->accept_failed = true;
+      return -1;
+    }
+    ss->conns[ss->conn_count++] = conn;
+  }
+  return 0;
+}
+
+int socket_server_init(socket_server_t *ss, const char *path,
+                       dispatcher_t *d) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  ss->conn_count = 0;
+  ss->accepting = true;
+  ss->accept_failed = false;
+  ss->reading = true;
+  ss->dispatcher = d;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  ss->epoll = epoll_create1(EPOLL_CLOEXEC);
+  ss->conn_epoll = epoll_create1(EPOLL_CLOEXEC);
+  ss->listener =
+      socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (ss->epoll == -1 || ss->conn_epoll == -1 ||
+      ss->listener == -1) {
+    return -1;
+  }
+  // Only one server can run (config semaphore): this one is stale
+  if (unlink(path) == -1 && errno != ENOENT) {
+    return -1;
+  }
+  if (bind(ss->listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      chmod(path, PERMS) == -1 || listen(ss->listener, SOCKET_BACKLOG) == -1) {
+    return -1;
+  }
+  if (watch(ss->epoll, EPOLL_CTL_ADD, ss->listener, true) == -1 ||
+      watch(ss->epoll, EPOLL_CTL_ADD, ss->conn_epoll, true) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+int socket_server_handle(socket_server_t *ss) {
+  int ret = 0;
+  struct epoll_event events[2];
+  int n = epoll_wait(ss->epoll, events, 2, 0);
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == ss->listener) {
+      ret = accept_conns(ss);
+    } else if (fd == ss->conn_epoll) {
+      read_conns(ss);
+    }
+  }
+  update_flow(ss);
+  return ret;
+}
+
+void socket_server_resume_accept(socket_server_t *ss) {
+  ss->accept_failed = false;
+  update_flow(ss);
+}
+
+void socket_server_update(socket_server_t *ss) { update_flow(ss); }
+
+void socket_server_close_front(socket_server_t *ss) {
+  int fds[3] = {ss->epoll, ss->conn_epoll, ss->listener};
+  for (int i = 0; i < 3; ++i) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  ss->epoll = -1;
+  ss->conn_epoll = -1;
+  ss->listener = -1;
+  close_fds(ss->conns, ss->conn_count);
+  ss->conn_count = 0;
+}
+
+int socket_server_reply(job_t *job, int32_t status, unsigned int timeout) {
+  int ret = 0;
+  socket_response_t rep = {.id = job->rq.id, .status = status};
+  if (full_write_until(job->conn, &rep, sizeof(rep), timeout) !=
+      sizeof(rep)) {
+    ret = -1;
+  }
+  int err = errno;
+  int fds[3] = {job->conn, job->fd_in, job->fd_out};
+  close_fds(fds, 3);
+  errno = err;
+  return ret;
+}
+
+void socket_server_dispose(socket_server_t *ss, const char *path) {
+  if (ss->listener != -1) {
+    unlink(path);
+  }
+  socket_server_close_front(ss);
+}
@@ -0,0 +1,87 @@
+#ifndef SOCKET_SERVER_H
+#define SOCKET_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dispatcher.h"
+#include "opt_to_request.h"
+
+#define SOCKET_MAX_CONNECTIONS 1024 // connexions simultanées au socket
+#define SOCKET_MAX_IN_FLIGHT 128    // requêtes en attente dans le répartiteur
+#define SOCKET_BACKLOG 128
+#define SOCKET_EVENTS 64    // évènements traités par appel à epoll_wait
+#define SOCKET_READ_BATCH 8 // requêtes lues au plus par connexion et par tour
+
+// FRONTAL PAR SOCKET
+// Le processus principal du serveur accepte les connexions au socket
+// REQUEST_SOCKET_PATH et reçoit leurs requêtes (voir socket_request_t). Chaque
+// requête est mise en attente, avec le descripteur de sa connexion et ceux de
+// ses fichiers, dans le répartiteur (voir dispatcher.h) qui la remet à un
+// worker. Les messages d'un socket SOCK_SEQPACKET étant reçus et envoyés d'un
+// seul tenant, plusieurs workers peuvent traiter et répondre en même temps aux
+// requêtes d'une même connexion.
+// Les connexions sont surveillées par conn_epoll, lui-même surveillé avec le
+// socket d'écoute par epoll, seul descripteur à surveiller par la boucle
+// principale. Au-delà de SOCKET_MAX_IN_FLIGHT requêtes en attente dans le
+// répartiteur, conn_epoll n'est plus surveillé et les requêtes restent dans
+// les sockets des clients jusqu'à ce que des workers se libèrent.
+
+typedef struct {
+  int epoll;      // socket d'écoute et conn_epoll
+  int conn_epoll; // connexions
+  int listener;
+  int conns[SOCKET_MAX_CONNECTIONS];
+  int conn_count;
+  bool accepting;
+  bool accept_failed; // accept4 a échoué faute de ressources
+  bool reading;
+  dispatcher_t *dispatcher;
+} socket_server_t;
+
+#define SOCKET_SERVER_INITIALIZER                                              \
+  {.epoll = -1,                                                                \
+   .conn_epoll = -1,                                                           \
+   .listener = -1}
+
+// socket_server_init: crée le socket d'écoute path, accessible à tous (PERMS),
+// en remplaçant un éventuel socket laissé par un serveur précédent, et les
+// descripteurs epoll du serveur pointé par ss, qui met ses requêtes en attente
+// dans le répartiteur d. Renvoit 0 en cas de succes, -1 sinon (errno est
+// positionné).
+int socket_server_init(socket_server_t *ss, const char *path,
+                       dispatcher_t *d);
+
+// socket_server_handle: traite, sans attendre, les évènements signalés par
+// ss->epoll : accepte les nouvelles connexions, met en attente les requêtes
+// reçues dans le répartiteur et ferme les connexions terminées. Une requête
+// invalide ou qui ne peut être mise en attente reçoit immédiatement sa réponse
+// (EINVAL, EBUSY...). Renvoit 0 en cas de succes, -1 si une connexion
+// n'a pas pu être acceptée faute de ressources (errno est positionné) : les
+// connexions ne sont alors plus acceptées jusqu'à
+// socket_server_resume_accept.
+int socket_server_handle(socket_server_t *ss);
+
+// socket_server_resume_accept: accepte à nouveau les connexions après un échec
+// de socket_server_handle
+void socket_server_resume_accept(socket_server_t *ss);
+
+// socket_server_update: surveille à nouveau les connexions si des requêtes ont
+// quitté le répartiteur (à appeler après dispatcher_run)
+void socket_server_update(socket_server_t *ss);
+
+// socket_server_close_front: ferme, dans un worker, les descripteurs du
+// processus principal hérités à sa création
+void socket_server_close_front(socket_server_t *ss);
+
+// socket_server_reply: envoie sur la connexion de la requête job du frontal
+// par socket, au plus tard timeout secondes après l'appel, la réponse de
+// statut status et ferme les descripteurs de job. Renvoit 0 en cas de succes,
+// -1 si la réponse n'a pas pu être envoyée (errno est positionné).
+int socket_server_reply(job_t *job, int32_t status, unsigned int timeout);
+
+// socket_server_dispose: ferme les descripteurs du serveur pointé par ss et
+// supprime le socket d'écoute path s'il a été créé
+void socket_server_dispose(socket_server_t *ss, const char *path);
+
+#endif
@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+
+// thread_pool_run: boucle d'un thread du pool, exécute les tâches de la file
+// jusqu'à l'arrêt du pool
+static void *thread_pool_run(void *arg) {
+  thread_pool_t *pool = (thread_pool_t *)arg;
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (pool->queued == 0 && !pool->stop) {
+      pthread_cond_wait(&pool->task_available, &pool->mutex);
+    }
+    if (pool->queued == 0) {
+      break;
+    }
+    thread_pool_task_t task = pool->tasks[pool->head];
+    pool->head = (pool->head + 1) % THREAD_POOL_QUEUE_SIZE;
+    pool->queued--;
+    pthread_cond_signal(&pool->slot_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    task.func(task.arg);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->pending == 0) {
+      pthread_cond_broadcast(&pool->tasks_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return nullptr;
+}
+
+int thread_pool_init(thread_pool_t *pool, int thread_count) {
+  pool->threads = malloc(sizeof(pthread_t) * (size_t)thread_count);
+  if (pool->threads == nullptr) {
+    return errno;
+  }
+  pool->thread_count = 0;
+  pool->head = 0;
+  pool->queued = 0;
+  pool->pending = 0;
+  pool->stop = false;
+  pthread_mutex_init(&pool->mutex, nullptr);
+  pthread_cond_init(&pool->task_available, nullptr);
+  pthread_cond_init(&pool->slot_available, nullptr);
+  pthread_cond_init(&pool->tasks_done, nullptr);
+
+  // SIGNALS
+  sigset_t all;
+  sigset_t old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int ret = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    if ((ret = pthread_create(&pool->threads[i], nullptr, thread_pool_run,
+                              pool)) != 0) {
+      break;
+    }
+    pool->thread_count++;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+
+  if (ret != 0) {
+    thread_pool_destroy(pool);
+  }
+  return ret;
+}
+
+void thread_pool_submit(thread_pool_t *pool, void *(*func)(void *), void *arg) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->queued == THREAD_POOL_QUEUE_SIZE) {
+    pthread_cond_wait(&pool->slot_available, &pool->mutex);
+  }
+  int tail = (pool->head + pool->queued) % THREAD_POOL_QUEUE_SIZE;
+  pool->tasks[tail].func = func;
+  pool->tasks[tail].arg = arg;
+  pool->queued++;
+  pool->pending++;
+  pthread_cond_signal(&pool->task_available);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(thread_pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->tasks_done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->task_available);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 0; i < pool->thread_count; ++i) {
+    pthread_join(pool->threads[i], nullptr);
+  }
+  free(pool->threads);
+  pool->threads = nullptr;
+  pool->thread_count = 0;
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->task_available);
+  pthread_cond_destroy(&pool->slot_available);
+  pthread_cond_destroy(&pool->tasks_done);
+}
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define THREAD_POOL_QUEUE_SIZE 64
+
+// Pool de threads persistant utilisé par un worker pour appliquer les filtres.
+// Les tâches ont la même signature que les fonctions de filtre (void *(*)(void
+// *)) afin que chaque bande de lignes décrite par un thread_filter_args_t
+// puisse être soumise telle quelle, sans créer de thread par image.
+
+typedef struct {
+  void *(*func)(void *);
+  void *arg;
+} thread_pool_task_t;
+
+typedef struct {
+  pthread_t *threads;
+  int thread_count;
+  thread_pool_task_t tasks[THREAD_POOL_QUEUE_SIZE];
+  int head;
+  int queued;
+  int pending;
+  bool stop;
+  pthread_mutex_t mutex;
+  pthread_cond_t task_available;
+  pthread_cond_t slot_available;
+  pthread_cond_t tasks_done;
+} thread_pool_t;
+
+// thread_pool_init: initialise le pool pointé par pool et démarre thread_count
+// threads. Les signaux sont bloqués dans ces threads afin d'être délivrés au
+// thread principal du worker. Retourne 0 en cas de succès sinon un code
+// d'erreur
+int thread_pool_init(thread_pool_t *pool, int thread_count);
+
+// thread_pool_submit: ajoute à la file du pool pointé par pool la tâche
+// func(arg). Bloque tant que la file est pleine
+void thread_pool_submit(thread_pool_t *pool, void *(*func)(void *), void *arg);
+
+// thread_pool_wait: attend la fin de toutes les tâches soumises au pool pointé
+// par pool
+void thread_pool_wait(thread_pool_t *pool);
+
+// thread_pool_destroy: termine les threads du pool pointé par pool après
+// l'exécution des tâches restantes et libère ses ressources
+void thread_pool_destroy(thread_pool_t *pool);
+
+#endif
@@ -0,0 +1,312 @@
+#include "tile_scheduler.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  const filter_func_t *filter_funcs;
+  int32_t filter_count;
+  const thread_filter_args_t *base;
+  int32_t height;
+  tile_queue_t queues[ABSOLUTE_MAX_THREADS];
+  atomic_int steal_count;
+  atomic_int failed_count;
+  tile_stats_t *stats;
+} tile_scheduler_t;
+
+typedef struct {
+  tile_scheduler_t *sched;
+  int id;
+} tile_runner_t;
+
+// tile_pop: retire la prochaine tuile de la file pointé par queue. Retourne
+// l'indice de la tuile ou -1 si la file est vide
+static int32_t tile_pop(tile_queue_t *queue) {
+  int32_t tile = -1;
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->next < queue->end) {
+    tile = queue->next++;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return tile;
+}
+
+// tile_steal: vole la moitié des tuiles restantes d'une autre file que celle
+// du runner et les place dans sa propre file. Lorsque l'image a des halos, la
+// tuile suivant celle en cours de traitement chez la victime n'est jamais
+// volée : la frontière partagée est copiée sous le verrou de la victime, avant
+// que l'une ou l'autre des tuiles qui la bordent ne soit modifiée. Retourne 0
+// en cas de succès, -1 si aucun thread n'a de tuile à céder
+static int tile_steal(tile_runner_t *runner) {
+  tile_scheduler_t *sched = runner->sched;
+  int thread_count = sched->stats->thread_count;
+  bmp_halo_t *halo = sched->base->halo;
+  int32_t kept = halo != nullptr ? 1 : 0;
+  for (int k = 1; k < thread_count; ++k) {
+    tile_queue_t *victim = &sched->queues[(runner->id + k) % thread_count];
+    pthread_mutex_lock(&victim->mutex);
+    int32_t remaining = victim->end - victim->next - kept;
+    if (remaining > 0 &&
+        (halo == nullptr ||
+         bmp_halo_capture(halo, victim->end - (remaining + 1) / 2) == 0)) {
+      int32_t end = victim->end;
+      victim->end -= (remaining + 1) / 2;
+      int32_t start = victim->end;
+      pthread_mutex_unlock(&victim->mutex);
+
+      tile_queue_t *own = &sched->queues[runner->id];
+      pthread_mutex_lock(&own->mutex);
+      own->next = start;
+      own->end = end;
+      pthread_mutex_unlock(&own->mutex);
+      atomic_fetch_add(&sched->steal_count, 1);
+      return 0;
+    }
+    pthread_mutex_unlock(&victim->mutex);
+  }
+  return -1;
+}
+
+// tile_run: tâche exécutée par chaque thread du pool, traite les tuiles de sa
+// file puis vole celles des autres threads jusqu'à épuisement. Chaque tuile
+// passe par tous les filtres à la suite, tant qu'elle est encore en cache
+static void *tile_run(void *arg) {
+  tile_runner_t *runner = (tile_runner_t *)arg;
+  tile_scheduler_t *sched = runner->sched;
+  int32_t tile_rows = sched->stats->tile_rows;
+  thread_filter_args_t args = *sched->base;
+  double busy_ms = 0;
+
+  do {
+    int32_t tile;
+    while ((tile = tile_pop(&sched->queues[runner->id])) != -1) {
+      args.start_line = tile * tile_rows;
+      args.end_line = args.start_line + tile_rows;
+      if (args.end_line > sched->height) {
+        args.end_line = sched->height;
+      }
+      struct timespec start;
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (int32_t f = 0; f < sched->filter_count; f++) {
+        if (sched->filter_funcs[f](&args) != nullptr) {
+          atomic_fetch_add(&sched->failed_count, 1);
+          break;
+        }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      busy_ms += (double)(end.tv_sec - start.tv_sec) * 1e3 +
+                 (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    }
+  } while (tile_steal(runner) == 0);
+
+  free(args.carry);
+  sched->stats->busy_ms[runner->id] = busy_ms;
+  return nullptr;
+}
+
+int32_t tile_scheduler_tile_rows(const bmp_mapped_image_t *img,
+                                 int32_t height, int thread_count,
+                                 int32_t min_rows) {
+  int32_t row_size = ((img->dib_h->width * 3 + 3) / 4) * 4;
+  int32_t tile_rows = TILE_TARGET_SIZE / (row_size > 0 ? row_size : 1);
+  int32_t balanced_rows = height / (thread_count * TILE_MIN_PER_THREAD);
+  if (tile_rows > balanced_rows) {
+    tile_rows = balanced_rows;
+  }
+  if (tile_rows < min_rows) {
+    tile_rows = min_rows;
+  }
+  if (tile_rows < 1) {
+    tile_rows = 1;
+  }
+  return tile_rows;
+}
+
+void tile_scheduler_run(thread_pool_t *pool, const filter_func_t *filter_funcs,
+                        int32_t filter_count, const thread_filter_args_t *base,
+                        int32_t height, int32_t tile_rows, int thread_count,
+                        tile_stats_t *stats) {
+  tile_scheduler_t sched;
+  tile_runner_t runners[ABSOLUTE_MAX_THREADS];
+
+  //---- [TILE SIZE         ] ------------------------------------------------//
+  stats->thread_count = thread_count;
+  stats->tile_rows = tile_rows;
+  stats->tile_count = (height + tile_rows - 1) / tile_rows;
+
+  //---- [DISTRIBUTION      ] ------------------------------------------------//
+  sched.filter_funcs = filter_funcs;
+  sched.filter_count = filter_count;
+  sched.base = base;
+  sched.height = height;
+  sched.stats = stats;
+  atomic_init(&sched.steal_count, 0);
+  atomic_init(&sched.failed_count, 0);
+  int32_t base_tiles = stats->tile_count / thread_count;
+  int32_t extra_tiles = stats->tile_count % thread_count;
+  int32_t next = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_mutex_init(&sched.queues[i].mutex, nullptr);
+    sched.queues[i].next = next;
+    next += base_tiles + (i < extra_tiles ? 1 : 0);
+    sched.queues[i].end = next;
+  }
+  // INITIAL BOUNDARIES
+  for (int i = 1; base->halo != nullptr && i < thread_count; ++i) {
+    if (bmp_halo_capture(base->halo, sched.queues[i].next) == -1) {
+      // Hand every tile to the first queue: no boundary is shared anymore
+      sched.queues[0].end = stats->tile_count;
+      for (int j = 1; j < thread_count; ++j) {
+        sched.queues[j].next = sched.queues[j].end = stats->tile_count;
+      }
+      break;
+    }
+  }
+
+  //---- [RUN               ] ------------------------------------------------//
+  for (int i = 0; i < thread_count; ++i) {
+    runners[i].sched = &sched;
+    runners[i].id = i;
+    thread_pool_submit(pool, tile_run, &runners[i]);
+  }
+  thread_pool_wait(pool);
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_mutex_destroy(&sched.queues[i].mutex);
+  }
+  stats->steal_count = atomic_load(&sched.steal_count);
+  stats->failed_count = atomic_load(&sched.failed_count);
+}
+
+//---- [ORDERED] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+#define TILE_IDLE INT32_MAX
+
+typedef struct {
+  pthread_mutex_t mutex;
+  const filter_func_t *filter_funcs;
+  int32_t filter_count;
+  const thread_filter_args_t *base;
+  int32_t height;
+  int32_t next;                          // prochaine tuile à prendre
+  int32_t current[ABSOLUTE_MAX_THREADS]; // tuile de chaque thread, TILE_IDLE
+  int32_t done;                          // tuiles terminées depuis la tuile 0
+  row_stream_t *stream;
+  int32_t failed_count;
+  tile_stats_t *stats;
+} tile_ordered_t;
+
+typedef struct {
+  tile_ordered_t *sched;
+  int id;
+} tile_ordered_runner_t;
+
+// tile_take: termine, sous le verrou de sched, la tuile en cours du runner id
+// puis lui donne la suivante. Les tuiles terminées depuis la tuile 0 sont
+// signalées au flux. Retourne l'indice de la tuile ou -1 s'il n'y en a plus
+static int32_t tile_take(tile_ordered_t *sched, int id) {
+  int32_t tile_count = sched->stats->tile_count;
+  pthread_mutex_lock(&sched->mutex);
+  int32_t tile = -1;
+  if (sched->next < tile_count &&
+      (sched->base->halo == nullptr ||
+       bmp_halo_capture(sched->base->halo, sched->next + 1) == 0)) {
+    tile = sched->next++;
+  } else if (sched->next < tile_count) {
+    // No boundary copy: the tiles left cannot run beside their neighbours
+    sched->failed_count += tile_count - sched->next;
+    sched->next = tile_count;
+  }
+  sched->current[id] = tile != -1 ? tile : TILE_IDLE;
+
+  // PROGRESS
+  int32_t done = sched->next;
+  for (int i = 0; i < sched->stats->thread_count; ++i) {
+    if (sched->current[i] < done) {
+      done = sched->current[i];
+    }
+  }
+  // A failed tile is never final
+  if (done > sched->done && sched->failed_count == 0) {
+    sched->done = done;
+    int32_t rows = done * sched->stats->tile_rows;
+    row_stream_ready(sched->stream, rows < sched->height ? rows : sched->height);
+  }
+  pthread_mutex_unlock(&sched->mutex);
+  return tile;
+}
+
+// tile_run_ordered: tâche exécutée par chaque thread du pool, traite les
+// tuiles dans l'ordre des lignes jusqu'à épuisement
+static void *tile_run_ordered(void *arg) {
+  tile_ordered_runner_t *runner = (tile_ordered_runner_t *)arg;
+  tile_ordered_t *sched = runner->sched;
+  int32_t tile_rows = sched->stats->tile_rows;
+  thread_filter_args_t args = *sched->base;
+  double busy_ms = 0;
+
+  int32_t tile;
+  while ((tile = tile_take(sched, runner->id)) != -1) {
+    args.start_line = tile * tile_rows;
+    args.end_line = args.start_line + tile_rows;
+    if (args.end_line > sched->height) {
+      args.end_line = sched->height;
+    }
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int32_t f = 0; f < sched->filter_count; f++) {
+      if (sched->filter_funcs[f](&args) != nullptr) {
+        pthread_mutex_lock(&sched->mutex);
+        sched->failed_count++;
+        pthread_mutex_unlock(&sched->mutex);
+        break;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    busy_ms += (double)(end.tv_sec - start.tv_sec) * 1e3 +
+               (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+  }
+
+  free(args.carry);
+  sched->stats->busy_ms[runner->id] = busy_ms;
+  return nullptr;
+}
+
+void tile_scheduler_run_ordered(thread_pool_t *pool,
+                                const filter_func_t *filter_funcs,
+                                int32_t filter_count,
+                                const thread_filter_args_t *base,
+                                int32_t height, int32_t tile_rows,
+                                int thread_count, row_stream_t *stream,
+                                tile_stats_t *stats) {
+  tile_ordered_t sched = {.filter_funcs = filter_funcs,
+                          .filter_count = filter_count,
+                          .base = base,
+                          .height = height,
+                          .stream = stream,
+                          .stats = stats};
+  tile_ordered_runner_t runners[ABSOLUTE_MAX_THREADS];
+  stats->thread_count = thread_count;
+  stats->tile_rows = tile_rows;
+  stats->tile_count = (height + tile_rows - 1) / tile_rows;
+  pthread_mutex_init(&sched.mutex, nullptr);
+  for (int i = 0; i < thread_count; ++i) {
+    sched.current[i] = TILE_IDLE;
+  }
+
+  //---- [RUN               ] ------------------------------------------------//
+  for (int i = 0; i < thread_count; ++i) {
+    runners[i].sched = &sched;
+    runners[i].id = i;
+    thread_pool_submit(pool, tile_run_ordered, &runners[i]);
+  }
+  thread_pool_wait(pool);
+
+  pthread_mutex_destroy(&sched.mutex);
+  stats->steal_count = 0;
+  stats->failed_count = sched.failed_count;
+}
@@ -0,0 +1,80 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "bmp.h"
+#include "config.h"
+#include "row_stream.h"
+#include "thread_pool.h"
+
+// Taille visée pour une tuile (bande de lignes) afin qu'elle tienne dans le
+// cache L2 d'un coeur
+#define TILE_TARGET_SIZE (256 * 1024)
+// Nombre minimum de tuiles par thread pour permettre l'équilibrage
+#define TILE_MIN_PER_THREAD 4
+
+// Ordonnanceur par vol de tâches : l'image est découpée en nombreuses tuiles
+// de tile_rows lignes, réparties équitablement entre les threads. Chaque
+// thread traite ses tuiles depuis le début de sa file puis, une fois sa file
+// vide, vole la moitié des tuiles restantes à la fin de la file d'un autre
+// thread. Un thread lent ou préempté ne retarde ainsi plus toute la requête.
+// Pour une image envoyée pendant son filtrage, les tuiles sont au contraire
+// prises dans l'ordre du fichier dans une file commune (voir
+// tile_scheduler_run_ordered) : les premières lignes sont terminées au plus
+// tôt, sans perdre l'équilibrage.
+
+typedef struct {
+  pthread_mutex_t mutex;
+  int32_t next; // prochaine tuile (inclusif)
+  int32_t end;  // dernière tuile (exclusif)
+} tile_queue_t;
+
+typedef struct {
+  int thread_count;
+  int32_t tile_rows;
+  int32_t tile_count;
+  int32_t steal_count;
+  int32_t failed_count; // tuiles dont le filtre a échoué
+  double busy_ms[ABSOLUTE_MAX_THREADS];
+} tile_stats_t;
+
+// tile_scheduler_tile_rows: calcule la hauteur des tuiles, d'au moins
+// min_rows lignes, pour l'image pointé par img de hauteur height traitée par
+// thread_count threads
+int32_t tile_scheduler_tile_rows(const bmp_mapped_image_t *img,
+                                 int32_t height, int thread_count,
+                                 int32_t min_rows);
+
+// tile_scheduler_run: applique les filter_count fonctions de filtre du tableau
+// filter_funcs, dans l'ordre et tuile par tuile, sur les lignes [0, height) de
+// l'image décrite par base, découpées en tuiles de tile_rows lignes, en
+// utilisant thread_count threads du pool pointé par pool. Seule la première
+// fonction peut lire les lignes voisines d'une tuile (convolution), les
+// suivantes ne doivent lire que les pixels qu'elles modifient.
+// Si base->halo n'est pas nullptr, ses tuiles ont tile_rows lignes et chaque
+// frontière entre les tuiles de deux threads y est copiée avant d'être
+// franchie. Le carry de chaque thread est libéré à la fin de sa dernière
+// tuile. Les statistiques d'exécution (temps d'activité de chaque thread, nombre de
+// vols, nombre de tuiles en échec) sont écrites dans la structure pointé par
+// stats
+void tile_scheduler_run(thread_pool_t *pool, const filter_func_t *filter_funcs,
+                        int32_t filter_count, const thread_filter_args_t *base,
+                        int32_t height, int32_t tile_rows, int thread_count,
+                        tile_stats_t *stats);
+
+// tile_scheduler_run_ordered: comme tile_scheduler_run, mais les threads
+// prennent les tuiles dans l'ordre des lignes et signalent au flux stream les
+// lignes terminées depuis la ligne 0 au fur et à mesure. Si base->halo n'est
+// pas nullptr, chaque frontière est copiée lorsque la tuile qui la précède est
+// prise, avant que l'une ou l'autre des tuiles qui la bordent ne soit modifiée.
+void tile_scheduler_run_ordered(thread_pool_t *pool,
+                                const filter_func_t *filter_funcs,
+                                int32_t filter_count,
+                                const thread_filter_args_t *base,
+                                int32_t height, int32_t tile_rows,
+                                int thread_count, row_stream_t *stream,
+                                tile_stats_t *stats);
+
+#endif
@@ -1,374 +1,307 @@
 #include "bmp.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
-
-// arg est un pointeur vers thread_filter_args_t
-void *identity_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  (void)img;
-  return nullptr;
-}
-
-void *blackAndWhite_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-
-  // REAL SIZE
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  // FOR EACH LINE
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-
-    // FOR EACH PIXEL
-    for (int32_t x = 0; x < width; x++) {
-      uint8_t blue = row[x * 3];
-      uint8_t green = row[x * 3 + 1];
-      uint8_t red = row[x * 3 + 2];
-      uint8_t gray = (uint8_t)(0.299 * red + 0.587 * green + 0.114 * blue);
-      row[x * 3] = gray;
-      row[x * 3 + 1] = gray;
-      row[x * 3 + 2] = gray;
+#include <stdlib.h>
+#include <string.h>
+
+#include "convolution.h"
+#include "point.h"
+
+// channel_lut: remplit lut pour conserver les canaux bleu, vert et rouge
+// indiqués par blue, green et red et mettre les autres à 0
+static void channel_lut(point_lut_t *lut, bool blue, bool green, bool red) {
+  bool keep[3] = {blue, green, red};
+  for (int32_t c = 0; c < 3; c++) {
+    for (int32_t v = 0; v < 256; v++) {
+      lut->table[c][v] = keep[c] ? (uint8_t)v : 0;
     }
   }
-  return nullptr;
 }
 
-// MATRICE CONVOLUTION
-typedef struct {
-  float *matrix;
-  int32_t size; // 3 5
-} convolution_matrix_t;
-
-// apply_convolution : applique la matrice de convolution conv au pixel (x, y)
-// de l'image pointé par img en utilisant l'image de référence pointé par
-// ref_img pour les valeurs des pixels voisins.
-static void apply_convolution(bmp_mapped_image_t *img,
-                              bmp_mapped_image_t *ref_img, int32_t x, int32_t y,
-                              int32_t width, int32_t height, int32_t row_size,
-                              convolution_matrix_t *conv) {
-  int32_t half_size = conv->size / 2;
-  float sum_r = 0, sum_g = 0, sum_b = 0;
-  float weight_sum = 0;
-
-  uint8_t *row_out = (uint8_t *)img->pixels + y * row_size;
-
-  for (int32_t ky = -half_size; ky <= half_size; ky++) {
-    for (int32_t kx = -half_size; kx <= half_size; kx++) {
-      int32_t px = x + kx;
-      int32_t py = y + ky;
-
-      // BORDER
-      if (px < 0) {
-        px = 0;
-      }
-      if (px >= width) {
-        px = width - 1;
-      }
-      if (py < 0) {
-        py = 0;
-      }
-      if (py >= height) {
-        py = height - 1;
-      }
-
-      uint8_t *ref_row = (uint8_t *)ref_img->pixels + py * row_size;
-      uint8_t blue = ref_row[px * 3];
-      uint8_t green = ref_row[px * 3 + 1];
-      uint8_t red = ref_row[px * 3 + 2];
-
-      float weight =
-          conv->matrix[(ky + half_size) * conv->size + (kx + half_size)];
-      sum_b += blue * weight;
-      sum_g += green * weight;
-      sum_r += red * weight;
-      weight_sum += weight;
-    }
-  }
-
-  // NORMALIZE
-  if (weight_sum > 0) {
-    sum_b /= weight_sum;
-    sum_g /= weight_sum;
-    sum_r /= weight_sum;
-  }
-
-  // CLAMPING
-  row_out[x * 3] = (uint8_t)(sum_b < 0 ? 0 : (sum_b > 255 ? 255 : sum_b));
-  row_out[x * 3 + 1] = (uint8_t)(sum_g < 0 ? 0 : (sum_g > 255 ? 255 : sum_g));
-  row_out[x * 3 + 2] = (uint8_t)(sum_r < 0 ? 0 : (sum_r > 255 ? 255 : sum_r));
+// arg est un pointeur vers thread_filter_args_t
+void *identity_filter(void *arg) {
+  point_lut_t lut;
+  channel_lut(&lut, true, true, true);
+  return generic_lut_filter(arg, &lut);
 }
 
-// generic_convolution_filter : applique une matrice de convolution générique
-// conv à l'image pointé par img en utilisant l'image de référence pointé par
-// ref_img pour les valeurs des pixels voisins. Sur les lignes entre
-// start_line et end_line.
-void *generic_convolution_filter(void *arg, convolution_matrix_t *conv) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  bmp_mapped_image_t *ref_img = args->ref_img;
-
-  int32_t width = img->dib_h->width;
-  int32_t height = img->dib_h->height;
-
-  // REAL SIZE
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  // FOR EACH LINE
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-
-    // FOR EACH PIXEL
-    for (int32_t x = 0; x < width; x++) {
-      apply_convolution(img, ref_img, x, y, width, height, row_size, conv);
-    }
-  }
-
-  return nullptr;
+void *blackAndWhite_filter(void *arg) {
+  // gray = 0.299 * red + 0.587 * green + 0.114 * blue
+  point_matrix_t matrix = {
+      .matrix = {{114, 587, 299}, {114, 587, 299}, {114, 587, 299}}};
+  return generic_matrix_filter(arg, &matrix);
 }
 
 void *blurbox_filter(void *arg) {
-  float matrix_data[9] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+  int16_t row[3] = {1, 1, 1};
+  int16_t col[3] = {1, 1, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *gaussian_blur_filter(void *arg) {
-  float matrix_data[9] = {1.0f, 2.0f, 1.0f, 2.0f, 4.0f, 2.0f, 1.0f, 2.0f, 1.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+  int16_t row[3] = {1, 2, 1};
+  int16_t col[3] = {1, 2, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *gaussian_blur5x5_filter(void *arg) {
-  float matrix_data[25] = {1.0f,  4.0f,  6.0f,  4.0f,  1.0f,  4.0f,  16.0f,
-                           24.0f, 16.0f, 4.0f,  6.0f,  24.0f, 36.0f, 24.0f,
-                           6.0f,  4.0f,  16.0f, 24.0f, 16.0f, 4.0f,  1.0f,
-                           4.0f,  6.0f,  4.0f,  1.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 5};
+  int16_t matrix_data[25] = {1, 4, 6, 4, 1, 4, 16, 24, 16, 4, 6, 24, 36, 24, 6,
+                             4, 16, 24, 16, 4, 1, 4, 6, 4, 1};
+  int16_t row[5] = {1, 4, 6, 4, 1};
+  int16_t col[5] = {1, 4, 6, 4, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 5, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *sharpen_filter(void *arg) {
-  float matrix_data[9] = {0.0f,  -1.0f, 0.0f,  -1.0f, 5.0f,
-                          -1.0f, 0.0f,  -1.0f, 0.0f};
+  int16_t matrix_data[9] = {0, -1, 0, -1, 5, -1, 0, -1, 0};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *sharpen_intense_filter(void *arg) {
-  float matrix_data[9] = {-1.0f, -1.0f, -1.0f, -1.0f, 9.0f,
-                          -1.0f, -1.0f, -1.0f, -1.0f};
+  int16_t matrix_data[9] = {-1, -1, -1, -1, 9, -1, -1, -1, -1};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *edge_detect_filter(void *arg) {
-  float matrix_data[9] = {-1.0f, -1.0f, -1.0f, -1.0f, 8.0f,
-                          -1.0f, -1.0f, -1.0f, -1.0f};
+  int16_t matrix_data[9] = {-1, -1, -1, -1, 8, -1, -1, -1, -1};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *sobel_horizontal_filter(void *arg) {
-  float matrix_data[9] = {-1.0f, -2.0f, -1.0f, 0.0f, 0.0f,
-                          0.0f,  1.0f,  2.0f,  1.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+  int16_t row[3] = {1, 2, 1};
+  int16_t col[3] = {-1, 0, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *sobel_vertical_filter(void *arg) {
-  float matrix_data[9] = {-1.0f, 0.0f,  1.0f, -2.0f, 0.0f,
-                          2.0f,  -1.0f, 0.0f, 1.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+  int16_t row[3] = {-1, 0, 1};
+  int16_t col[3] = {1, 2, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *laplacian_filter(void *arg) {
-  float matrix_data[9] = {0.0f, 1.0f, 0.0f, 1.0f, -4.0f,
-                          1.0f, 0.0f, 1.0f, 0.0f};
+  int16_t matrix_data[9] = {0, 1, 0, 1, -4, 1, 0, 1, 0};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *emboss_filter(void *arg) {
-  float matrix_data[9] = {-2.0f, -1.0f, 0.0f, -1.0f, 1.0f,
-                          1.0f,  0.0f,  1.0f, 2.0f};
+  int16_t matrix_data[9] = {-2, -1, 0, -1, 1, 1, 0, 1, 2};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *emboss_intense_filter(void *arg) {
-  float matrix_data[9] = {-4.0f, -2.0f, 0.0f, -2.0f, 1.0f,
-                          2.0f,  0.0f,  2.0f, 4.0f};
+  int16_t matrix_data[9] = {-4, -2, 0, -2, 1, 2, 0, 2, 4};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *motion_blur_filter(void *arg) {
-  float matrix_data[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  int16_t matrix_data[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *motion_blur_horizontal_filter(void *arg) {
-  float matrix_data[9] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {0, 0, 0, 1, 1, 1, 0, 0, 0};
+  int16_t row[3] = {1, 1, 1};
+  int16_t col[3] = {0, 1, 0};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *motion_blur_vertical_filter(void *arg) {
-  float matrix_data[9] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
-  convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
+  int16_t matrix_data[9] = {0, 1, 0, 0, 1, 0, 0, 1, 0};
+  int16_t row[3] = {0, 1, 0};
+  int16_t col[3] = {1, 1, 1};
+  convolution_matrix_t conv = {
+      .matrix = matrix_data, .size = 3, .row = row, .col = col};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *oil_painting_filter(void *arg) {
-  float matrix_data[25] = {1.0f, 2.0f, 3.0f, 2.0f, 1.0f, 2.0f, 4.0f, 5.0f, 4.0f,
-                           2.0f, 3.0f, 5.0f, 6.0f, 5.0f, 3.0f, 2.0f, 4.0f, 5.0f,
-                           4.0f, 2.0f, 1.0f, 2.0f, 3.0f, 2.0f, 1.0f};
+  int16_t matrix_data[25] = {1, 2, 3, 2, 1, 2, 4, 5, 4, 2, 3, 5, 6, 5, 3, 2, 4,
+                             5, 4, 2, 1, 2, 3, 2, 1};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 5};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *crosshatch_filter(void *arg) {
-  float matrix_data[9] = {1.0f, 1.0f, 1.0f, 1.0f, -7.0f,
-                          1.0f, 1.0f, 1.0f, 1.0f};
+  int16_t matrix_data[9] = {1, 1, 1, 1, -7, 1, 1, 1, 1};
   convolution_matrix_t conv = {.matrix = matrix_data, .size = 3};
   return generic_convolution_filter(arg, &conv);
 }
 
 void *red_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3] = 0;
-      row[x * 3 + 1] = 0;
-    }
-  }
-  return nullptr;
+  point_lut_t lut;
+  channel_lut(&lut, false, false, true);
+  return generic_lut_filter(arg, &lut);
 }
 
 void *green_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3] = 0;
-      row[x * 3 + 2] = 0;
-    }
-  }
-  return nullptr;
+  point_lut_t lut;
+  channel_lut(&lut, false, true, false);
+  return generic_lut_filter(arg, &lut);
 }
 
 void *blue_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3 + 1] = 0;
-      row[x * 3 + 2] = 0;
-    }
-  }
-  return nullptr;
+  point_lut_t lut;
+  channel_lut(&lut, true, false, false);
+  return generic_lut_filter(arg, &lut);
 }
 
 void *cyan_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3 + 2] = 0;
-    }
-  }
-  return nullptr;
+  point_lut_t lut;
+  channel_lut(&lut, true, true, false);
+  return generic_lut_filter(arg, &lut);
 }
 
 void *magenta_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+  point_lut_t lut;
+  channel_lut(&lut, true, false, true);
+  return generic_lut_filter(arg, &lut);
+}
 
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3 + 1] = 0;
-    }
+void *yellow_filter(void *arg) {
+  point_lut_t lut;
+  channel_lut(&lut, false, true, true);
+  return generic_lut_filter(arg, &lut);
+}
+
+void *sepia_filter(void *arg) {
+  // red = 0.393 * red + 0.769 * green + 0.189 * blue
+  // green = 0.349 * red + 0.686 * green + 0.168 * blue
+  // blue = 0.272 * red + 0.534 * green + 0.131 * blue
+  point_matrix_t matrix = {
+      .matrix = {{131, 534, 272}, {168, 686, 349}, {189, 769, 393}}};
+  return generic_matrix_filter(arg, &matrix);
+}
+
+void *invert_filter(void *arg) {
+  point_lut_t lut;
+  for (int32_t v = 0; v < 256; v++) {
+    lut.table[0][v] = (uint8_t)(255 - v);
+    lut.table[1][v] = (uint8_t)(255 - v);
+    lut.table[2][v] = (uint8_t)(255 - v);
   }
-  return nullptr;
+  return generic_lut_filter(arg, &lut);
 }
 
-void *yellow_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
+bool bmp_headers_valid(const bmp_file_header_t *file_h,
+                       const bmp_dib_header_t *dib_h, size_t size) {
+  size_t headers_size = sizeof(*file_h) + sizeof(*dib_h);
+  if (size < headers_size || file_h->signature != BMP_SIGNATURE) {
+    return false;
+  }
+  // Row sizes are computed on 32 bits by the filters, -height must exist
+  if (dib_h->width <= 0 || dib_h->width > (INT32_MAX - 3) / 3 ||
+      dib_h->height == 0 || dib_h->height == INT32_MIN) {
+    return false;
+  }
+  size_t row_size = (((size_t)dib_h->width * 3 + 3) / 4) * 4;
+  size_t height =
+      (size_t)(dib_h->height > 0 ? dib_h->height : -dib_h->height);
+  size_t pixels = file_h->pixel_array_offset;
+  return pixels >= headers_size && pixels <= size &&
+         height <= (size - pixels) / row_size;
+}
+
+int bmp_halo_init(bmp_halo_t *halo, const bmp_mapped_image_t *img,
+                  int32_t height, int32_t band_rows, int32_t halo_rows) {
   int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+  int32_t band_count = (height + band_rows - 1) / band_rows;
+
+  *halo = (bmp_halo_t){.pixels = img->pixels,
+                       .boundaries = nullptr,
+                       .halo = halo_rows,
+                       .band_rows = band_rows,
+                       .band_count = band_count,
+                       .height = height,
+                       .row_size = ((width * 3 + 3) / 4) * 4};
+  halo->boundaries = calloc((size_t)band_count + 1, sizeof(uint8_t *));
+  if (halo->boundaries == nullptr) {
+    return -1;
+  }
+  if (bmp_halo_capture(halo, 0) == -1 ||
+      bmp_halo_capture(halo, band_count) == -1) {
+    bmp_halo_dispose(halo);
+    return -1;
+  }
+  return 0;
+}
 
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3] = 0;
+int bmp_halo_capture(bmp_halo_t *halo, int32_t band) {
+  if (halo->halo == 0 || halo->boundaries[band] != nullptr) {
+    return 0;
+  }
+  uint8_t *rows = malloc(2 * (size_t)halo->halo * (size_t)halo->row_size);
+  if (rows == nullptr) {
+    return -1;
+  }
+  int32_t boundary =
+      band < halo->band_count ? band * halo->band_rows : halo->height;
+  for (int32_t i = 0; i < 2 * halo->halo; i++) {
+    int32_t row = boundary - halo->halo + i;
+    if (row < 0 || row >= halo->height) {
+      continue;
     }
+    memcpy(rows + (size_t)i * (size_t)halo->row_size,
+           halo->pixels + (size_t)row * (size_t)halo->row_size,
+           (size_t)halo->row_size);
   }
-  return nullptr;
+  halo->boundaries[band] = rows;
+  return 0;
 }
 
-void *sepia_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      uint8_t blue = row[x * 3];
-      uint8_t green = row[x * 3 + 1];
-      uint8_t red = row[x * 3 + 2];
-
-      int32_t new_red = (int32_t)(0.393 * red + 0.769 * green + 0.189 * blue);
-      int32_t new_green = (int32_t)(0.349 * red + 0.686 * green + 0.168 * blue);
-      int32_t new_blue = (int32_t)(0.272 * red + 0.534 * green + 0.131 * blue);
-
-      row[x * 3] = (uint8_t)(new_blue > 255 ? 255 : new_blue);
-      row[x * 3 + 1] = (uint8_t)(new_green > 255 ? 255 : new_green);
-      row[x * 3 + 2] = (uint8_t)(new_red > 255 ? 255 : new_red);
-    }
+const uint8_t *bmp_halo_row(const bmp_halo_t *halo, int32_t row) {
+  if (halo == nullptr || row < 0 || row >= halo->height) {
+    return nullptr;
+  }
+  // NEAREST BOUNDARY
+  int32_t band = (row + halo->halo) / halo->band_rows;
+  int32_t boundary = band * halo->band_rows;
+  if (band < halo->band_count && halo->boundaries[band] != nullptr &&
+      row < boundary + halo->halo) {
+    return halo->boundaries[band] +
+           (size_t)(row - boundary + halo->halo) * (size_t)halo->row_size;
+  }
+  // END OF IMAGE
+  boundary = halo->height;
+  if (halo->boundaries[halo->band_count] != nullptr &&
+      row >= boundary - halo->halo) {
+    return halo->boundaries[halo->band_count] +
+           (size_t)(row - boundary + halo->halo) * (size_t)halo->row_size;
   }
   return nullptr;
 }
 
-void *invert_filter(void *arg) {
-  thread_filter_args_t *args = (thread_filter_args_t *)arg;
-  bmp_mapped_image_t *img = args->img;
-  int32_t width = img->dib_h->width;
-  int32_t row_size = ((width * 3 + 3) / 4) * 4;
-
-  for (int32_t y = args->start_line; y < args->end_line; y++) {
-    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
-    for (int32_t x = 0; x < width; x++) {
-      row[x * 3] = 255 - row[x * 3];
-      row[x * 3 + 1] = 255 - row[x * 3 + 1];
-      row[x * 3 + 2] = 255 - row[x * 3 + 2];
-    }
+void bmp_halo_dispose(bmp_halo_t *halo) {
+  if (halo->boundaries == nullptr) {
+    return;
   }
-  return nullptr;
-}
\ No newline at end of file
+  for (int32_t band = 0; band <= halo->band_count; band++) {
+    free(halo->boundaries[band]);
+  }
+  free(halo->boundaries);
+  halo->boundaries = nullptr;
+}
@@ -0,0 +1,762 @@
+#include "convolution.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmp.h"
+
+//---- [FIXED POINT] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les poids des matrices étant entiers, les sommes sont calculées en entiers
+// 32 bits. La normalisation par la somme des poids d (lorsqu'elle est
+// positive) remplace la division par une multiplication par un inverse
+// précalculé suivie d'un décalage : pour n dans [0, 255 * d],
+// n / d == (n * mul) >> shift. Une somme négative donne 0 et une somme
+// supérieure à 255 * d donne 255, comme le faisait la division flottante.
+
+typedef struct {
+  int32_t max_sum; // 255 * d (ou 255 sans normalisation)
+  int32_t divisor; // d, ou 1 sans normalisation
+  uint32_t mul;    // 0 si aucun inverse sur 32 bits n'existe
+  int32_t shift;
+} normalization_t;
+
+// compute_normalization: précalcule dans norm l'inverse de weight_sum
+// permettant de normaliser toute somme de [0, 255 * weight_sum] sans division.
+// On cherche le plus petit décalage shift tel que mul = ceil(2^shift / d)
+// vérifie (mul * d - 2^shift) * 255 * d < 2^shift, condition suffisante pour
+// que (n * mul) >> shift == n / d. Si le produit déborde 32 bits, mul vaut 0
+// et la normalisation se fait par division entière.
+static void compute_normalization(int32_t weight_sum, normalization_t *norm) {
+  if (weight_sum <= 1) {
+    *norm = (normalization_t){
+        .max_sum = 255, .divisor = 1, .mul = 1, .shift = 0};
+    return;
+  }
+  uint64_t divisor = (uint64_t)weight_sum;
+  uint64_t max_sum = 255 * divisor;
+  *norm = (normalization_t){
+      .max_sum = (int32_t)max_sum, .divisor = weight_sum, .mul = 0};
+  for (int32_t shift = 0; shift < 48; shift++) {
+    uint64_t power = (uint64_t)1 << shift;
+    uint64_t mul = (power + divisor - 1) / divisor;
+    if ((mul * divisor - power) * max_sum < power) {
+      if (mul <= UINT32_MAX / max_sum) {
+        norm->mul = (uint32_t)mul;
+        norm->shift = shift;
+      }
+      return;
+    }
+  }
+}
+
+//---- [SIMD KERNELS] --------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les noyaux traitent une ligne BGR 24 bits comme une suite de valeurs de
+// canaux : la valeur i de la sortie est la somme pondérée des valeurs i des
+// lignes sources, chaque tap étant décalé de 3 * kx octets. Les taps sont
+// groupés par paires (tap_count est pair, un tap de poids nul complète la
+// dernière paire) : les versions SSE4.1 et AVX2 entrelacent les valeurs 16 bits
+// des deux sources d'une paire et calculent les deux produits et leur somme en
+// une seule instruction pmaddwd, 16 canaux par itération. La version générique
+// sert de repli et traite aussi les normalisations sans inverse.
+
+#define SIMD_LANES 16
+#define MAX_TAPS 26 // 25 taps arrondis à un nombre pair
+
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// normalize: normalise la somme sum selon norm et la ramène dans [0, 255]
+KERNEL_INLINE uint8_t normalize(int32_t sum, const normalization_t *norm) {
+  if (sum <= 0) {
+    return 0;
+  }
+  if (sum >= norm->max_sum) {
+    return 255;
+  }
+  if (norm->mul == 0) {
+    return (uint8_t)(sum / norm->divisor);
+  }
+  return (uint8_t)(((uint32_t)sum * norm->mul) >> norm->shift);
+}
+
+// convolve_tail: out[i] = normalize(somme(weights[k] * srcs[k][i])) pour i
+// dans [begin, end)
+KERNEL_INLINE void convolve_tail(uint8_t *out, const uint8_t *const *srcs,
+                                 const int16_t *weights, int32_t tap_count,
+                                 size_t begin, size_t end,
+                                 const normalization_t *norm) {
+  for (size_t i = begin; i < end; i++) {
+    int32_t sum = 0;
+    for (int32_t k = 0; k < tap_count; k++) {
+      sum += srcs[k][i] * weights[k];
+    }
+    out[i] = normalize(sum, norm);
+  }
+}
+
+// hpass_tail: out[i] = somme(weights[k] * srcs[k][i]) pour i dans
+// [begin, end), sans normalisation
+KERNEL_INLINE void hpass_tail(int16_t *out, const uint8_t *const *srcs,
+                              const int16_t *weights, int32_t tap_count,
+                              size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    int32_t sum = 0;
+    for (int32_t k = 0; k < tap_count; k++) {
+      sum += srcs[k][i] * weights[k];
+    }
+    out[i] = (int16_t)sum;
+  }
+}
+
+// vpass_tail: out[i] = normalize(somme(weights[k] * lines[k][i])) pour i dans
+// [begin, end)
+KERNEL_INLINE void vpass_tail(uint8_t *out, const int16_t *const *lines,
+                              const int16_t *weights, int32_t tap_count,
+                              size_t begin, size_t end,
+                              const normalization_t *norm) {
+  for (size_t i = begin; i < end; i++) {
+    int32_t sum = 0;
+    for (int32_t k = 0; k < tap_count; k++) {
+      sum += lines[k][i] * weights[k];
+    }
+    out[i] = normalize(sum, norm);
+  }
+}
+
+typedef struct {
+  void (*convolve)(uint8_t *, const uint8_t *const *, const int16_t *, int32_t,
+                   size_t, size_t, const normalization_t *);
+  void (*hpass)(int16_t *, const uint8_t *const *, const int16_t *, int32_t,
+                size_t, size_t);
+  void (*vpass)(uint8_t *, const int16_t *const *, const int16_t *, int32_t,
+                size_t, size_t, const normalization_t *);
+} convolution_kernels_t;
+
+// GENERIC
+static void convolve_generic(uint8_t *out, const uint8_t *const *srcs,
+                             const int16_t *weights, int32_t tap_count,
+                             size_t begin, size_t end,
+                             const normalization_t *norm) {
+  convolve_tail(out, srcs, weights, tap_count, begin, end, norm);
+}
+
+static void hpass_generic(int16_t *out, const uint8_t *const *srcs,
+                          const int16_t *weights, int32_t tap_count,
+                          size_t begin, size_t end) {
+  hpass_tail(out, srcs, weights, tap_count, begin, end);
+}
+
+static void vpass_generic(uint8_t *out, const int16_t *const *lines,
+                          const int16_t *weights, int32_t tap_count,
+                          size_t begin, size_t end,
+                          const normalization_t *norm) {
+  vpass_tail(out, lines, weights, tap_count, begin, end, norm);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define SSE41 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+// weight_pair: poids des taps k et k + 1 regroupés pour pmaddwd
+KERNEL_INLINE int32_t weight_pair(const int16_t *weights, int32_t k) {
+  return (int32_t)((uint32_t)(uint16_t)weights[k] |
+                   ((uint32_t)(uint16_t)weights[k + 1] << 16));
+}
+
+// SSE4.1
+// sse41_madd_bytes: ajoute à acc les sommes pondérées par w des 16 octets
+// pointés par a et b
+SSE41 KERNEL_INLINE void sse41_madd_bytes(__m128i acc[4], const uint8_t *a,
+                                          const uint8_t *b, __m128i w) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i va = _mm_loadu_si128((const __m128i *)a);
+  __m128i vb = _mm_loadu_si128((const __m128i *)b);
+  __m128i low = _mm_unpacklo_epi8(va, vb);
+  __m128i high = _mm_unpackhi_epi8(va, vb);
+  acc[0] = _mm_add_epi32(acc[0],
+                         _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), w));
+  acc[1] = _mm_add_epi32(acc[1],
+                         _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), w));
+  acc[2] = _mm_add_epi32(acc[2],
+                         _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), w));
+  acc[3] = _mm_add_epi32(acc[3],
+                         _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), w));
+}
+
+// sse41_store: normalise selon norm les 16 sommes acc puis les écrit dans out
+SSE41 KERNEL_INLINE void sse41_store(uint8_t *out, __m128i acc[4],
+                                     const normalization_t *norm) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i max_sum = _mm_set1_epi32(norm->max_sum);
+  __m128i mul = _mm_set1_epi32((int32_t)norm->mul);
+  __m128i shift = _mm_cvtsi32_si128(norm->shift);
+  for (int j = 0; j < 4; j++) {
+    acc[j] = _mm_min_epi32(_mm_max_epi32(acc[j], zero), max_sum);
+    if (norm->mul != 1) {
+      acc[j] = _mm_mullo_epi32(acc[j], mul);
+    }
+    acc[j] = _mm_srl_epi32(acc[j], shift);
+  }
+  __m128i low = _mm_packs_epi32(acc[0], acc[1]);
+  __m128i high = _mm_packs_epi32(acc[2], acc[3]);
+  _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(low, high));
+}
+
+SSE41 static void convolve_sse41(uint8_t *out, const uint8_t *const *srcs,
+                                 const int16_t *weights, int32_t tap_count,
+                                 size_t begin, size_t end,
+                                 const normalization_t *norm) {
+  size_t i = begin;
+  for (; norm->mul != 0 && i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(),
+                      _mm_setzero_si128(), _mm_setzero_si128()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m128i w = _mm_set1_epi32(weight_pair(weights, k));
+      sse41_madd_bytes(acc, srcs[k] + i, srcs[k + 1] + i, w);
+    }
+    sse41_store(out + i, acc, norm);
+  }
+  convolve_tail(out, srcs, weights, tap_count, i, end, norm);
+}
+
+SSE41 static void hpass_sse41(int16_t *out, const uint8_t *const *srcs,
+                              const int16_t *weights, int32_t tap_count,
+                              size_t begin, size_t end) {
+  size_t i = begin;
+  for (; i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(),
+                      _mm_setzero_si128(), _mm_setzero_si128()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m128i w = _mm_set1_epi32(weight_pair(weights, k));
+      sse41_madd_bytes(acc, srcs[k] + i, srcs[k + 1] + i, w);
+    }
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(acc[0], acc[1]));
+    _mm_storeu_si128((__m128i *)(out + i + 8),
+                     _mm_packs_epi32(acc[2], acc[3]));
+  }
+  hpass_tail(out, srcs, weights, tap_count, i, end);
+}
+
+SSE41 static void vpass_sse41(uint8_t *out, const int16_t *const *lines,
+                              const int16_t *weights, int32_t tap_count,
+                              size_t begin, size_t end,
+                              const normalization_t *norm) {
+  size_t i = begin;
+  for (; norm->mul != 0 && i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(),
+                      _mm_setzero_si128(), _mm_setzero_si128()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m128i w = _mm_set1_epi32(weight_pair(weights, k));
+      for (int j = 0; j < 2; j++) {
+        __m128i a =
+            _mm_loadu_si128((const __m128i *)(lines[k] + i + 8 * (size_t)j));
+        __m128i b = _mm_loadu_si128(
+            (const __m128i *)(lines[k + 1] + i + 8 * (size_t)j));
+        acc[2 * j] = _mm_add_epi32(acc[2 * j],
+                                   _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+        acc[2 * j + 1] = _mm_add_epi32(
+            acc[2 * j + 1], _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+      }
+    }
+    sse41_store(out + i, acc, norm);
+  }
+  vpass_tail(out, lines, weights, tap_count, i, end, norm);
+}
+
+// AVX2
+// Les instructions d'entrelacement AVX2 opèrent par moitiés de 128 bits : acc[0]
+// reçoit les canaux 0-3 et 8-11, acc[1] les canaux 4-7 et 12-15, ce que
+// l'empaquetage final (lui aussi par moitiés) remet dans l'ordre.
+
+// avx2_madd_words: ajoute à acc les sommes pondérées par w des 16 valeurs
+// 16 bits a et b
+AVX2 KERNEL_INLINE void avx2_madd_words(__m256i acc[2], __m256i a, __m256i b,
+                                        __m256i w) {
+  acc[0] = _mm256_add_epi32(acc[0],
+                            _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+  acc[1] = _mm256_add_epi32(acc[1],
+                            _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+}
+
+// avx2_load_bytes: étend en valeurs 16 bits les 16 octets pointés par src
+AVX2 KERNEL_INLINE __m256i avx2_load_bytes(const uint8_t *src) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)src));
+}
+
+// avx2_store: normalise selon norm les 16 sommes acc puis les écrit dans out
+AVX2 KERNEL_INLINE void avx2_store(uint8_t *out, __m256i acc[2],
+                                   const normalization_t *norm) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i max_sum = _mm256_set1_epi32(norm->max_sum);
+  __m256i mul = _mm256_set1_epi32((int32_t)norm->mul);
+  __m128i shift = _mm_cvtsi32_si128(norm->shift);
+  for (int j = 0; j < 2; j++) {
+    acc[j] = _mm256_min_epi32(_mm256_max_epi32(acc[j], zero), max_sum);
+    if (norm->mul != 1) {
+      acc[j] = _mm256_mullo_epi32(acc[j], mul);
+    }
+    acc[j] = _mm256_srl_epi32(acc[j], shift);
+  }
+  __m256i words = _mm256_packs_epi32(acc[0], acc[1]);
+  _mm_storeu_si128((__m128i *)out,
+                   _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                    _mm256_extracti128_si256(words, 1)));
+}
+
+AVX2 static void convolve_avx2(uint8_t *out, const uint8_t *const *srcs,
+                               const int16_t *weights, int32_t tap_count,
+                               size_t begin, size_t end,
+                               const normalization_t *norm) {
+  size_t i = begin;
+  for (; norm->mul != 0 && i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m256i acc[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m256i w = _mm256_set1_epi32(weight_pair(weights, k));
+      avx2_madd_words(acc, avx2_load_bytes(srcs[k] + i),
+                      avx2_load_bytes(srcs[k + 1] + i), w);
+    }
+    avx2_store(out + i, acc, norm);
+  }
+  convolve_tail(out, srcs, weights, tap_count, i, end, norm);
+}
+
+AVX2 static void hpass_avx2(int16_t *out, const uint8_t *const *srcs,
+                            const int16_t *weights, int32_t tap_count,
+                            size_t begin, size_t end) {
+  size_t i = begin;
+  for (; i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m256i acc[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m256i w = _mm256_set1_epi32(weight_pair(weights, k));
+      avx2_madd_words(acc, avx2_load_bytes(srcs[k] + i),
+                      avx2_load_bytes(srcs[k + 1] + i), w);
+    }
+    _mm256_storeu_si256((__m256i *)(out + i),
+                        _mm256_packs_epi32(acc[0], acc[1]));
+  }
+  hpass_tail(out, srcs, weights, tap_count, i, end);
+}
+
+AVX2 static void vpass_avx2(uint8_t *out, const int16_t *const *lines,
+                            const int16_t *weights, int32_t tap_count,
+                            size_t begin, size_t end,
+                            const normalization_t *norm) {
+  size_t i = begin;
+  for (; norm->mul != 0 && i + SIMD_LANES <= end; i += SIMD_LANES) {
+    __m256i acc[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int32_t k = 0; k < tap_count; k += 2) {
+      __m256i w = _mm256_set1_epi32(weight_pair(weights, k));
+      avx2_madd_words(
+          acc, _mm256_loadu_si256((const __m256i *)(lines[k] + i)),
+          _mm256_loadu_si256((const __m256i *)(lines[k + 1] + i)), w);
+    }
+    avx2_store(out + i, acc, norm);
+  }
+  vpass_tail(out, lines, weights, tap_count, i, end, norm);
+}
+#endif
+
+static convolution_kernels_t kernels = {.convolve = convolve_generic,
+                                        .hpass = hpass_generic,
+                                        .vpass = vpass_generic};
+
+// select_kernels: choisit au démarrage du programme les noyaux correspondant
+// au meilleur jeu d'instructions supporté par le processeur
+__attribute__((constructor)) static void select_kernels(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels = (convolution_kernels_t){
+        .convolve = convolve_avx2, .hpass = hpass_avx2, .vpass = vpass_avx2};
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    kernels = (convolution_kernels_t){
+        .convolve = convolve_sse41, .hpass = hpass_sse41, .vpass = vpass_sse41};
+  }
+#endif
+}
+
+//---- [SOURCE ROWS] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les filtres écrivent directement dans l'image : avant d'écrire la ligne y,
+// sa valeur d'origine est sauvegardée dans un tampon circulaire de
+// BMP_MAX_HALO + 1 lignes conservé d'une bande à la suivante du même thread
+// (args->carry). Les lignes suivantes de la bande sont encore intactes dans
+// l'image et les lignes des bandes d'autres threads sont lues dans les halos.
+// La mémoire utilisée par thread est ainsi de l'ordre de largeur * taille de la
+// matrice au lieu d'une copie complète de l'image.
+
+#define SAVED_ROWS (BMP_MAX_HALO + 1)
+
+typedef struct {
+  int32_t row_size;
+  int32_t low;  // première ligne sauvegardée depuis le début de la série
+  int32_t next; // première ligne non sauvegardée
+  uint8_t rows[];
+} saved_rows_t;
+
+typedef struct {
+  uint8_t *pixels;
+  int32_t row_size;
+  int32_t start_line;
+  int32_t end_line;
+  const bmp_halo_t *halo;
+  saved_rows_t *saved;
+} source_rows_t;
+
+// source_rows_init: prépare dans src la lecture des lignes d'origine pour la
+// bande décrite par args, en reprenant le tampon de la bande précédente si
+// elle se terminait à start_line. Renvoie -1 si le tampon n'a pas pu être
+// alloué.
+static int source_rows_init(source_rows_t *src, thread_filter_args_t *args,
+                            int32_t row_size) {
+  saved_rows_t *saved = args->carry;
+  if (saved == nullptr || saved->row_size != row_size) {
+    free(saved);
+    saved = malloc(sizeof(saved_rows_t) + SAVED_ROWS * (size_t)row_size);
+    args->carry = saved;
+    if (saved == nullptr) {
+      return -1;
+    }
+    saved->row_size = row_size;
+    saved->next = -1;
+  }
+  if (saved->next != args->start_line) {
+    saved->low = args->start_line;
+    saved->next = args->start_line;
+  }
+  *src = (source_rows_t){.pixels = args->img->pixels,
+                         .row_size = row_size,
+                         .start_line = args->start_line,
+                         .end_line = args->end_line,
+                         .halo = args->halo,
+                         .saved = saved};
+  return 0;
+}
+
+// source_row: renvoie la valeur d'origine de la ligne row de l'image
+static const uint8_t *source_row(const source_rows_t *src, int32_t row) {
+  const saved_rows_t *saved = src->saved;
+  if (row < saved->next && row >= saved->low &&
+      row >= saved->next - SAVED_ROWS) {
+    return saved->rows + (size_t)(row % SAVED_ROWS) * (size_t)src->row_size;
+  }
+  // Outside the band, or already overwritten without being kept (wrap
+  // reading row 0 from the end of a band holding the whole image)
+  if (row < src->start_line || row >= src->end_line || row < saved->next) {
+    const uint8_t *copy = bmp_halo_row(src->halo, row);
+    if (copy != nullptr) {
+      return copy;
+    }
+  }
+  return src->pixels + (size_t)row * (size_t)src->row_size;
+}
+
+// source_save: sauvegarde la ligne y de la bande avant qu'elle soit écrasée
+static void source_save(source_rows_t *src, int32_t y) {
+  memcpy(src->saved->rows + (size_t)(y % SAVED_ROWS) * (size_t)src->row_size,
+         src->pixels + (size_t)y * (size_t)src->row_size,
+         (size_t)src->row_size);
+  src->saved->next = y + 1;
+}
+
+//---- [SCALAR PATH] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Le chemin scalaire ne traite que les pixels dont le voisinage sort de
+// l'image. Chaque coordonnée voisine y est ramenée dans l'image selon la
+// politique de bord.
+
+// border_index: ramène la coordonnée p dans [0, n) selon la politique border.
+// Renvoie -1 si le voisin doit compter pour 0 (BORDER_ZERO).
+static int32_t border_index(int32_t p, int32_t n, border_policy_t border) {
+  if (p >= 0 && p < n) {
+    return p;
+  }
+  switch (border) {
+  case BORDER_MIRROR: {
+    if (n == 1) {
+      return 0;
+    }
+    int32_t period = 2 * (n - 1);
+    p = abs(p) % period;
+    return p < n ? p : period - p;
+  }
+  case BORDER_WRAP:
+    p %= n;
+    return p < 0 ? p + n : p;
+  case BORDER_ZERO:
+    return -1;
+  case BORDER_CLAMP:
+  default:
+    return p < 0 ? 0 : n - 1;
+  }
+}
+
+// apply_convolution : applique la matrice de convolution conv au pixel x de la
+// ligne row_out en utilisant les lignes sources rows (une par ligne de la
+// matrice, nullptr pour une ligne hors de l'image comptant pour 0) pour les
+// valeurs des pixels voisins.
+static void apply_convolution(uint8_t *row_out, const uint8_t *const *rows,
+                              int32_t x, int32_t width,
+                              convolution_matrix_t *conv,
+                              const normalization_t *norm,
+                              border_policy_t border) {
+  int32_t half_size = conv->size / 2;
+  int32_t sum_r = 0, sum_g = 0, sum_b = 0;
+
+  for (int32_t ky = 0; ky < conv->size; ky++) {
+    if (rows[ky] == nullptr) {
+      continue;
+    }
+    for (int32_t kx = 0; kx < conv->size; kx++) {
+      // BORDER
+      int32_t px = border_index(x + kx - half_size, width, border);
+      if (px < 0) {
+        continue;
+      }
+      int32_t weight = conv->matrix[ky * conv->size + kx];
+      sum_b += rows[ky][px * 3] * weight;
+      sum_g += rows[ky][px * 3 + 1] * weight;
+      sum_r += rows[ky][px * 3 + 2] * weight;
+    }
+  }
+
+  // NORMALIZE
+  row_out[x * 3] = normalize(sum_b, norm);
+  row_out[x * 3 + 1] = normalize(sum_g, norm);
+  row_out[x * 3 + 2] = normalize(sum_r, norm);
+}
+
+// horizontal_pass : applique le vecteur ligne row de taille size aux pixels
+// [x_start, x_end) de la ligne src de largeur width avec la politique de bord
+// border et écrit les sommes obtenues pour chaque canal dans dst
+static void horizontal_pass(const uint8_t *src, int16_t *dst, int32_t width,
+                            int32_t x_start, int32_t x_end, const int16_t *row,
+                            int32_t size, border_policy_t border) {
+  int32_t half_size = size / 2;
+  for (int32_t x = x_start; x < x_end; x++) {
+    int32_t sum_b = 0, sum_g = 0, sum_r = 0;
+    for (int32_t k = 0; k < size; k++) {
+      // BORDER
+      int32_t px = border_index(x + k - half_size, width, border);
+      if (px < 0) {
+        continue;
+      }
+      sum_b += src[px * 3] * row[k];
+      sum_g += src[px * 3 + 1] * row[k];
+      sum_r += src[px * 3 + 2] * row[k];
+    }
+    dst[x * 3] = (int16_t)sum_b;
+    dst[x * 3 + 1] = (int16_t)sum_g;
+    dst[x * 3 + 2] = (int16_t)sum_r;
+  }
+}
+
+//---- [FILTERS] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// separable_convolution_filter : applique la matrice de convolution séparable
+// conv en deux passes, horizontale (conv->row) puis verticale (conv->col), ce
+// qui réduit le nombre de multiplications par canal de size * size à 2 * size.
+// Les size dernières lignes filtrées horizontalement sont conservées dans un
+// tampon circulaire de valeurs 16 bits. Le résultat est identique à celui de la
+// convolution 2D. Retourne 0 en cas de succès, -1 si les sommes intermédiaires
+// ne tiennent pas sur 16 bits ou si les tampons n'ont pas pu être alloués.
+static int separable_convolution_filter(void *arg, convolution_matrix_t *conv,
+                                        const normalization_t *norm) {
+  thread_filter_args_t *args = (thread_filter_args_t *)arg;
+  bmp_mapped_image_t *img = args->img;
+
+  int32_t width = img->dib_h->width;
+  int32_t height = img->dib_h->height;
+  int32_t size = conv->size;
+  int32_t half_size = size / 2;
+  size_t line_len = (size_t)width * 3;
+
+  // REAL SIZE
+  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+
+  // RANGE
+  int32_t row_abs = 0, col_abs = 0;
+  for (int32_t k = 0; k < size; k++) {
+    row_abs += abs(conv->row[k]);
+    col_abs += abs(conv->col[k]);
+  }
+  if (255 * row_abs > INT16_MAX ||
+      (int64_t)255 * row_abs * col_abs > INT32_MAX) {
+    return -1;
+  }
+
+  source_rows_t src;
+  if (source_rows_init(&src, args, row_size) == -1) {
+    return -1;
+  }
+  int16_t *lines = malloc(sizeof(int16_t) * line_len * (size_t)size);
+  if (lines == nullptr) {
+    return -1;
+  }
+
+  // TAPS
+  const uint8_t *h_srcs[MAX_TAPS];
+  int16_t h_weights[MAX_TAPS];
+  int32_t h_offsets[MAX_TAPS];
+  int32_t h_count = 0;
+  const int16_t *v_lines[MAX_TAPS];
+  int16_t v_weights[MAX_TAPS];
+  int32_t v_rows[MAX_TAPS];
+  int32_t v_count = 0;
+  for (int32_t k = 0; k < size; k++) {
+    if (conv->row[k] != 0) {
+      h_offsets[h_count] = (k - half_size) * 3;
+      h_weights[h_count++] = conv->row[k];
+    }
+    if (conv->col[k] != 0) {
+      v_rows[v_count] = k;
+      v_weights[v_count++] = conv->col[k];
+    }
+  }
+  // PAIRS
+  if (h_count % 2 != 0) {
+    h_offsets[h_count] = h_offsets[h_count - 1];
+    h_weights[h_count++] = 0;
+  }
+  if (v_count % 2 != 0) {
+    v_rows[v_count] = v_rows[v_count - 1];
+    v_weights[v_count++] = 0;
+  }
+  bool simd_rows = width > 2 * half_size;
+
+  // FOR EACH LINE
+  for (int32_t py = args->start_line - half_size;
+       py < args->end_line + half_size; py++) {
+    // HORIZONTAL PASS
+    int32_t ry = border_index(py, height, args->border);
+    int16_t *line = lines + (size_t)((py + size) % size) * line_len;
+    if (ry < 0) {
+      memset(line, 0, sizeof(int16_t) * line_len);
+    } else if (simd_rows) {
+      const uint8_t *ref_row = source_row(&src, ry);
+      for (int32_t k = 0; k < h_count; k++) {
+        h_srcs[k] = ref_row + h_offsets[k];
+      }
+      kernels.hpass(line, h_srcs, h_weights, h_count, (size_t)half_size * 3,
+                    (size_t)(width - half_size) * 3);
+      horizontal_pass(ref_row, line, width, 0, half_size, conv->row, size,
+                      args->border);
+      horizontal_pass(ref_row, line, width, width - half_size, width,
+                      conv->row, size, args->border);
+    } else {
+      horizontal_pass(source_row(&src, ry), line, width, 0, width, conv->row,
+                      size, args->border);
+    }
+
+    // VERTICAL PASS
+    int32_t y = py - half_size;
+    if (y < args->start_line) {
+      continue;
+    }
+    source_save(&src, y);
+    uint8_t *row_out = (uint8_t *)img->pixels + y * row_size;
+    for (int32_t k = 0; k < v_count; k++) {
+      v_lines[k] =
+          lines + (size_t)((y - half_size + v_rows[k] + size) % size) * line_len;
+    }
+    kernels.vpass(row_out, v_lines, v_weights, v_count, 0, line_len, norm);
+  }
+
+  free(lines);
+  return 0;
+}
+
+void *generic_convolution_filter(void *arg, convolution_matrix_t *conv) {
+  thread_filter_args_t *args = (thread_filter_args_t *)arg;
+  bmp_mapped_image_t *img = args->img;
+
+  int32_t width = img->dib_h->width;
+  int32_t height = img->dib_h->height;
+  int32_t size = conv->size;
+  int32_t half_size = size / 2;
+
+  // REAL SIZE
+  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+
+  // TAPS
+  const uint8_t *srcs[MAX_TAPS];
+  int16_t weights[MAX_TAPS];
+  int32_t tap_rows[MAX_TAPS];
+  int32_t tap_offsets[MAX_TAPS];
+  int32_t tap_count = 0;
+  int32_t weight_sum = 0;
+  for (int32_t ky = 0; ky < size; ky++) {
+    for (int32_t kx = 0; kx < size; kx++) {
+      int32_t weight = conv->matrix[ky * size + kx];
+      weight_sum += weight;
+      if (weight != 0) {
+        tap_rows[tap_count] = ky;
+        tap_offsets[tap_count] = (kx - half_size) * 3;
+        weights[tap_count++] = (int16_t)weight;
+      }
+    }
+  }
+  // PAIRS
+  if (tap_count % 2 != 0) {
+    tap_rows[tap_count] = tap_rows[tap_count - 1];
+    tap_offsets[tap_count] = tap_offsets[tap_count - 1];
+    weights[tap_count++] = 0;
+  }
+  normalization_t norm;
+  compute_normalization(weight_sum, &norm);
+
+  // SEPARABLE
+  if (conv->row != nullptr && conv->col != nullptr &&
+      separable_convolution_filter(arg, conv, &norm) == 0) {
+    return nullptr;
+  }
+
+  source_rows_t src;
+  if (source_rows_init(&src, args, row_size) == -1) {
+    return FILTER_FAILED;
+  }
+
+  // FOR EACH LINE
+  const uint8_t *rows[CONVOLUTION_MAX_SIZE];
+  for (int32_t y = args->start_line; y < args->end_line; y++) {
+    source_save(&src, y);
+    bool inside = width > 2 * half_size;
+    for (int32_t ky = 0; ky < size; ky++) {
+      int32_t py = border_index(y + ky - half_size, height, args->border);
+      rows[ky] = py < 0 ? nullptr : source_row(&src, py);
+      inside = inside && rows[ky] != nullptr;
+    }
+    uint8_t *row_out = (uint8_t *)img->pixels + y * row_size;
+
+    // INTERIOR
+    if (inside) {
+      for (int32_t k = 0; k < tap_count; k++) {
+        srcs[k] = rows[tap_rows[k]] + tap_offsets[k];
+      }
+      kernels.convolve(row_out, srcs, weights, tap_count,
+                       (size_t)half_size * 3, (size_t)(width - half_size) * 3,
+                       &norm);
+      for (int32_t x = 0; x < half_size; x++) {
+        apply_convolution(row_out, rows, x, width, conv, &norm, args->border);
+        apply_convolution(row_out, rows, width - 1 - x, width, conv, &norm,
+                          args->border);
+      }
+      continue;
+    }
+
+    // FOR EACH PIXEL
+    for (int32_t x = 0; x < width; x++) {
+      apply_convolution(row_out, rows, x, width, conv, &norm, args->border);
+    }
+  }
+
+  return nullptr;
+}
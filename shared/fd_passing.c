@@ -0,0 +1,80 @@
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC
+
+#include "fd_passing.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ssize_t send_fds(int sock, const void *buf, size_t len, const int *fds,
+                 int fd_count, int flags) {
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * FD_PASSING_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+  struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+  if (fd_count < 0 || fd_count > FD_PASSING_MAX_FDS) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (fd_count > 0) {
+    size_t size = sizeof(int) * (size_t)fd_count;
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(size);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(size);
+    memcpy(CMSG_DATA(cmsg), fds, size);
+  }
+  ssize_t n;
+  do {
+    n = sendmsg(sock, &msg, flags | MSG_NOSIGNAL);
+  } while (n == -1 && errno == EINTR);
+  return n;
+}
+
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int *fd_count,
+                 int flags) {
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * FD_PASSING_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {.iov_base = buf, .iov_len = len};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control.buf,
+                       .msg_controllen = sizeof(control.buf)};
+  *fd_count = 0;
+  ssize_t n;
+  do {
+    n = recvmsg(sock, &msg, flags | MSG_CMSG_CLOEXEC);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1) {
+    return -1;
+  }
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      memcpy(fds + *fd_count, CMSG_DATA(cmsg), sizeof(int) * (size_t)count);
+      *fd_count += count;
+    }
+  }
+  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    close_fds(fds, *fd_count);
+    *fd_count = 0;
+    errno = EMSGSIZE;
+    return -1;
+  }
+  return n;
+}
+
+void close_fds(const int *fds, int fd_count) {
+  for (int i = 0; i < fd_count; ++i) {
+    close(fds[i]);
+  }
+}
@@ -1,8 +1,16 @@
+#define _GNU_SOURCE // splice, vmsplice
+
 #include "full_io.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#define SPLICE_FALLBACK_SIZE (64 * 1024)
+
 static ssize_t safe_write(int fd, const void *buf, size_t count) {
   ssize_t written = -1;
   do {
@@ -40,6 +48,46 @@ ssize_t full_write(int fd, const void *buf, size_t count) {
   return (ssize_t)total;
 }
 
+ssize_t full_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  size_t total = 0;
+  const char *ptr = (const char *)buf;
+  while (count > 0) {
+    ssize_t n_w;
+    do {
+      n_w = pwrite(fd, ptr, count, offset + (off_t)total);
+    } while (n_w == -1 && errno == EINTR);
+    if (n_w < 0) {
+      break;
+    }
+    if (n_w == 0) {
+      errno = ENOSPC;
+      break;
+    }
+    total += (size_t)n_w;
+    ptr += n_w;
+    count -= (size_t)n_w;
+  }
+  return (ssize_t)total;
+}
+
+ssize_t full_pread(int fd, void *buf, size_t count, off_t offset) {
+  size_t total = 0;
+  char *ptr = (char *)buf;
+  while (count > 0) {
+    ssize_t n_r;
+    do {
+      n_r = pread(fd, ptr, count, offset + (off_t)total);
+    } while (n_r == -1 && errno == EINTR);
+    if (n_r <= 0) {
+      break;
+    }
+    total += (size_t)n_r;
+    ptr += n_r;
+    count -= (size_t)n_r;
+  }
+  return (ssize_t)total;
+}
+
 ssize_t full_read(int fd, void *buf, size_t count) {
   size_t total = 0;
   char *ptr = (char *)buf;
@@ -59,3 +107,141 @@ ssize_t full_read(int fd, void *buf, size_t count) {
 
   return (ssize_t)total;
 }
+
+// wait_ready: attend que fd soit prêt pour events, au plus timeout secondes.
+// Renvoit 0 si c'est le cas, -1 sinon (errno est positionné).
+static int wait_ready(int fd, short events, unsigned int timeout) {
+  struct pollfd pfd = {.fd = fd, .events = events, .revents = 0};
+  // Signals do not extend the wait
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout;
+  int n;
+  do {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ms = (long long)(deadline.tv_sec - now.tv_sec) * 1000 +
+                   (deadline.tv_nsec - now.tv_nsec) / 1000000;
+    if (ms <= 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    n = poll(&pfd, 1, ms > INT_MAX ? INT_MAX : (int)ms);
+  } while (n == -1 && errno == EINTR);
+  if (n == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return n == -1 ? -1 : 0;
+}
+
+ssize_t full_read_until(int fd, void *buf, size_t count,
+                        unsigned int timeout) {
+  size_t total = 0;
+  char *ptr = (char *)buf;
+  while (total < count) {
+    ssize_t n_r = read(fd, ptr + total, count - total);
+    if (n_r > 0) {
+      total += (size_t)n_r;
+    } else if (n_r == 0) {
+      errno = EIO;
+      break;
+    } else if (errno == EAGAIN) {
+      if (wait_ready(fd, POLLIN, timeout) == -1) {
+        break;
+      }
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  return (ssize_t)total;
+}
+
+ssize_t full_write_until(int fd, const void *buf, size_t count,
+                         unsigned int timeout) {
+  size_t total = 0;
+  const char *ptr = (const char *)buf;
+  while (total < count) {
+    ssize_t n_w = write(fd, ptr + total, count - total);
+    if (n_w > 0) {
+      total += (size_t)n_w;
+    } else if (n_w == -1 && errno == EAGAIN) {
+      if (wait_ready(fd, POLLOUT, timeout) == -1) {
+        break;
+      }
+    } else if (n_w == -1 && errno == EPIPE) {
+      errno = EIO;
+      break;
+    } else if (n_w == 0 || errno != EINTR) {
+      break;
+    }
+  }
+  return (ssize_t)total;
+}
+
+ssize_t full_vmsplice(int fd, const void *buf, size_t count,
+                      unsigned int timeout) {
+  size_t total = 0;
+  while (total < count) {
+    struct iovec iov = {.iov_base = (char *)buf + total,
+                        .iov_len = count - total};
+    ssize_t n_w = vmsplice(fd, &iov, 1, SPLICE_F_NONBLOCK);
+    if (n_w > 0) {
+      total += (size_t)n_w;
+    } else if (n_w == -1 && errno == EAGAIN) {
+      if (wait_ready(fd, POLLOUT, timeout) == -1) {
+        break;
+      }
+    } else if (n_w == -1 && errno == EPIPE) {
+      errno = EIO;
+      break;
+    } else if (n_w == 0 || errno != EINTR) {
+      break;
+    }
+  }
+  return (ssize_t)total;
+}
+
+// copy_until: transfère count octets de fd_in vers fd_out par read et write,
+// lorsque fd_out ne permet pas splice.
+static ssize_t copy_until(int fd_in, int fd_out, size_t count,
+                          unsigned int timeout) {
+  char buffer[SPLICE_FALLBACK_SIZE];
+  size_t total = 0;
+  while (total < count) {
+    size_t n = count - total;
+    if (n > sizeof(buffer)) {
+      n = sizeof(buffer);
+    }
+    if (full_read_until(fd_in, buffer, n, timeout) != (ssize_t)n ||
+        full_write(fd_out, buffer, n) != (ssize_t)n) {
+      break;
+    }
+    total += n;
+  }
+  return (ssize_t)total;
+}
+
+ssize_t full_splice(int fd_in, int fd_out, size_t count,
+                    unsigned int timeout) {
+  size_t total = 0;
+  while (total < count) {
+    ssize_t n = splice(fd_in, nullptr, fd_out, nullptr, count - total,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      total += (size_t)n;
+    } else if (n == 0) {
+      errno = EIO;
+      break;
+    } else if (errno == EAGAIN) {
+      if (wait_ready(fd_in, POLLIN, timeout) == -1) {
+        break;
+      }
+    } else if (errno == EINVAL && total == 0) {
+      return copy_until(fd_in, fd_out, count, timeout);
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  return (ssize_t)total;
+}
@@ -9,42 +9,82 @@
 #define OUTPUT_ARG_LABEL "output"
 #define OUTPUT_ARG_DESCRIPTION                                                 \
   "Output image path realative to the current working directory"
+#define BORDER_ARG_LABEL "policy"
+#define BORDER_ARG_DESCRIPTION                                                 \
+  "Border policy of convolution filters: clamp (default), mirror, wrap, zero"
+#define PRIORITY_ARG_LABEL "class"
+#define PRIORITY_ARG_DESCRIPTION                                               \
+  "Priority class of the request: low, normal (default), high"
+#define SHM_DESCRIPTION                                                        \
+  "Get the image back through shared memory instead of the response FIFO"
+#define SERVER_WRITE_DESCRIPTION                                               \
+  "Let the server write the output file, only a status comes back"
+#define SOCKET_DESCRIPTION                                                     \
+  "Send the request over the server socket, with the file descriptors"
+#define SOURCE_ARG_LABEL "source"
+#define OUTDIR_ARG_LABEL "outdir"
+#define WINDOW_ARG_LABEL "n"
+#define BATCH_DESCRIPTION                                                      \
+  "Filter every image of a directory, glob or manifest over one socket"
+#define WINDOW_DESCRIPTION "Requests in flight at most in batch mode"
+#define FILTERS_DESCRIPTION                                                    \
+  "Filters are applied in the order given, at most %d per request"
 
-int process_options_to_request(int argc, char *argv[], arguments_t *arg) {
-  // CHECK FOR HELP IN EACH ARGUMENT
-  for (int i = 1; i < argc; ++i) {
-    if (strcmp(argv[i],
-               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_HELP) == 0 ||
-        strcmp(argv[i], OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_HELP) ==
-            0) {
-      print_help(argv[0]);
-      return -1;
+static const char *border_names[BORDER_POLICY_COUNT] = {
+    [BORDER_CLAMP] = "clamp",
+    [BORDER_MIRROR] = "mirror",
+    [BORDER_WRAP] = "wrap",
+    [BORDER_ZERO] = "zero",
+};
+
+// parse_border: écrit dans border la politique de bord de nom name. Renvoit 0
+// en cas de succes, -1 si le nom est inconnu.
+static int parse_border(const char *name, border_policy_t *border) {
+  for (int i = 0; i < BORDER_POLICY_COUNT; i++) {
+    if (strcmp(name, border_names[i]) == 0) {
+      *border = (border_policy_t)i;
+      return 0;
     }
   }
+  return -1;
+}
 
-  if (argc < 4 || argc > 4) {
-    print_help(argv[0]);
-    return -1;
-  }
+static const char *priority_names[PRIORITY_COUNT] = {
+    [PRIORITY_LOW - PRIORITY_LOW] = "low",
+    [PRIORITY_NORMAL - PRIORITY_LOW] = "normal",
+    [PRIORITY_HIGH - PRIORITY_LOW] = "high",
+};
 
-  arg->input = argv[1];
-  arg->output = argv[2];
+// parse_priority: écrit dans priority la classe de priorité de nom name.
+// Renvoit 0 en cas de succes, -1 si le nom est inconnu.
+static int parse_priority(const char *name, request_priority_t *priority) {
+  for (int i = 0; i < PRIORITY_COUNT; i++) {
+    if (strcmp(name, priority_names[i]) == 0) {
+      *priority = (request_priority_t)(i + PRIORITY_LOW);
+      return 0;
+    }
+  }
+  return -1;
+}
 
+// parse_filter: écrit dans filter le filtre dont l'option est flag. Renvoit 0
+// en cas de succes, -1 si l'option ne correspond à aucun filtre.
+static int parse_filter(const char *flag, filter_t *filter) {
   // SIMPLE OPTIONS
 #define OPT_TO_REQUEST_SIMPLE_FILTER(filter_name, short_flag, long_flag, ...)  \
-  else if (strcmp(argv[3], OPT_TO_REQUEST_SHORT_PREFIX short_flag) == 0) {     \
-    arg->filter = filter_name;                                                 \
+  else if (strcmp(flag, OPT_TO_REQUEST_SHORT_PREFIX short_flag) == 0) {        \
+    *filter = filter_name;                                                     \
   }                                                                            \
-  else if (strcmp(argv[3], OPT_TO_REQUEST_LONG_PREFIX long_flag) == 0) {       \
-    arg->filter = filter_name;                                                 \
+  else if (strcmp(flag, OPT_TO_REQUEST_LONG_PREFIX long_flag) == 0) {          \
+    *filter = filter_name;                                                     \
   }
 // COMPLEX OPTIONS
 #define OPT_TO_REQUEST_COMPLEX_FILTER(filter_name, short_flag, long_flag, ...) \
-  else if (strcmp(argv[3], OPT_TO_REQUEST_SHORT_PREFIX short_flag) == 0) {     \
-    arg->filter = filter_name;                                                 \
+  else if (strcmp(flag, OPT_TO_REQUEST_SHORT_PREFIX short_flag) == 0) {        \
+    *filter = filter_name;                                                     \
   }                                                                            \
-  else if (strcmp(argv[3], OPT_TO_REQUEST_LONG_PREFIX long_flag) == 0) {       \
-    arg->filter = filter_name;                                                 \
+  else if (strcmp(flag, OPT_TO_REQUEST_LONG_PREFIX long_flag) == 0) {          \
+    *filter = filter_name;                                                     \
   }
   if (false) {
   }
@@ -57,7 +97,130 @@ int process_options_to_request(int argc, char *argv[], arguments_t *arg) {
 #endif
 #undef OPT_TO_REQUEST_COMPLEX_FILTER
   else {
-    fprintf(stderr, "Error: Unknown filter '%s'\n", argv[3]);
+    return -1;
+  }
+  return 0;
+}
+
+int process_options_to_request(int argc, char *argv[], arguments_t *arg) {
+  // CHECK FOR HELP IN EACH ARGUMENT
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i],
+               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_HELP) == 0 ||
+        strcmp(argv[i], OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_HELP) ==
+            0) {
+      print_help(argv[0]);
+      return -1;
+    }
+  }
+
+  if (argc < 4) {
+    print_help(argv[0]);
+    return -1;
+  }
+
+  arg->input = argv[1];
+  arg->output = argv[2];
+  arg->filter_count = 0;
+  arg->border = BORDER_CLAMP;
+  arg->response = RESPONSE_FIFO;
+  arg->priority = PRIORITY_NORMAL;
+
+  for (int i = 3; i < argc; ++i) {
+    // SHARED MEMORY OPTION
+    if (strcmp(argv[i], OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_SHM) ==
+            0 ||
+        strcmp(argv[i], OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_SHM) ==
+            0) {
+      if (arg->response != RESPONSE_FIFO) {
+        fprintf(stderr, "Error: Only one response mode can be given\n");
+        return -1;
+      }
+      arg->response = RESPONSE_SHM;
+      continue;
+    }
+
+    // SERVER WRITE OPTION
+    if (strcmp(argv[i], OPT_TO_REQUEST_SHORT_PREFIX
+                            OPT_TO_REQUEST_SHORT_SERVER_WRITE) == 0 ||
+        strcmp(argv[i], OPT_TO_REQUEST_LONG_PREFIX
+                            OPT_TO_REQUEST_LONG_SERVER_WRITE) == 0) {
+      if (arg->response != RESPONSE_FIFO) {
+        fprintf(stderr, "Error: Only one response mode can be given\n");
+        return -1;
+      }
+      arg->response = RESPONSE_FILE;
+      continue;
+    }
+
+    // SOCKET OPTION
+    if (strcmp(argv[i],
+               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_SOCKET) == 0 ||
+        strcmp(argv[i],
+               OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_SOCKET) == 0) {
+      if (arg->response != RESPONSE_FIFO) {
+        fprintf(stderr, "Error: Only one response mode can be given\n");
+        return -1;
+      }
+      arg->response = RESPONSE_SOCKET;
+      continue;
+    }
+
+    // BORDER OPTION
+    if (strcmp(argv[i],
+               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_BORDER) == 0 ||
+        strcmp(argv[i],
+               OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_BORDER) == 0) {
+      if (++i == argc) {
+        fprintf(stderr, "Error: Missing border policy after '%s'\n",
+                argv[i - 1]);
+        print_help(argv[0]);
+        return -1;
+      }
+      if (parse_border(argv[i], &arg->border) != 0) {
+        fprintf(stderr, "Error: Unknown border policy '%s'\n", argv[i]);
+        print_help(argv[0]);
+        return -1;
+      }
+      continue;
+    }
+
+    // PRIORITY OPTION
+    if (strcmp(argv[i],
+               OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_PRIORITY) ==
+            0 ||
+        strcmp(argv[i],
+               OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_PRIORITY) == 0) {
+      if (++i == argc) {
+        fprintf(stderr, "Error: Missing priority class after '%s'\n",
+                argv[i - 1]);
+        print_help(argv[0]);
+        return -1;
+      }
+      if (parse_priority(argv[i], &arg->priority) != 0) {
+        fprintf(stderr, "Error: Unknown priority class '%s'\n", argv[i]);
+        print_help(argv[0]);
+        return -1;
+      }
+      continue;
+    }
+
+    // FILTERS
+    if (arg->filter_count == REQUEST_MAX_FILTERS) {
+      fprintf(stderr, "Error: Too many filters (at most %d)\n",
+              REQUEST_MAX_FILTERS);
+      return -1;
+    }
+    if (parse_filter(argv[i], &arg->filters[arg->filter_count]) != 0) {
+      fprintf(stderr, "Error: Unknown filter '%s'\n", argv[i]);
+      print_help(argv[0]);
+      return -1;
+    }
+    arg->filter_count++;
+  }
+
+  if (arg->filter_count == 0) {
+    fprintf(stderr, "Error: No filter given\n");
     print_help(argv[0]);
     return -1;
   }
@@ -86,6 +249,28 @@ void print_help(const char *exec_name) {
   OPT_TO_REQUEST_COMPLEX_FILTERS
 #undef OPT_TO_REQUEST_COMPLEX_FILTER
 #endif
+  printf("... ");
+
+  printf("[%s%s|%s%s <%s>]", OPT_TO_REQUEST_SHORT_PREFIX,
+         OPT_TO_REQUEST_SHORT_BORDER, OPT_TO_REQUEST_LONG_PREFIX,
+         OPT_TO_REQUEST_LONG_BORDER, BORDER_ARG_LABEL);
+  printf(" [%s%s|%s%s <%s>]", OPT_TO_REQUEST_SHORT_PREFIX,
+         OPT_TO_REQUEST_SHORT_PRIORITY, OPT_TO_REQUEST_LONG_PREFIX,
+         OPT_TO_REQUEST_LONG_PRIORITY, PRIORITY_ARG_LABEL);
+  printf(" [%s%s|%s%s]", OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_SHM,
+         OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_SHM);
+  printf(" [%s%s|%s%s]", OPT_TO_REQUEST_SHORT_PREFIX,
+         OPT_TO_REQUEST_SHORT_SERVER_WRITE, OPT_TO_REQUEST_LONG_PREFIX,
+         OPT_TO_REQUEST_LONG_SERVER_WRITE);
+  printf(" [%s%s|%s%s]", OPT_TO_REQUEST_SHORT_PREFIX,
+         OPT_TO_REQUEST_SHORT_SOCKET, OPT_TO_REQUEST_LONG_PREFIX,
+         OPT_TO_REQUEST_LONG_SOCKET);
+  printf("\n\t%s %s%s|%s%s <%s> [<%s> <filters>...] [%s%s|%s%s <%s>]",
+         exec_name, OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_BATCH,
+         OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_BATCH,
+         SOURCE_ARG_LABEL, OUTDIR_ARG_LABEL, OPT_TO_REQUEST_SHORT_PREFIX,
+         OPT_TO_REQUEST_SHORT_WINDOW, OPT_TO_REQUEST_LONG_PREFIX,
+         OPT_TO_REQUEST_LONG_WINDOW, WINDOW_ARG_LABEL);
 
   printf("\n\n");
 
@@ -102,6 +287,70 @@ void print_help(const char *exec_name) {
       max_width = len;
   }
 
+  // Width for border option
+  {
+    int len = (int)strlen(
+        OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_BORDER
+        ", " OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_BORDER
+        " <" BORDER_ARG_LABEL ">");
+    if (len > max_width)
+      max_width = len;
+  }
+
+  // Width for priority option
+  {
+    int len = (int)strlen(
+        OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_PRIORITY
+        ", " OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_PRIORITY
+        " <" PRIORITY_ARG_LABEL ">");
+    if (len > max_width)
+      max_width = len;
+  }
+
+  // Width for shared memory option
+  {
+    int len = (int)strlen(OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_SHM
+                          ", " OPT_TO_REQUEST_LONG_PREFIX
+                              OPT_TO_REQUEST_LONG_SHM);
+    if (len > max_width)
+      max_width = len;
+  }
+
+  // Width for server write option
+  {
+    int len = (int)strlen(OPT_TO_REQUEST_SHORT_PREFIX
+                          OPT_TO_REQUEST_SHORT_SERVER_WRITE
+                          ", " OPT_TO_REQUEST_LONG_PREFIX
+                              OPT_TO_REQUEST_LONG_SERVER_WRITE);
+    if (len > max_width)
+      max_width = len;
+  }
+
+  // Width for socket option
+  {
+    int len = (int)strlen(OPT_TO_REQUEST_SHORT_PREFIX
+                          OPT_TO_REQUEST_SHORT_SOCKET
+                          ", " OPT_TO_REQUEST_LONG_PREFIX
+                              OPT_TO_REQUEST_LONG_SOCKET);
+    if (len > max_width)
+      max_width = len;
+  }
+
+  // Width for batch options
+  {
+    int len = (int)strlen(OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_BATCH
+                          ", " OPT_TO_REQUEST_LONG_PREFIX
+                              OPT_TO_REQUEST_LONG_BATCH " <" SOURCE_ARG_LABEL
+                          ">");
+    if (len > max_width)
+      max_width = len;
+    len = (int)strlen(OPT_TO_REQUEST_SHORT_PREFIX OPT_TO_REQUEST_SHORT_WINDOW
+                      ", " OPT_TO_REQUEST_LONG_PREFIX OPT_TO_REQUEST_LONG_WINDOW
+                      " <" WINDOW_ARG_LABEL ">");
+    if (len > max_width)
+      max_width = len;
+  }
+
   // Width for help option
   {
     int len =
@@ -160,7 +409,78 @@ void print_help(const char *exec_name) {
            max_width - (int)strlen(help_str), "");
   }
 
+  // Border option
+  {
+    char border_str[256];
+    snprintf(border_str, sizeof(border_str), "%s%s, %s%s <%s>",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_BORDER,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_BORDER,
+             BORDER_ARG_LABEL);
+    printf("\t%s%*s\t%s\n", border_str, max_width - (int)strlen(border_str),
+           "", BORDER_ARG_DESCRIPTION);
+  }
+
+  // Priority option
+  {
+    char priority_str[256];
+    snprintf(priority_str, sizeof(priority_str), "%s%s, %s%s <%s>",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_PRIORITY,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_PRIORITY,
+             PRIORITY_ARG_LABEL);
+    printf("\t%s%*s\t%s\n", priority_str,
+           max_width - (int)strlen(priority_str), "", PRIORITY_ARG_DESCRIPTION);
+  }
+
+  // Shared memory option
+  {
+    char shm_str[256];
+    snprintf(shm_str, sizeof(shm_str), "%s%s, %s%s",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_SHM,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_SHM);
+    printf("\t%s%*s\t%s\n", shm_str, max_width - (int)strlen(shm_str), "",
+           SHM_DESCRIPTION);
+  }
+
+  // Server write option
+  {
+    char sw_str[256];
+    snprintf(sw_str, sizeof(sw_str), "%s%s, %s%s",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_SERVER_WRITE,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_SERVER_WRITE);
+    printf("\t%s%*s\t%s\n", sw_str, max_width - (int)strlen(sw_str), "",
+           SERVER_WRITE_DESCRIPTION);
+  }
+
+  // Socket option
+  {
+    char so_str[256];
+    snprintf(so_str, sizeof(so_str), "%s%s, %s%s",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_SOCKET,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_SOCKET);
+    printf("\t%s%*s\t%s\n", so_str, max_width - (int)strlen(so_str), "",
+           SOCKET_DESCRIPTION);
+  }
+
+  // Batch options
+  {
+    char batch_str[256];
+    snprintf(batch_str, sizeof(batch_str), "%s%s, %s%s <%s>",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_BATCH,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_BATCH,
+             SOURCE_ARG_LABEL);
+    printf("\t%s%*s\t%s\n", batch_str, max_width - (int)strlen(batch_str),
+           "", BATCH_DESCRIPTION);
+    char window_str[256];
+    snprintf(window_str, sizeof(window_str), "%s%s, %s%s <%s>",
+             OPT_TO_REQUEST_SHORT_PREFIX, OPT_TO_REQUEST_SHORT_WINDOW,
+             OPT_TO_REQUEST_LONG_PREFIX, OPT_TO_REQUEST_LONG_WINDOW,
+             WINDOW_ARG_LABEL);
+    printf("\t%s%*s\t%s\n", window_str, max_width - (int)strlen(window_str),
+           "", WINDOW_DESCRIPTION);
+  }
+
   // Filter options
+  printf("\n\t" FILTERS_DESCRIPTION ":\n", REQUEST_MAX_FILTERS);
 #ifdef OPT_TO_REQUEST_SIMPLE_FILTERS
 #define OPT_TO_REQUEST_SIMPLE_FILTER(filter_name, short_flag, long_flag,       \
                                      description, ...)                         \
@@ -0,0 +1,331 @@
+#include "point.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "bmp.h"
+
+//---- [FIXED POINT] ---------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les sommes pondérées d'une matrice couleur sont entières (coefficients en
+// millièmes) puis divisées par POINT_MATRIX_SCALE avec troncature. Les noyaux
+// vectoriels remplacent la division par une multiplication flottante :
+// n * 0.001f + 0.0005f, tronqué. Les sommes n étant entières, la partie
+// fractionnaire exacte de n / 1000 est un multiple de 0.001 ; l'erreur
+// d'arrondi, inférieure à 2^-23 * n / 1000 (moins de 0.00004 tant que
+// n / 1000 < 256, les sommes plus grandes donnant 255), ne peut donc pas faire
+// franchir d'entier au résultat décalé de 0.0005.
+
+#define SCALE_INVERSE (1.0f / POINT_MATRIX_SCALE)
+#define SCALE_ROUNDING (0.5f / POINT_MATRIX_SCALE)
+
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// scale: ramène la somme pondérée sum d'un canal dans [0, 255]
+KERNEL_INLINE uint8_t scale(int32_t sum) {
+  if (sum <= 0) {
+    return 0;
+  }
+  int32_t value = sum / POINT_MATRIX_SCALE;
+  return (uint8_t)(value > 255 ? 255 : value);
+}
+
+//---- [KERNELS] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// Les noyaux traitent les size octets (3 par pixel) d'une ligne en place.
+// Tables bit à bit : row[i] = (row[i] & masks[i]) ^ flips[i], les motifs de
+// PATTERN_SIZE octets répétant les masques des trois canaux, 16 ou 32 octets
+// par instruction. Matrices : les versions SSE4.1 et AVX2 traitent 4 pixels (12
+// octets) par voie de 128 bits. Les canaux sont répartis en paires 16 bits
+// (bleu, vert) et (rouge, 0) afin que pmaddwd calcule la somme pondérée de
+// chaque canal de sortie en deux instructions. Seuls les 12 octets traités sont
+// écrits : une lecture de 16 octets chevauchant l'écriture précédente ne
+// pourrait pas être servie par le tampon d'écriture et bloquerait chaque
+// itération.
+
+#define PATTERN_SIZE 96 // ppcm de 3 octets par pixel et 32 octets (AVX2)
+
+// bitwise_tail: applique les motifs aux octets [begin, end) de row
+KERNEL_INLINE void bitwise_tail(uint8_t *row, size_t begin, size_t end,
+                                const uint8_t *masks, const uint8_t *flips) {
+  for (size_t i = begin; i < end; i++) {
+    row[i] = (uint8_t)((row[i] & masks[i % PATTERN_SIZE]) ^
+                       flips[i % PATTERN_SIZE]);
+  }
+}
+
+// matrix_tail: applique matrix aux pixels des octets [begin, end) de row
+KERNEL_INLINE void matrix_tail(uint8_t *row, size_t begin, size_t end,
+                               const point_matrix_t *matrix) {
+  for (size_t i = begin; i < end; i += 3) {
+    int32_t blue = row[i];
+    int32_t green = row[i + 1];
+    int32_t red = row[i + 2];
+    for (int32_t c = 0; c < 3; c++) {
+      row[i + (size_t)c] = scale(matrix->matrix[c][0] * blue +
+                                 matrix->matrix[c][1] * green +
+                                 matrix->matrix[c][2] * red);
+    }
+  }
+}
+
+typedef struct {
+  void (*bitwise)(uint8_t *, size_t, const uint8_t *, const uint8_t *);
+  void (*matrix)(uint8_t *, size_t, const point_matrix_t *);
+} point_kernels_t;
+
+// GENERIC
+static void bitwise_generic(uint8_t *row, size_t size, const uint8_t *masks,
+                            const uint8_t *flips) {
+  bitwise_tail(row, 0, size, masks, flips);
+}
+
+static void matrix_generic(uint8_t *row, size_t size,
+                           const point_matrix_t *matrix) {
+  matrix_tail(row, 0, size, matrix);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define SSE41 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+// weight_pair: coefficients a et b regroupés pour pmaddwd
+KERNEL_INLINE int32_t weight_pair(int16_t a, int16_t b) {
+  return (int32_t)((uint32_t)(uint16_t)a | ((uint32_t)(uint16_t)b << 16));
+}
+
+// SSE4.1
+static SSE41 void bitwise_sse41(uint8_t *row, size_t size,
+                                const uint8_t *masks, const uint8_t *flips) {
+  __m128i mask[PATTERN_SIZE / 16];
+  __m128i flip[PATTERN_SIZE / 16];
+  for (int32_t k = 0; k < PATTERN_SIZE / 16; k++) {
+    mask[k] = _mm_loadu_si128((const __m128i *)(masks + k * 16));
+    flip[k] = _mm_loadu_si128((const __m128i *)(flips + k * 16));
+  }
+  size_t i = 0;
+  for (; i + PATTERN_SIZE <= size; i += PATTERN_SIZE) {
+    for (int32_t k = 0; k < PATTERN_SIZE / 16; k++) {
+      __m128i *p = (__m128i *)(row + i + (size_t)k * 16);
+      _mm_storeu_si128(
+          p, _mm_xor_si128(_mm_and_si128(_mm_loadu_si128(p), mask[k]), flip[k]));
+    }
+  }
+  bitwise_tail(row, i, size, masks, flips);
+}
+
+// sse41_scale: divise par POINT_MATRIX_SCALE les 4 sommes de sum (les sommes
+// négatives donnent 0)
+SSE41 KERNEL_INLINE __m128i sse41_scale(__m128i sum) {
+  __m128 value = _mm_cvtepi32_ps(_mm_max_epi32(sum, _mm_setzero_si128()));
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(SCALE_INVERSE)),
+                                     _mm_set1_ps(SCALE_ROUNDING)));
+}
+
+// sse41_store12: écrit les 12 premiers octets de pixels à l'adresse out
+SSE41 KERNEL_INLINE void sse41_store12(uint8_t *out, __m128i pixels) {
+  _mm_storel_epi64((__m128i *)out, pixels);
+  int32_t last = _mm_extract_epi32(pixels, 2);
+  memcpy(out + 8, &last, sizeof(last));
+}
+
+static SSE41 void matrix_sse41(uint8_t *row, size_t size,
+                               const point_matrix_t *matrix) {
+  const __m128i split_bg = _mm_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7,
+                                         -1, 9, -1, 10, -1);
+  const __m128i split_r = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1,
+                                        -1, -1, 11, -1, -1, -1);
+  const __m128i merge = _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1,
+                                      -1, -1, -1);
+  __m128i w_bg[3];
+  __m128i w_r[3];
+  for (int32_t c = 0; c < 3; c++) {
+    w_bg[c] = _mm_set1_epi32(
+        weight_pair(matrix->matrix[c][0], matrix->matrix[c][1]));
+    w_r[c] = _mm_set1_epi32(weight_pair(matrix->matrix[c][2], 0));
+  }
+  size_t i = 0;
+  for (; i + 16 <= size; i += 12) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(row + i));
+    __m128i bg = _mm_shuffle_epi8(in, split_bg);
+    __m128i r = _mm_shuffle_epi8(in, split_r);
+    __m128i out[3];
+    for (int32_t c = 0; c < 3; c++) {
+      out[c] = sse41_scale(_mm_add_epi32(_mm_madd_epi16(bg, w_bg[c]),
+                                         _mm_madd_epi16(r, w_r[c])));
+    }
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(out[0], out[1]),
+                                      _mm_packs_epi32(out[2], out[2]));
+    sse41_store12(row + i, _mm_shuffle_epi8(packed, merge));
+  }
+  matrix_tail(row, i, size, matrix);
+}
+
+// AVX2
+static AVX2 void bitwise_avx2(uint8_t *row, size_t size, const uint8_t *masks,
+                              const uint8_t *flips) {
+  __m256i mask[PATTERN_SIZE / 32];
+  __m256i flip[PATTERN_SIZE / 32];
+  for (int32_t k = 0; k < PATTERN_SIZE / 32; k++) {
+    mask[k] = _mm256_loadu_si256((const __m256i *)(masks + k * 32));
+    flip[k] = _mm256_loadu_si256((const __m256i *)(flips + k * 32));
+  }
+  size_t i = 0;
+  for (; i + PATTERN_SIZE <= size; i += PATTERN_SIZE) {
+    for (int32_t k = 0; k < PATTERN_SIZE / 32; k++) {
+      __m256i *p = (__m256i *)(row + i + (size_t)k * 32);
+      _mm256_storeu_si256(
+          p, _mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256(p), mask[k]),
+                              flip[k]));
+    }
+  }
+  bitwise_tail(row, i, size, masks, flips);
+}
+
+// avx2_scale: divise par POINT_MATRIX_SCALE les 8 sommes de sum
+AVX2 KERNEL_INLINE __m256i avx2_scale(__m256i sum) {
+  __m256 value =
+      _mm256_cvtepi32_ps(_mm256_max_epi32(sum, _mm256_setzero_si256()));
+  return _mm256_cvttps_epi32(
+      _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(SCALE_INVERSE)),
+                    _mm256_set1_ps(SCALE_ROUNDING)));
+}
+
+// Chaque voie de 128 bits traite 4 pixels, la voie haute étant chargée 12
+// octets après la voie basse.
+static AVX2 void matrix_avx2(uint8_t *row, size_t size,
+                             const point_matrix_t *matrix) {
+  const __m256i split_bg = _mm256_setr_epi8(
+      0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1, 0, -1, 1, -1, 3,
+      -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+  const __m256i split_r = _mm256_setr_epi8(
+      2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1, 2, -1, -1,
+      -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+  const __m256i merge = _mm256_setr_epi8(
+      0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1, 0, 4, 8, 1, 5, 9, 2,
+      6, 10, 3, 7, 11, -1, -1, -1, -1);
+  __m256i w_bg[3];
+  __m256i w_r[3];
+  for (int32_t c = 0; c < 3; c++) {
+    w_bg[c] = _mm256_set1_epi32(
+        weight_pair(matrix->matrix[c][0], matrix->matrix[c][1]));
+    w_r[c] = _mm256_set1_epi32(weight_pair(matrix->matrix[c][2], 0));
+  }
+  size_t i = 0;
+  for (; i + 28 <= size; i += 24) {
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(row + i))),
+        _mm_loadu_si128((const __m128i *)(row + i + 12)), 1);
+    __m256i bg = _mm256_shuffle_epi8(in, split_bg);
+    __m256i r = _mm256_shuffle_epi8(in, split_r);
+    __m256i out[3];
+    for (int32_t c = 0; c < 3; c++) {
+      out[c] = avx2_scale(_mm256_add_epi32(_mm256_madd_epi16(bg, w_bg[c]),
+                                           _mm256_madd_epi16(r, w_r[c])));
+    }
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(out[0], out[1]),
+                                         _mm256_packs_epi32(out[2], out[2]));
+    __m256i pixels = _mm256_shuffle_epi8(packed, merge);
+    sse41_store12(row + i, _mm256_castsi256_si128(pixels));
+    sse41_store12(row + i + 12, _mm256_extracti128_si256(pixels, 1));
+  }
+  matrix_tail(row, i, size, matrix);
+}
+#endif
+
+static point_kernels_t kernels = {.bitwise = bitwise_generic,
+                                  .matrix = matrix_generic};
+
+// select_kernels: choisit au démarrage du programme les noyaux correspondant
+// au meilleur jeu d'instructions supporté par le processeur
+__attribute__((constructor)) static void select_kernels(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels = (point_kernels_t){.bitwise = bitwise_avx2,
+                                .matrix = matrix_avx2};
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    kernels = (point_kernels_t){.bitwise = bitwise_sse41,
+                                .matrix = matrix_sse41};
+  }
+#endif
+}
+
+//---- [FILTERS] -------------------------------------------------------------//
+//----------------------------------------------------------------------------//
+
+// lut_pattern: si chaque table de lut est de la forme
+// table[v] == (v & mask) ^ flip, écrit dans masks et flips les motifs de
+// PATTERN_SIZE octets correspondants et renvoit true, sinon renvoit false
+static bool lut_pattern(const point_lut_t *lut, uint8_t *masks,
+                        uint8_t *flips) {
+  for (int32_t c = 0; c < 3; c++) {
+    const uint8_t *table = lut->table[c];
+    uint8_t flip = table[0];
+    uint8_t mask = (uint8_t)(table[255] ^ flip);
+    for (int32_t v = 0; v < 256; v++) {
+      if (table[v] != ((v & mask) ^ flip)) {
+        return false;
+      }
+    }
+    for (int32_t i = c; i < PATTERN_SIZE; i += 3) {
+      masks[i] = mask;
+      flips[i] = flip;
+    }
+  }
+  return true;
+}
+
+void *generic_lut_filter(void *arg, const point_lut_t *lut) {
+  thread_filter_args_t *args = (thread_filter_args_t *)arg;
+  bmp_mapped_image_t *img = args->img;
+  int32_t width = img->dib_h->width;
+
+  // REAL SIZE
+  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+
+  uint8_t masks[PATTERN_SIZE];
+  uint8_t flips[PATTERN_SIZE];
+  bool bitwise = lut_pattern(lut, masks, flips);
+  if (bitwise && masks[0] == 0xFF && masks[1] == 0xFF && masks[2] == 0xFF &&
+      flips[0] == 0 && flips[1] == 0 && flips[2] == 0) {
+    // IDENTITY
+    return nullptr;
+  }
+
+  // FOR EACH LINE
+  for (int32_t y = args->start_line; y < args->end_line; y++) {
+    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
+    if (bitwise) {
+      kernels.bitwise(row, (size_t)width * 3, masks, flips);
+      continue;
+    }
+    for (int32_t x = 0; x < width; x++) {
+      row[x * 3] = lut->table[0][row[x * 3]];
+      row[x * 3 + 1] = lut->table[1][row[x * 3 + 1]];
+      row[x * 3 + 2] = lut->table[2][row[x * 3 + 2]];
+    }
+  }
+  return nullptr;
+}
+
+void *generic_matrix_filter(void *arg, const point_matrix_t *matrix) {
+  thread_filter_args_t *args = (thread_filter_args_t *)arg;
+  bmp_mapped_image_t *img = args->img;
+  int32_t width = img->dib_h->width;
+
+  // REAL SIZE
+  int32_t row_size = ((width * 3 + 3) / 4) * 4;
+
+  // FOR EACH LINE
+  for (int32_t y = args->start_line; y < args->end_line; y++) {
+    uint8_t *row = (uint8_t *)img->pixels + y * row_size;
+    kernels.matrix(row, (size_t)width * 3, matrix);
+  }
+  return nullptr;
+}
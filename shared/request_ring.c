@@ -0,0 +1,263 @@
+#define _GNU_SOURCE // syscall
+
+#include "request_ring.h"
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// wait_event: attend, par futex, que le compteur d'évènements event ne vaille
+// plus seen, en se comptant dans waiters pour que signal_event sache qu'il
+// doit réveiller. Renvoit 0 au réveil ou si event a déjà changé, -1 sinon.
+static int wait_event(_Atomic uint32_t *event, _Atomic uint32_t *waiters,
+                      uint32_t seen) {
+  atomic_fetch_add(waiters, 1);
+  long r = syscall(SYS_futex, (uint32_t *)event, FUTEX_WAIT, seen, nullptr,
+                   nullptr, 0);
+  atomic_fetch_sub(waiters, 1);
+  return r == -1 && errno != EAGAIN ? -1 : 0;
+}
+
+// signal_event: incrémente le compteur d'évènements event et réveille un
+// processus s'il y en a en attente. L'incrément précède la lecture de waiters
+// (ordre séquentiel) : un processus qui s'est compté après cette lecture voit
+// le nouveau compteur et n'attend pas.
+static void signal_event(_Atomic uint32_t *event, _Atomic uint32_t *waiters) {
+  atomic_fetch_add(event, 1);
+  if (atomic_load(waiters) > 0) {
+    syscall(SYS_futex, (uint32_t *)event, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+  }
+}
+
+// slot_at: renvoit la case de la position pos de la file pointé par ring
+static request_slot_t *slot_at(request_t *ring, uint64_t pos) {
+  return &ring->slots[pos & ring->mask];
+}
+
+// span_of: renvoit le nombre de cases occupées par un enregistrement de size
+// octets
+static uint32_t span_of(size_t size) {
+  return (uint32_t)((size + REQUEST_SLOT_PAYLOAD - 1) / REQUEST_SLOT_PAYLOAD);
+}
+
+// encode: écrit dans record, d'au moins REQUEST_RECORD_MAX octets,
+// l'enregistrement de la requête pointé par rq. Renvoit sa taille.
+static size_t encode(const filter_request_t *rq, unsigned char *record) {
+  request_record_t head = {.pid = rq->pid,
+                           .filter_count = rq->filter_count,
+                           .border = rq->border,
+                           .response = rq->response,
+                           .priority = rq->priority,
+                           .path_length =
+                               (uint16_t)strnlen(rq->path, PATH_MAX - 1),
+                           .output_length =
+                               (uint16_t)strnlen(rq->output, PATH_MAX - 1)};
+  memcpy(head.filters, rq->filters, sizeof(head.filters));
+  memcpy(record, &head, sizeof(head));
+  size_t size = sizeof(head);
+  memcpy(record + size, rq->path, head.path_length);
+  size += head.path_length;
+  memcpy(record + size, rq->output, head.output_length);
+  return size + head.output_length;
+}
+
+// decode: remplit rq depuis l'enregistrement record de span cases. Renvoit 0
+// en cas de succes, -1 si l'enregistrement est invalide.
+static int decode(const unsigned char *record, uint32_t span,
+                  filter_request_t *rq) {
+  request_record_t head;
+  memcpy(&head, record, sizeof(head));
+  if (head.path_length >= PATH_MAX || head.output_length >= PATH_MAX ||
+      head.priority < PRIORITY_LOW || head.priority > PRIORITY_HIGH) {
+    return -1;
+  }
+  size_t size = sizeof(head) + head.path_length + head.output_length;
+  if (span_of(size) != span) {
+    return -1;
+  }
+  rq->pid = head.pid;
+  memcpy(rq->filters, head.filters, sizeof(rq->filters));
+  rq->filter_count = head.filter_count;
+  rq->border = head.border;
+  rq->response = head.response;
+  rq->priority = head.priority;
+  memcpy(rq->path, record + sizeof(head), head.path_length);
+  rq->path[head.path_length] = '\0';
+  memcpy(rq->output, record + sizeof(head) + head.path_length,
+         head.output_length);
+  rq->output[head.output_length] = '\0';
+  return 0;
+}
+
+// try_push: ajoute l'enregistrement record de size octets à la file pointé
+// par ring sans attendre. Renvoit 0 en cas de succes, -1 si la file n'a pas
+// assez de cases libres consécutives.
+static int try_push(request_t *ring, const unsigned char *record,
+                    size_t size) {
+  uint32_t span = span_of(size);
+  uint64_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  for (;;) {
+    // A slot only leaves the free state once head has passed it, so checking
+    // them all before the compare-and-swap is enough
+    int64_t diff = 0;
+    for (uint32_t i = 0; i < span && diff == 0; ++i) {
+      uint64_t seq = atomic_load_explicit(&slot_at(ring, pos + i)->seq,
+                                          memory_order_acquire);
+      diff = (int64_t)(seq - (pos + i));
+    }
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + span,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        for (uint32_t i = 0; i < span; ++i) {
+          size_t offset = i * REQUEST_SLOT_PAYLOAD;
+          size_t count = size - offset < REQUEST_SLOT_PAYLOAD
+                             ? size - offset
+                             : REQUEST_SLOT_PAYLOAD;
+          memcpy(slot_at(ring, pos + i)->payload, record + offset, count);
+        }
+        request_slot_t *first = slot_at(ring, pos);
+        atomic_store_explicit(&first->span, span, memory_order_relaxed);
+        atomic_store_explicit(&first->seq, pos + 1, memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+  }
+}
+
+size_t request_ring_size(uint32_t capacity) {
+  return sizeof(request_t) + capacity * sizeof(request_slot_t);
+}
+
+request_t *request_ring_create(int fd, uint32_t capacity) {
+  if (capacity < REQUEST_RING_MAX_SPAN || (capacity & (capacity - 1)) != 0) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  size_t size = request_ring_size(capacity);
+  if (ftruncate(fd, (off_t)size) == -1) {
+    return nullptr;
+  }
+  request_t *ring =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    return nullptr;
+  }
+  ring->capacity = capacity;
+  ring->mask = capacity - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->ready, 0);
+  atomic_init(&ring->ready_waiters, 0);
+  atomic_init(&ring->space, 0);
+  atomic_init(&ring->space_waiters, 0);
+  for (uint32_t i = 0; i < capacity; ++i) {
+    atomic_init(&ring->slots[i].seq, i);
+  }
+  return ring;
+}
+
+request_t *request_ring_attach(int fd) {
+  struct stat s;
+  if (fstat(fd, &s) == -1) {
+    return nullptr;
+  }
+  size_t size = (size_t)s.st_size;
+  if (size < sizeof(request_t)) {
+    errno = EPROTO;
+    return nullptr;
+  }
+  request_t *ring =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    return nullptr;
+  }
+  uint32_t capacity = ring->capacity;
+  if (capacity < REQUEST_RING_MAX_SPAN || (capacity & (capacity - 1)) != 0 ||
+      ring->mask != capacity - 1 || request_ring_size(capacity) != size) {
+    munmap(ring, size);
+    errno = EPROTO;
+    return nullptr;
+  }
+  return ring;
+}
+
+int request_ring_detach(request_t *ring) {
+  return munmap(ring, request_ring_size(ring->capacity));
+}
+
+int request_ring_push(request_t *ring, const filter_request_t *rq) {
+  unsigned char record[REQUEST_RECORD_MAX];
+  size_t size = encode(rq, record);
+  for (;;) {
+    uint32_t seen = atomic_load(&ring->space);
+    if (try_push(ring, record, size) == 0) {
+      break;
+    }
+    if (wait_event(&ring->space, &ring->space_waiters, seen) == -1 &&
+        errno != EINTR) {
+      return -1;
+    }
+  }
+  request_ring_notify(ring);
+  return 0;
+}
+
+int request_ring_try_pop(request_t *ring, filter_request_t *rq) {
+  uint64_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  for (;;) {
+    request_slot_t *first = slot_at(ring, pos);
+    uint64_t seq = atomic_load_explicit(&first->seq, memory_order_acquire);
+    int64_t diff = (int64_t)(seq - (pos + 1));
+    if (diff == 0) {
+      // Only trusted once tail is won: a stale span fails the exchange
+      uint32_t span = atomic_load_explicit(&first->span, memory_order_relaxed);
+      if (span < 1 || span > REQUEST_RING_MAX_SPAN) {
+        span = 1;
+      }
+      if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + span,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        unsigned char record[REQUEST_RING_MAX_SPAN * REQUEST_SLOT_PAYLOAD];
+        for (uint32_t i = 0; i < span; ++i) {
+          request_slot_t *slot = slot_at(ring, pos + i);
+          memcpy(record + i * REQUEST_SLOT_PAYLOAD, slot->payload,
+                 REQUEST_SLOT_PAYLOAD);
+          atomic_store_explicit(&slot->seq, pos + i + ring->capacity,
+                                memory_order_release);
+        }
+        signal_event(&ring->space, &ring->space_waiters);
+        if (decode(record, span, rq) == -1) {
+          errno = EBADMSG;
+          return -1;
+        }
+        return 0;
+      }
+    } else if (diff < 0) {
+      errno = EAGAIN;
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+  }
+}
+
+uint32_t request_ring_ready(request_t *ring) {
+  return atomic_load(&ring->ready);
+}
+
+int request_ring_wait(request_t *ring, uint32_t seen) {
+  return wait_event(&ring->ready, &ring->ready_waiters, seen);
+}
+
+void request_ring_notify(request_t *ring) {
+  signal_event(&ring->ready, &ring->ready_waiters);
+}
@@ -0,0 +1,285 @@
+// Vérifie les filtres de convolution séparables (gb, gb5, bl, mbh, mbv) et le
+// flou diagonal (mb) : sur des images générées, pour chaque politique de bord,
+// le chemin séparable et le chemin 2D (mêmes poids, sans row ni col) doivent
+// donner à 1 près le résultat d'une convolution naïve calculée ici, quel que
+// soit le découpage de l'image en bandes.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmp.h"
+#include "convolution.h"
+
+#define MAX_DELTA 1
+
+typedef struct {
+  const char *name;
+  filter_func_t filter; // chemin séparable s'il existe
+  int32_t size;
+  int16_t matrix[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+} filter_case_t;
+
+static const filter_case_t filters[] = {
+    {"gb", gaussian_blur_filter, 3, {1, 2, 1, 2, 4, 2, 1, 2, 1}},
+    {"gb5",
+     gaussian_blur5x5_filter,
+     5,
+     {1, 4, 6, 4, 1, 4, 16, 24, 16, 4, 6, 24, 36,
+      24, 6, 4, 16, 24, 16, 4, 1, 4, 6, 4, 1}},
+    {"bl", blurbox_filter, 3, {1, 1, 1, 1, 1, 1, 1, 1, 1}},
+    {"mb", motion_blur_filter, 3, {1, 0, 0, 0, 1, 0, 0, 0, 1}},
+    {"mbh", motion_blur_horizontal_filter, 3, {0, 0, 0, 1, 1, 1, 0, 0, 0}},
+    {"mbv", motion_blur_vertical_filter, 3, {0, 1, 0, 0, 1, 0, 0, 1, 0}},
+};
+
+// Tailles des images : plus étroites que la matrice, sans et avec remplissage
+// des lignes, et assez larges pour les noyaux vectoriels
+static const int32_t sizes[][2] = {{1, 1}, {2, 3},  {4, 4},   {5, 7},
+                                   {7, 2}, {17, 9}, {64, 33}, {257, 19}};
+
+// Découpages : une bande, trois bandes d'un même thread (lignes précédentes
+// dans carry), trois bandes de threads différents (lignes voisines dans les
+// halos)
+static const struct {
+  int32_t bands;
+  bool reverse;
+} modes[] = {{1, false}, {3, false}, {3, true}};
+
+static const char *border_names[BORDER_POLICY_COUNT] = {"clamp", "mirror",
+                                                        "wrap", "zero"};
+
+typedef struct {
+  bmp_file_header_t file_h;
+  bmp_dib_header_t dib_h;
+  bmp_mapped_image_t img;
+  uint8_t *pixels;
+  int32_t row_size;
+} test_image_t;
+
+// image_init: alloue dans image une image de width x height pixels remplie de
+// valeurs pseudo-aléatoires tirées de seed. Renvoit 0 en cas de succes, -1
+// sinon.
+static int image_init(test_image_t *image, int32_t width, int32_t height,
+                      uint32_t seed) {
+  image->row_size = ((width * 3 + 3) / 4) * 4;
+  image->pixels = malloc((size_t)image->row_size * (size_t)height);
+  if (image->pixels == nullptr) {
+    return -1;
+  }
+  for (size_t i = 0; i < (size_t)image->row_size * (size_t)height; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    image->pixels[i] = (uint8_t)seed;
+  }
+  image->file_h = (bmp_file_header_t){.signature = BMP_SIGNATURE};
+  image->dib_h = (bmp_dib_header_t){
+      .header_size = sizeof(bmp_dib_header_t),
+      .width = width,
+      .height = height,
+      .planes = 1,
+      .bit_count = 24};
+  image->img = (bmp_mapped_image_t){.file_h = &image->file_h,
+                                    .dib_h = &image->dib_h,
+                                    .pixels = image->pixels};
+  return 0;
+}
+
+// image_copy: alloue dans copy une copie de image. Renvoit 0 en cas de succes,
+// -1 sinon.
+static int image_copy(test_image_t *copy, const test_image_t *image) {
+  *copy = *image;
+  size_t size = (size_t)image->row_size * (size_t)image->dib_h.height;
+  copy->pixels = malloc(size);
+  if (copy->pixels == nullptr) {
+    return -1;
+  }
+  memcpy(copy->pixels, image->pixels, size);
+  copy->img = (bmp_mapped_image_t){
+      .file_h = &copy->file_h, .dib_h = &copy->dib_h, .pixels = copy->pixels};
+  return 0;
+}
+
+// reference_index: ramène p dans [0, n) selon border, -1 pour un voisin nul
+static int32_t reference_index(int32_t p, int32_t n, border_policy_t border) {
+  while (p < 0 || p >= n) {
+    switch (border) {
+    case BORDER_CLAMP:
+      return p < 0 ? 0 : n - 1;
+    case BORDER_MIRROR:
+      if (n == 1) {
+        return 0;
+      }
+      p = p < 0 ? -p : 2 * (n - 1) - p;
+      break;
+    case BORDER_WRAP:
+      p = p < 0 ? p + n : p - n;
+      break;
+    default:
+      return -1;
+    }
+  }
+  return p;
+}
+
+// reference_filter: écrit dans out la convolution de image par f, calculée
+// pixel par pixel
+static void reference_filter(uint8_t *out, const test_image_t *image,
+                             const filter_case_t *f, border_policy_t border) {
+  int32_t width = image->dib_h.width;
+  int32_t height = image->dib_h.height;
+  int32_t half_size = f->size / 2;
+  int32_t weight_sum = 0;
+  for (int32_t k = 0; k < f->size * f->size; k++) {
+    weight_sum += f->matrix[k];
+  }
+  for (int32_t y = 0; y < height; y++) {
+    for (int32_t x = 0; x < width; x++) {
+      for (int32_t c = 0; c < 3; c++) {
+        int32_t sum = 0;
+        for (int32_t ky = 0; ky < f->size; ky++) {
+          for (int32_t kx = 0; kx < f->size; kx++) {
+            int32_t py = reference_index(y + ky - half_size, height, border);
+            int32_t px = reference_index(x + kx - half_size, width, border);
+            if (py >= 0 && px >= 0) {
+              sum += f->matrix[ky * f->size + kx] *
+                     image->pixels[py * image->row_size + px * 3 + c];
+            }
+          }
+        }
+        int32_t v = weight_sum > 1 ? sum / weight_sum : sum;
+        out[y * image->row_size + x * 3 + c] =
+            (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+      }
+    }
+  }
+}
+
+// Filtre en cours de vérification
+static const filter_case_t *current;
+
+// convolution_2d_filter: applique la matrice de current sans passes séparées
+static void *convolution_2d_filter(void *arg) {
+  int16_t matrix[CONVOLUTION_MAX_SIZE * CONVOLUTION_MAX_SIZE];
+  memcpy(matrix, current->matrix, sizeof(matrix));
+  convolution_matrix_t conv = {.matrix = matrix, .size = current->size};
+  return generic_convolution_filter(arg, &conv);
+}
+
+// run_filter: applique filter à image découpée en bands bandes, comme le
+// serveur : les frontières de l'image sont copiées dans un halo. Les bandes
+// sont filtrées par un même thread dans l'ordre, ou par des threads
+// différents dans l'ordre inverse si reverse est vrai (toutes les frontières
+// sont alors copiées). Renvoit 0 en cas de succes, -1 sinon.
+static int run_filter(filter_func_t filter, test_image_t *image,
+                      border_policy_t border, int32_t bands, bool reverse) {
+  int32_t height = image->dib_h.height;
+  int32_t band_rows = (height + bands - 1) / bands;
+  if (band_rows < 2 * BMP_MAX_HALO) {
+    band_rows = 2 * BMP_MAX_HALO;
+  }
+  bmp_halo_t halo;
+  if (bmp_halo_init(&halo, &image->img, height, band_rows, BMP_MAX_HALO) ==
+      -1) {
+    return -1;
+  }
+  int ret = 0;
+  for (int32_t b = 0; reverse && b < halo.band_count && ret == 0; b++) {
+    ret = bmp_halo_capture(&halo, b);
+  }
+  thread_filter_args_t args = {
+      .img = &image->img, .halo = &halo, .border = border, .carry = nullptr};
+  for (int32_t k = 0; k < halo.band_count && ret == 0; k++) {
+    int32_t b = reverse ? halo.band_count - 1 - k : k;
+    args.start_line = b * band_rows;
+    args.end_line = b + 1 < halo.band_count ? (b + 1) * band_rows : height;
+    if (filter(&args) == FILTER_FAILED) {
+      ret = -1;
+    }
+    if (reverse) {
+      free(args.carry);
+      args.carry = nullptr;
+    }
+  }
+  free(args.carry);
+  bmp_halo_dispose(&halo);
+  return ret;
+}
+
+// check: compare à expected le résultat de filter sur image. Renvoit 0 si
+// chaque valeur est à au plus MAX_DELTA près, -1 sinon.
+static int check(const char *path, filter_func_t filter,
+                 const test_image_t *image, const uint8_t *expected,
+                 border_policy_t border, int32_t bands, bool reverse) {
+  test_image_t out;
+  if (image_copy(&out, image) == -1) {
+    fprintf(stderr, "image_copy failed\n");
+    return -1;
+  }
+  int ret = run_filter(filter, &out, border, bands, reverse);
+  if (ret == -1) {
+    fprintf(stderr, "%s %s: filter failed\n", current->name, path);
+  }
+  int32_t width = image->dib_h.width;
+  for (int32_t y = 0; y < image->dib_h.height && ret == 0; y++) {
+    for (int32_t i = 0; i < width * 3; i++) {
+      int32_t at = y * image->row_size + i;
+      if (abs(out.pixels[at] - expected[at]) > MAX_DELTA) {
+        fprintf(stderr,
+                "%s %s, %s border, %dx%d in %d band(s)%s: pixel (%d, %d) "
+                "channel %d is %u, expected %u\n",
+                current->name, path, border_names[border], width,
+                image->dib_h.height, bands, reverse ? " reversed" : "",
+                i / 3, y, i % 3, out.pixels[at], expected[at]);
+        ret = -1;
+        break;
+      }
+    }
+  }
+  free(out.pixels);
+  return ret;
+}
+
+int main(void) {
+  int failed = 0;
+  int passed = 0;
+  uint32_t seed = 0x9E3779B9;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    test_image_t image;
+    if (image_init(&image, sizes[s][0], sizes[s][1], seed++) == -1) {
+      fprintf(stderr, "image_init failed\n");
+      return EXIT_FAILURE;
+    }
+    uint8_t *expected = malloc((size_t)image.row_size * (size_t)sizes[s][1]);
+    if (expected == nullptr) {
+      fprintf(stderr, "malloc failed\n");
+      free(image.pixels);
+      return EXIT_FAILURE;
+    }
+    for (size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+      current = &filters[f];
+      for (int b = 0; b < BORDER_POLICY_COUNT; b++) {
+        border_policy_t border = (border_policy_t)b;
+        reference_filter(expected, &image, current, border);
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+          if (check("separable", current->filter, &image, expected, border,
+                    modes[m].bands, modes[m].reverse) == -1 ||
+              check("2d", convolution_2d_filter, &image, expected, border,
+                    modes[m].bands, modes[m].reverse) == -1) {
+            failed++;
+          } else {
+            passed++;
+          }
+        }
+      }
+    }
+    free(expected);
+    free(image.pixels);
+  }
+
+  printf("convolution: %d passed, %d failed\n", passed, failed);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}